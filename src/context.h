@@ -0,0 +1,155 @@
+#ifndef CONTEXT_H_INCLUDED
+#define CONTEXT_H_INCLUDED
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "contexttypes.h"
+#include "regtypes.h"
+#include "coretypes.h"
+#include "memtypes.h"
+#include "memmap.h"
+#include "core.h"
+#include "decode.h"
+#include "sched.h"
+#include "intc.h"
+#include "copro.h"
+#include "trace.h"
+
+
+// Contexts, and the state at their start, begin on a cache line, see `CONTEXT_STATE_SIZE`
+#if defined(__GNUC__) || defined(__clang__)
+	#define CONTEXT_ALIGNED __attribute__((aligned(64)))
+#else
+	#define CONTEXT_ALIGNED
+#endif
+
+// State of one emulated device
+// Every `core*()` and `memory*()` function works on the context it's given, so several devices
+// can run side by side, one per thread. Two contexts may share code memory, see `memoryInitShared()`.
+// A context must start zeroed (static, or allocated with `posix_memalign()`/`aligned_alloc()` and cleared),
+// and is quite big with the caches, so don't put it on the stack.
+struct EmuContext {
+	// What the emulated device is, and nothing else, comes first: data memory (SFRs included), registers,
+	// hidden core state, pending events and interrupts. It holds no pointers into the context, so copying
+	// `CONTEXT_STATE_SIZE` bytes from one context to another one running the same ROM clones, snapshots or
+	// resets it. Forked contexts must call `memoryUnshare()` first. Stop requests and interrupts raised from
+	// other threads are left out.
+	uint8_t DataMemory[0x10000 - ROM_WINDOW_SIZE] CONTEXT_ALIGNED;	// unless pages have been moved out, see `DataPages`
+
+	// core
+	CoreRegister_t CoreRegister;
+	int CycleCount;			// cycles taken by the last instruction
+	int RunCycles;			// cycles taken by the current `coreRun()` before the running instruction
+	int IntMaskCycle;		// how many steps the processor should ignore the interrupt
+	DATA_ACCESS_PAGE NextAccess;	// which segment the next data access would be accessing
+	int EAIncDelay;			// if last instruction should cause a wait cycle due to bus conflict
+#ifdef CORE_IDLE_SKIP
+	// state when a backward branch was last taken, see `core.c`
+	bool IsIdleValid;
+	uint64_t IdleKey[CORE_IDLE_KEY_SIZE];
+	int IdleCycles;			// cycles and instructions run in the current `coreRun()` by then
+	unsigned int IdleExecuted;
+#endif
+#ifdef CORE_LAZY_FLAGS
+	// flags the last flag-setting instruction hasn't written into PSW yet, see `core.c`
+	uint32_t LazyCarries;
+	int64_t LazyResult;
+	bool IsLazyZS;
+#endif
+#ifdef CORE_TRACE
+	uint64_t TraceClock;		// cycles run by the core before the current `coreRun()`/`coreStep()`, see `trace.c`
+#endif
+
+	// events, see `sched.c`
+	uint64_t SchedClock;		// cycles run by `schedRun()`
+	uint64_t SchedTarget;		// where the budget of the running `coreRun()` ends
+	bool IsSchedRunning;
+	unsigned int SchedCount;
+	uint8_t SchedHeap[SCHED_EVENTS];	// IDs of pending events, a min-heap by `SchedWhen`
+	uint8_t SchedPosition[SCHED_EVENTS];	// where each event is in `SchedHeap` + 1, 0 if it isn't pending
+	uint64_t SchedWhen[SCHED_EVENTS];
+	SchedHandler_t SchedHandlers[SCHED_EVENTS];
+
+#ifdef CORE_INTC
+	// interrupt controller, see `intc.c`
+	uint64_t IntcPending;		// IRQ registers, bit n is source n
+	uint64_t IntcEnable;		// IE registers
+	bool IntcRequest;		// some source is pending and enabled
+#endif
+
+	// The rest is how it's run: set up once, caches, and what the host talks to it with
+	volatile uint8_t CoreStopRequests[4] CONTEXT_ALIGNED;	// see `coreRequestStop()`, one is spare so that they're tested as a whole by translated code
+#ifdef CORE_INTC
+	volatile uint8_t IntcRaisedAny;	// set by `intcRaise()` after one of these, with release, see `intc.c`
+	volatile uint8_t IntcRaised[INTC_SOURCES];
+#endif
+	CoproHandler_t CoproHandler;	// runs what CR writes command, see `copro.h`
+#ifdef CORE_DUAL_VARIANT
+	bool IsU16;			// runs the nX-U16/100 core, see `core.h`
+#endif
+
+	// decoded instructions
+#ifdef CORE_PREDECODE
+	CoreInstruction_t DecodeCache[CODE_PAGE_COUNT][0x8000];
+#else
+	CoreInstruction_t DecodeCache[CORE_DECODE_CACHE_LINES];
+	uint32_t DecodeCacheTag[CORE_DECODE_CACHE_LINES];
+#endif
+	CoreInstruction_t UnmappedInstruction;
+	// what `CSR` resolves to for instruction fetch, see `_coreSetCodeSegment()` in `core.c`
+	const uint8_t *CodeSegment;	// its code memory, NULL if it's unmapped
+	SR_t CodeSegmentIndex;		// its page after mirrowing
+#ifdef CORE_BLOCK_CACHE
+	CoreBlock_t BlockCache[CORE_BLOCK_CACHE_LINES];
+#endif
+
+#ifdef CORE_JIT
+	// translated code, see `jit.h`
+	uint8_t *JitCode;
+	uint8_t *JitCodeNext;
+	bool IsJitBroken;
+	int JitCycles;
+	unsigned int JitLength;
+	unsigned int JitGeneration;
+#ifdef CORE_JIT_PERF_MAP
+	void *JitPerfMap;		// `FILE *` of the `perf` map
+#endif
+#endif
+
+	// memory
+	MemoryModel_t Model;		// layout of the device, see `memoryInitModel()`
+	void *CodeMemory;
+	uint8_t *DataPages[DATA_MEMORY_PAGES];	// where each page of data memory is, in `DataMemory` or `DataPageBlocks`
+	SharedDataPage_t *DataPageBlocks[DATA_MEMORY_PAGES];	// the shared page each of them is in, NULL if it's in `DataMemory`
+	uint32_t DataPagesShared;	// bit n: `DataPages[n]` may be used by other contexts, so it's copied before it's written
+	bool IsMemoryInited;
+	bool IsCodeShared;		// `CodeMemory` belongs to another context
+	MEMORY_STATUS MemoryStatus;	// status of last memory operation
+	unsigned int ROMWinAccessCount;	// tracks how many ROM window access has happened
+	// data memory dispatch, built from `Model`, see `mmu.c`
+	uint8_t MemorySegments[0x100];	// which of `MemoryPageTables` each segment uses
+	DataMemoryPage_t MemoryPageTables[MEMORY_PAGE_TABLES][0x100];
+	DataMemoryHandler_t MemorySplitPages[MEMORY_SPLIT_PAGES][0x100];	// handler of every byte
+	uint8_t MemoryPageTableCount;
+	uint8_t MemorySplitPageCount;
+	MemoryWatch_t Watches[MEMORY_WATCHES];	// see `memoryAddWatch()`
+	uint8_t WatchCount;
+	MemoryWatchHit_t WatchHit;	// the access that stopped `coreRun()` with `CORE_STOP_WATCH`
+#ifdef CORE_IDLE_SKIP
+	unsigned int MemoryWrites;	// counts data memory writes, wraps around
+#endif
+#ifdef CORE_TRACE
+	Trace_t *Trace;			// NULL unless it's being traced, see `trace.c`
+#endif
+
+	void *UserData;			// left to the host, e.g. peripheral state for `SFRHandler`
+};
+
+// Bytes at the start of a context which are the state of the emulated device, a whole number of cache lines
+#define CONTEXT_STATE_SIZE offsetof(EmuContext_t, CoreStopRequests)
+
+
+#endif
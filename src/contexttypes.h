@@ -0,0 +1,9 @@
+#ifndef CONTEXTTYPES_H_INCLUDED
+#define CONTEXTTYPES_H_INCLUDED
+
+
+// Everything one emulated device owns, see `context.h`
+typedef struct EmuContext EmuContext_t;
+
+
+#endif
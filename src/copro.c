@@ -0,0 +1,52 @@
+#include <stdint.h>
+
+#include "core.h"
+#include "copro.h"
+#include "context.h"
+
+
+// Multiply/divide coprocessor
+//
+// CXR0 (CR0~CR3): A, the multiplicand or dividend, gets the product or quotient
+// CXR4 (CR4~CR7): B, the multiplier or divisor, gets the remainder
+// CR8: mode, writing it (on its own or as part of a wider transfer) runs the operation at once,
+//	so the results are there for the next instruction, and the ROM never has to wait
+// CR9: status, see `COPRO_STATUS_DIV0`
+// CER10 (CR10~CR11): the other multiplier of `COPRO_MAC`
+// All of them are little-endian, so a whole operand goes in or out with one `MOV CXRn, [EA+]`.
+void coproMulDiv(EmuContext_t *ctx, unsigned int reg, unsigned int count) {
+	uint32_t a, b;
+
+	if( (reg > COPRO_MODE) || (reg + count <= COPRO_MODE) )
+		return;
+
+	a = CR.xrs[0];
+	b = CR.xrs[1];
+	CR.rs[COPRO_STATUS] = 0;
+
+	switch( CR.rs[COPRO_MODE] ) {
+		case COPRO_MUL:
+			CR.xrs[0] = (a & 0xffff) * (b & 0xffff);
+			break;
+
+		case COPRO_MULS:
+			CR.xrs[0] = (uint32_t)((int32_t)(int16_t)a * (int16_t)b);
+			break;
+
+		case COPRO_DIV:
+			b &= 0xffff;
+			// fall through
+		case COPRO_DIVL:
+			if( b == 0 ) {
+				CR.rs[COPRO_STATUS] = COPRO_STATUS_DIV0;
+				break;
+			}
+			CR.xrs[0] = a / b;
+			CR.xrs[1] = a % b;
+			break;
+
+		case COPRO_MAC:
+			CR.xrs[0] = a + (uint32_t)CR.ers[5] * (b & 0xffff);
+			break;
+	}
+}
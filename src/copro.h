@@ -0,0 +1,29 @@
+#ifndef COPRO_H_INCLUDED
+#define COPRO_H_INCLUDED
+
+
+#include <stdint.h>
+
+#include "contexttypes.h"
+
+
+// Called once an instruction has written `count` coprocessor registers, from CR`reg` on
+// That's where the coprocessor runs what the write commands, putting its results into `CR` (see `core.h`)
+// for the ROM to read back. Put it in `ctx -> CoproHandler`, or leave that NULL for a plain register file.
+typedef void (*CoproHandler_t)(EmuContext_t *ctx, unsigned int reg, unsigned int count);
+
+// Multiply/divide coprocessor of ClassWiz-class chips, see `coproMulDiv()`
+#define COPRO_MODE 8		// writing CR8 runs an operation
+#define COPRO_STATUS 9
+#define COPRO_MUL 0		// A = A[15:0] * B[15:0]
+#define COPRO_MULS 1		// the same, signed
+#define COPRO_DIV 2		// A = A / B[15:0], B = remainder
+#define COPRO_DIVL 3		// A = A / B, B = remainder
+#define COPRO_MAC 4		// A = A + CER10 * B[15:0]
+#define COPRO_STATUS_DIV0 0x01	// the last division was by zero, A and B are left alone then
+
+
+void coproMulDiv(EmuContext_t *ctx, unsigned int reg, unsigned int count);
+
+
+#endif
@@ -1,11 +1,34 @@
+#include <stddef.h>
 #include <stdbool.h>
+#include <limits.h>
 
 #include "mmu.h"
+#include "memmap.h"
 #include "core.h"
 #include "coretypes.h"
+#include "decode.h"
+#include "jit.h"
+#include "intc.h"
+#include "context.h"
 
 
-#define GET_DATA_SEG ((NextAccess == DATA_ACCESS_DSR)? DSR : (SR_t)0)
+// With `CORE_DUAL_VARIANT`, `core_u16.c` builds this file again as the nX-U16/100 core,
+// and functions that differ between the cores get the name of their core appended.
+// The ones that don't are only built here, along with those picking the core of a context.
+#ifdef CORE_U16_COPY
+	#define CORE_IS_U16
+#endif
+
+#if !defined(CORE_DUAL_VARIANT)
+	#define VARIANT(name) name
+#elif defined(CORE_IS_U16)
+	#define VARIANT(name) name##U16
+#else
+	#define VARIANT(name) name##U8
+#endif
+
+
+#define GET_DATA_SEG ((ctx -> NextAccess == DATA_ACCESS_DSR)? DSR : (SR_t)0)
 #define IS_ZERO(val) ((val)? 0 : 1)
 #define SIGN8(val) (((val) >> 7) & 1)
 #define SIGN16(val) (((val) >> 15) & 1)
@@ -19,53 +42,323 @@
 #endif
 
 
-// Tracks how many steps the processor should ignore the interrupt
-static int IntMaskCycle = 0;
-// Tracks which segment the next data access would be accessing
-static DATA_ACCESS_PAGE NextAccess = DATA_ACCESS_PAGE0;
-// Tracks if last instruction should cause a wait cycle due to bus conflict
-static int EAIncDelay = 0;
+// Picks the cycle count of the emulated core
+#ifdef CORE_IS_U16
+	#define CYCLES(u8, u16) (u16)
+#else
+	#define CYCLES(u8, u16) (u8)
+#endif
+
+// Instruction dispatching used by `_coreExecute()`
+// Computed gotos give every instruction its own indirect jump, which the host CPU predicts much better.
+#if defined(__GNUC__) && !defined(CORE_NO_COMPUTED_GOTO)
+	#define CORE_COMPUTED_GOTO
+#endif
+
+#ifdef CORE_COMPUTED_GOTO
+	#define LABEL(op) [op] = &&L_##op
+	#define TARGET(op) L_##op:
+	#define TARGET_DEFAULT(op) L_##op:
+	#define DISPATCH_BEGIN goto *DispatchTable[insn -> op];
+	#define DISPATCH_END
+	#define DISPATCH() goto *DispatchTable[insn -> op]
+	#define NEXT() do { RETIRE(); FETCH(); DISPATCH(); } while( 0 )
+#else
+	#define TARGET(op) case op:
+	#define TARGET_DEFAULT(op) default:
+	#ifdef CORE_BLOCK_CACHE
+		// `FUSE()` dispatches again without fetching
+		#define DISPATCH_BEGIN for( ;; ) { dispatch: switch( insn -> op ) {
+	#else
+		#define DISPATCH_BEGIN for( ;; ) { switch( insn -> op ) {
+	#endif
+	#define DISPATCH_END } next: RETIRE(); FETCH(); }
+	#define DISPATCH() goto dispatch
+	#define NEXT() goto next
+#endif
+
+// Checks if `_coreExecute()` should stop before the next instruction
+#define IS_STOPPING() ((totalCycles >= cycleBudget) || \
+		(isStoppable && (ctx -> CoreStopRequests[CORE_STOP_REQUEST_HOST] | ctx -> CoreStopRequests[CORE_STOP_REQUEST_INTERRUPT] | \
+		ctx -> CoreStopRequests[CORE_STOP_REQUEST_WATCH])))
+
+// Checks if data memory accesses are being traced, translated code doesn't tell the tracer about them
+#ifdef CORE_TRACE
+#define IS_TRACED() (ctx -> Trace != NULL)
+#else
+#define IS_TRACED() false
+#endif
+
+// Unpacks `insn` into the locals instructions work with
+#define UNPACK() do { \
+		PC = (PC + 2) & 0xfffe; \
+		regNumDest = insn -> dest; \
+		regNumSrc = insn -> src; \
+		imm = insn -> imm; \
+		ctx -> CycleCount = insn -> cycles; \
+		isEAInc = false; \
+		isDSRSet = false; \
+	} while( 0 )
+
+// Takes a pending interrupt, whose cycles count like an instruction's, see `intc.c`
+#ifdef CORE_INTC
+#define INTERRUPT() do { \
+		if( ctx -> IntcRequest | INTC_IS_RAISED(ctx) ) { \
+			SYNC_FLAGS(); \
+			totalCycles += intcDeliver(ctx); \
+			ctx -> RunCycles = totalCycles; \
+		} \
+	} while( 0 )
+#else
+#define INTERRUPT()
+#endif
 
+// Fetches the next instruction, or leaves if enough of them have been run
+#ifdef CORE_BLOCK_CACHE
+// Walks through the current block, and looks up the next one only when it runs out.
+#define FETCH() do { \
+		if( IS_STOPPING() ) \
+			goto done; \
+		while( blockNext == blockEnd ) { \
+			if( executed == count ) \
+				goto done; \
+			INTERRUPT(); \
+			_coreNextBlock(ctx, &blockNext, &blockEnd, &executed, count, &totalCycles, cycleBudget); \
+			if( IS_STOPPING() ) \
+				goto done; \
+		} \
+		insn = blockNext++; \
+		UNPACK(); \
+	} while( 0 )
+
+// Ends a DSR prefix, running the data access it has been fused with right away
+// Nothing is checked in between, the prefix masks interrupts for it anyway.
+#define FUSE() do { \
+		if( insn -> isFused && (blockNext != blockEnd) ) { \
+			RETIRE(); \
+			insn = blockNext++; \
+			UNPACK(); \
+			DISPATCH(); \
+		} \
+		NEXT(); \
+	} while( 0 )
+#else
+#define FETCH() do { \
+		if( (executed == count) || IS_STOPPING() ) \
+			goto done; \
+		INTERRUPT(); \
+		insn = _coreFetchCurrent(ctx); \
+		UNPACK(); \
+	} while( 0 )
+
+// Only blocks have fused prefixes
+#define FUSE() NEXT()
+#endif
 
-CoreRegister_t CoreRegister;
-// Records how many cycles the last instruction has taken
-int CycleCount;
+// Bytes moved by a coprocessor transfer through EA, see `CORE_OP`
+#define CR_WIDTH (1 << ((regNumSrc >> 1) & 3))
+
+// Lets the coprocessor run whatever writing `count` registers from CR`reg` on has commanded, see `copro.h`
+#define COPRO_WRITTEN(reg, count) do { \
+		if( ctx -> CoproHandler != NULL ) \
+			ctx -> CoproHandler(ctx, (reg), (count)); \
+	} while( 0 )
+
+// Updates hidden core states once an instruction has finished
+// Mask interrupts if DSR prefix instruction is used
+#define RETIRE() do { \
+		ctx -> EAIncDelay = isEAInc? 1 : 0; \
+		ctx -> NextAccess = isDSRSet? DATA_ACCESS_DSR : DATA_ACCESS_PAGE0; \
+		if( (ctx -> IntMaskCycle -= ctx -> CycleCount) < 0 ) \
+			ctx -> IntMaskCycle = 0; \
+		if( isDSRSet && (ctx -> IntMaskCycle == 0) ) \
+			++ctx -> IntMaskCycle; \
+		totalCycles += ctx -> CycleCount; \
+		ctx -> RunCycles = totalCycles; \
+		++executed; \
+	} while( 0 )
 
 
 // ALU operations, modifies PSW
 // A place to hide all the ugly code behind the scene
 // If only I could use the flags of the host CPU...
 
-// 8-bit addition
-static uint8_t _ALU_ADD(register uint8_t dest, register uint8_t src) {
+// C, OV and HC of additions and subtractions
+static inline void _FLAGS_ADD8(EmuContext_t *ctx, register uint8_t dest, register uint8_t src) {
 	uint16_t retVal = dest + src;
 	PSW.field.C = (retVal & 0x100)? 1 : 0;
-	retVal &= 0xff;
-	PSW.field.Z = IS_ZERO(retVal);
-	PSW.field.S = SIGN8(retVal);
 	// reference: Z80 user manual
 	PSW.field.OV = (((dest & 0x7f) + (src & 0x7f)) >> 7) ^ PSW.field.C;
 	PSW.field.HC = (((dest & 0x0f) + (src & 0x0f)) & 0x10)? 1 : 0;
-	return (uint8_t)retVal;
 }
 
-// 16-bit addition
-static uint16_t _ALU_ADD_W(register uint16_t dest, register uint16_t src) {
+static inline void _FLAGS_ADD16(EmuContext_t *ctx, register uint16_t dest, register uint16_t src) {
 	uint32_t retVal = dest + src;
 	PSW.field.C = (retVal & 0x10000)? 1 : 0;
-	retVal &= 0xffff;
-	PSW.field.Z = IS_ZERO(retVal);
-	PSW.field.S = SIGN16(retVal);
-	// reference: Z80 user manual
 	PSW.field.OV = (((dest & 0x7fff) + (src & 0x7fff)) >> 15) ^ PSW.field.C;
 	PSW.field.HC = (((dest & 0x0fff) + (src & 0x0fff)) & 0x1000)? 1 : 0;
-	return (uint16_t)retVal;
+}
+
+static inline void _FLAGS_SUB8(EmuContext_t *ctx, register uint8_t dest, register uint8_t src) {
+	uint16_t retVal = dest - src;
+	PSW.field.C = (retVal & 0x100)? 1 : 0;
+	PSW.field.OV = (((dest & 0x7f) - (src & 0x7f)) >> 7) ^ PSW.field.C;
+	PSW.field.HC = (((dest & 0x0f) - (src & 0x0f)) & 0x10)? 1 : 0;
+}
+
+static inline void _FLAGS_SUB16(EmuContext_t *ctx, register uint16_t dest, register uint16_t src) {
+	uint32_t retVal = dest - src;
+	PSW.field.C = (retVal & 0x10000)? 1 : 0;
+	PSW.field.OV = (((dest & 0x7fff) - (src & 0x7fff)) >> 15) ^ PSW.field.C;
+	PSW.field.HC = (((dest & 0x0fff) - (src & 0x0fff)) & 0x1000)? 1 : 0;
+}
+
+#ifdef CORE_LAZY_FLAGS
+// Flags that haven't been written to PSW yet
+// For the last addition/subtraction, `LazyCarries` keeps `dest ^ src ^ result` shifted to 16 bits:
+// bit 16 is C, bit 15 is the carry into the sign bit and bit 12 is HC. Bit 31 marks it as pending.
+// For the last result that sets Z and S, `LazyResult` keeps it sign-extended.
+#define LAZY_PENDING 0x80000000
+
+static inline uint32_t _LAZY_ADD8(uint8_t dest, uint8_t src) {
+	return (((uint32_t)dest ^ src ^ (uint32_t)(dest + src)) << 8) | LAZY_PENDING;
+}
+
+static inline uint32_t _LAZY_ADD16(uint16_t dest, uint16_t src) {
+	return ((uint32_t)dest ^ src ^ (uint32_t)(dest + src)) | LAZY_PENDING;
+}
+
+static inline uint32_t _LAZY_SUB8(uint8_t dest, uint8_t src) {
+	return (((uint32_t)dest ^ src ^ (uint32_t)(dest - src)) << 8) | LAZY_PENDING;
+}
+
+static inline uint32_t _LAZY_SUB16(uint16_t dest, uint16_t src) {
+	return ((uint32_t)dest ^ src ^ (uint32_t)(dest - src)) | LAZY_PENDING;
+}
+
+// Writes pending flags to PSW
+static void _coreSyncFlags(EmuContext_t *ctx) {
+	if( ctx -> LazyCarries ) {
+		PSW.field.C = (ctx -> LazyCarries >> 16) & 1;
+		PSW.field.OV = ((ctx -> LazyCarries >> 15) ^ (ctx -> LazyCarries >> 16)) & 1;
+		PSW.field.HC = (ctx -> LazyCarries >> 12) & 1;
+		ctx -> LazyCarries = 0;
+	}
+	if( ctx -> IsLazyZS ) {
+		PSW.field.Z = IS_ZERO(ctx -> LazyResult);
+		PSW.field.S = (ctx -> LazyResult < 0)? 1 : 0;
+		ctx -> IsLazyZS = false;
+	}
+}
+
+	#define SET_CARRIES(op, d, s) (ctx -> LazyCarries = _LAZY_##op(d, s))
+	// `val` must fit in `bits`
+	#define SET_ZS(val, bits) do { \
+			ctx -> LazyResult = (int64_t)((uint64_t)(val) << (64 - (bits))) >> (64 - (bits)); \
+			ctx -> IsLazyZS = true; \
+		} while( 0 )
+	// Must come before anything that reads or writes PSW by itself
+	#define SYNC_FLAGS() do { if( ctx -> LazyCarries || ctx -> IsLazyZS ) _coreSyncFlags(ctx); } while( 0 )
+	// Flags read by conditional branches, without syncing
+	#define FLAG_C (ctx -> LazyCarries? ((ctx -> LazyCarries >> 16) & 1) : PSW.field.C)
+	#define FLAG_OV (ctx -> LazyCarries? (((ctx -> LazyCarries >> 15) ^ (ctx -> LazyCarries >> 16)) & 1) : PSW.field.OV)
+	#define FLAG_Z (ctx -> IsLazyZS? (ctx -> LazyResult == 0) : PSW.field.Z)
+	#define FLAG_S (ctx -> IsLazyZS? (ctx -> LazyResult < 0) : PSW.field.S)
+#else
+	#define SET_CARRIES(op, d, s) _FLAGS_##op(ctx, d, s)
+	#define SET_ZS(val, bits) do { PSW.field.Z = IS_ZERO(val); PSW.field.S = ((val) >> ((bits) - 1)) & 1; } while( 0 )
+	#define SYNC_FLAGS()
+	#define FLAG_C (PSW.field.C)
+	#define FLAG_OV (PSW.field.OV)
+	#define FLAG_Z (PSW.field.Z)
+	#define FLAG_S (PSW.field.S)
+#endif
+
+#ifdef CORE_ALU_TABLES
+// Flags of `dest + src + carry`, indexed by `carry << 16 | dest << 8 | src`, in `PSW_t.raw` layout
+// A subtraction `dest - src - carry` is looked up as `dest + ~src + !carry`,
+// which gives the same flags except for C and HC, that are inverted.
+// It's constant so that all the contexts can share it, and with `CORE_DUAL_VARIANT` both cores do.
+extern const uint8_t AluFlagTable[2 * 256 * 256];
+
+#define ALU_FLAGS (PSW_C | PSW_Z | PSW_S | PSW_OV | PSW_HC)
+#define ALU_ADD8_FLAGS(d, s, c) (AluFlagTable[((c) << 16) | ((d) << 8) | (s)])
+#define ALU_SUB8_FLAGS(d, s, c) (AluFlagTable[((!(c)) << 16) | ((d) << 8) | (uint8_t)~(s)] ^ (PSW_C | PSW_HC))
+// Replaces all the ALU flags in one go
+#define ALU_SET_FLAGS(flags) (PSW.raw = (PSW.raw & ~ALU_FLAGS) | (flags))
+
+#ifndef CORE_U16_COPY
+// OV is set when both operands have the same sign and the result doesn't,
+// HC when bit 4 of the result isn't the one of `dest ^ src`, i.e. the low nibbles carried.
+#define ALU_ENTRY_OF(d, s, r) ((((r) >> 1) & PSW_C) | ((((r) & 0xff) == 0)? PSW_Z : 0) | (((r) >> 2) & PSW_S) | \
+		(((((d) ^ (r)) & ((s) ^ (r))) >> 3) & PSW_OV) | ((((d) ^ (s) ^ (r)) >> 2) & PSW_HC))
+#define ALU_ENTRY(carry, dest, src) ALU_ENTRY_OF(dest, src, (dest + src + carry))
+// Rows are built 16 entries at a time, pasting the low hex digit of `src` or `dest` to `high`
+#define ALU_ENTRY16(carry, dest, high) \
+		ALU_ENTRY(carry, dest, 0x##high##0), ALU_ENTRY(carry, dest, 0x##high##1), ALU_ENTRY(carry, dest, 0x##high##2), ALU_ENTRY(carry, dest, 0x##high##3), \
+		ALU_ENTRY(carry, dest, 0x##high##4), ALU_ENTRY(carry, dest, 0x##high##5), ALU_ENTRY(carry, dest, 0x##high##6), ALU_ENTRY(carry, dest, 0x##high##7), \
+		ALU_ENTRY(carry, dest, 0x##high##8), ALU_ENTRY(carry, dest, 0x##high##9), ALU_ENTRY(carry, dest, 0x##high##a), ALU_ENTRY(carry, dest, 0x##high##b), \
+		ALU_ENTRY(carry, dest, 0x##high##c), ALU_ENTRY(carry, dest, 0x##high##d), ALU_ENTRY(carry, dest, 0x##high##e), ALU_ENTRY(carry, dest, 0x##high##f)
+#define ALU_ROW(carry, dest) \
+		ALU_ENTRY16(carry, dest, 0), ALU_ENTRY16(carry, dest, 1), ALU_ENTRY16(carry, dest, 2), ALU_ENTRY16(carry, dest, 3), \
+		ALU_ENTRY16(carry, dest, 4), ALU_ENTRY16(carry, dest, 5), ALU_ENTRY16(carry, dest, 6), ALU_ENTRY16(carry, dest, 7), \
+		ALU_ENTRY16(carry, dest, 8), ALU_ENTRY16(carry, dest, 9), ALU_ENTRY16(carry, dest, a), ALU_ENTRY16(carry, dest, b), \
+		ALU_ENTRY16(carry, dest, c), ALU_ENTRY16(carry, dest, d), ALU_ENTRY16(carry, dest, e), ALU_ENTRY16(carry, dest, f)
+#define ALU_ROW16(carry, high) \
+		ALU_ROW(carry, 0x##high##0), ALU_ROW(carry, 0x##high##1), ALU_ROW(carry, 0x##high##2), ALU_ROW(carry, 0x##high##3), \
+		ALU_ROW(carry, 0x##high##4), ALU_ROW(carry, 0x##high##5), ALU_ROW(carry, 0x##high##6), ALU_ROW(carry, 0x##high##7), \
+		ALU_ROW(carry, 0x##high##8), ALU_ROW(carry, 0x##high##9), ALU_ROW(carry, 0x##high##a), ALU_ROW(carry, 0x##high##b), \
+		ALU_ROW(carry, 0x##high##c), ALU_ROW(carry, 0x##high##d), ALU_ROW(carry, 0x##high##e), ALU_ROW(carry, 0x##high##f)
+#define ALU_ROW256(carry) \
+		ALU_ROW16(carry, 0), ALU_ROW16(carry, 1), ALU_ROW16(carry, 2), ALU_ROW16(carry, 3), \
+		ALU_ROW16(carry, 4), ALU_ROW16(carry, 5), ALU_ROW16(carry, 6), ALU_ROW16(carry, 7), \
+		ALU_ROW16(carry, 8), ALU_ROW16(carry, 9), ALU_ROW16(carry, a), ALU_ROW16(carry, b), \
+		ALU_ROW16(carry, c), ALU_ROW16(carry, d), ALU_ROW16(carry, e), ALU_ROW16(carry, f)
+
+const uint8_t AluFlagTable[2 * 256 * 256] = { ALU_ROW256(0), ALU_ROW256(1) };
+#endif
+#endif
+
+// Flags of 8-bit additions and subtractions, `r` is the result
+// With `CORE_LAZY_FLAGS`, recording them is cheaper than looking them up.
+#if defined(CORE_ALU_TABLES) && !defined(CORE_LAZY_FLAGS)
+	#define SET_ADD8_FLAGS(d, s, r) ALU_SET_FLAGS(ALU_ADD8_FLAGS(d, s, 0))
+	#define SET_SUB8_FLAGS(d, s, r) ALU_SET_FLAGS(ALU_SUB8_FLAGS(d, s, 0))
+#else
+	#define SET_ADD8_FLAGS(d, s, r) do { SET_CARRIES(ADD8, d, s); SET_ZS(r, 8); } while( 0 )
+	#define SET_SUB8_FLAGS(d, s, r) do { SET_CARRIES(SUB8, d, s); SET_ZS(r, 8); } while( 0 )
+#endif
+
+// 8-bit addition
+static uint8_t _ALU_ADD(EmuContext_t *ctx, register uint8_t dest, register uint8_t src) {
+	uint8_t retVal = dest + src;
+	SET_ADD8_FLAGS(dest, src, retVal);
+	return retVal;
+}
+
+// 16-bit addition
+static uint16_t _ALU_ADD_W(EmuContext_t *ctx, register uint16_t dest, register uint16_t src) {
+	uint16_t retVal = dest + src;
+	SET_CARRIES(ADD16, dest, src);
+	SET_ZS(retVal, 16);
+	return retVal;
 }
 
 // 8-bit addition with carry
-static uint8_t _ALU_ADDC(register uint8_t dest, register uint8_t src) {
-	uint16_t retVal = dest + src + PSW.field.C;
-	uint8_t oldCarry = PSW.field.C;
+static uint8_t _ALU_ADDC(EmuContext_t *ctx, register uint8_t dest, register uint8_t src) {
+	uint8_t oldCarry;
+#ifndef CORE_ALU_TABLES
+	uint16_t retVal;
+#endif
+	SYNC_FLAGS();
+#ifdef CORE_ALU_TABLES
+	// Z is only kept if it was set
+	oldCarry = PSW.field.C;
+	ALU_SET_FLAGS(ALU_ADD8_FLAGS(dest, src, oldCarry) & (PSW.raw | ~PSW_Z));
+	return dest + src + oldCarry;
+#else
+	retVal = dest + src + PSW.field.C;
+	oldCarry = PSW.field.C;
 	PSW.field.C = (retVal & 0x100)? 1 : 0;
 	retVal &= 0xff;
 	PSW.field.Z = PSW.field.Z & IS_ZERO(retVal);
@@ -74,64 +367,61 @@ static uint8_t _ALU_ADDC(register uint8_t dest, register uint8_t src) {
 	PSW.field.OV = (((dest & 0x7f) + (src & 0x7f) + oldCarry) >> 7) ^ PSW.field.C;
 	PSW.field.HC = (((dest & 0x0f) + (src & 0x0f) + oldCarry) & 0x10)? 1 : 0;
 	return (uint8_t)retVal;
+#endif
 }
 
 // 8-bit logical AND
-static inline uint8_t _ALU_AND(register uint8_t dest, register uint8_t src) {
+static inline uint8_t _ALU_AND(EmuContext_t *ctx, register uint8_t dest, register uint8_t src) {
 	uint8_t retVal = dest & src;
-	PSW.field.Z = IS_ZERO(retVal);
-	PSW.field.S = SIGN8(retVal);
+	SET_ZS(retVal, 8);
 	return retVal;
 }
 
 // 8-bit logical OR
-static inline uint8_t _ALU_OR(register uint8_t dest, register uint8_t src) {
+static inline uint8_t _ALU_OR(EmuContext_t *ctx, register uint8_t dest, register uint8_t src) {
 	uint8_t retVal = dest | src;
-	PSW.field.Z = IS_ZERO(retVal);
-	PSW.field.S = SIGN8(retVal);
+	SET_ZS(retVal, 8);
 	return retVal;
 }
 
 // 8-bit logical XOR
-static inline uint8_t _ALU_XOR(register uint8_t dest, register uint8_t src) {
+static inline uint8_t _ALU_XOR(EmuContext_t *ctx, register uint8_t dest, register uint8_t src) {
 	uint8_t retVal = dest ^ src;
-	PSW.field.Z = IS_ZERO(retVal);
-	PSW.field.S = SIGN8(retVal);
+	SET_ZS(retVal, 8);
 	return retVal;
 }
 
 // 16-bit comparison
-static void _ALU_CMP_W(register uint16_t dest, register uint16_t src) {
-	uint32_t retVal = dest - src;
-	PSW.field.C = (retVal & 0x10000)? 1 : 0;
-	retVal &= 0xffff;
-	PSW.field.Z = IS_ZERO(retVal);
-	PSW.field.S = SIGN16(retVal);
-	// reference: Z80 user manual
-	PSW.field.OV = (((dest & 0x7fff) - (src & 0x7fff)) >> 15) ^ PSW.field.C;
-	PSW.field.HC = (((dest & 0x0fff) - (src & 0x0fff)) & 0x1000)? 1 : 0;
+static void _ALU_CMP_W(EmuContext_t *ctx, register uint16_t dest, register uint16_t src) {
+	uint16_t retVal = dest - src;
+	SET_CARRIES(SUB16, dest, src);
+	SET_ZS(retVal, 16);
 }
 
 // 8-bit comparison & subtraction
-static uint8_t _ALU_SUB(register uint8_t dest, register uint8_t src) {
-	uint16_t retVal = dest - src;
-	PSW.field.C = (retVal & 0x100)? 1 : 0;
-	retVal &= 0xff;
-	PSW.field.Z = IS_ZERO(retVal);
-	PSW.field.S = SIGN8(retVal);
-	// reference: Z80 user manual
-	PSW.field.OV = (((dest & 0x7f) - (src & 0x7f)) >> 7) ^ PSW.field.C;
-	PSW.field.HC = (((dest & 0x0f) - (src & 0x0f)) & 0x10)? 1 : 0;
-	return (uint8_t)retVal;
+static uint8_t _ALU_SUB(EmuContext_t *ctx, register uint8_t dest, register uint8_t src) {
+	uint8_t retVal = dest - src;
+	SET_SUB8_FLAGS(dest, src, retVal);
+	return retVal;
 }
 
-#define _ALU_CMP(d, s) _ALU_SUB(d, s)
+#define _ALU_CMP(d, s) _ALU_SUB(ctx, d, s)
 
 
 // 8-bit comparison & subtraction with carry
-static uint8_t _ALU_SUBC(register uint8_t dest, register uint8_t src) {
-	uint16_t retVal = dest - src - PSW.field.C;
-	uint8_t oldCarry = PSW.field.C;
+static uint8_t _ALU_SUBC(EmuContext_t *ctx, register uint8_t dest, register uint8_t src) {
+	uint8_t oldCarry;
+#ifndef CORE_ALU_TABLES
+	uint16_t retVal;
+#endif
+	SYNC_FLAGS();
+#ifdef CORE_ALU_TABLES
+	oldCarry = PSW.field.C;
+	ALU_SET_FLAGS(ALU_SUB8_FLAGS(dest, src, oldCarry) & (PSW.raw | ~PSW_Z));
+	return dest - src - oldCarry;
+#else
+	retVal = dest - src - PSW.field.C;
+	oldCarry = PSW.field.C;
 	PSW.field.C = (retVal & 0x100)? 1 : 0;
 	retVal &= 0xff;
 	PSW.field.Z = PSW.field.Z & IS_ZERO(retVal);
@@ -140,48 +430,53 @@ static uint8_t _ALU_SUBC(register uint8_t dest, register uint8_t src) {
 	PSW.field.OV = (((dest & 0x7f) - (src & 0x7f) - oldCarry) >> 7) ^ PSW.field.C;
 	PSW.field.HC = (((dest & 0x0f) - (src & 0x0f) - oldCarry) & 0x10)? 1 : 0;
 	return (uint8_t)retVal;
+#endif
 }
 
-#define _ALU_CMPC(d, s) _ALU_SUBC(d, s)
+#define _ALU_CMPC(d, s) _ALU_SUBC(ctx, d, s)
 
 // 8-bit logical left shift
-static uint8_t _ALU_SLL(register uint8_t data, register uint8_t count) {
+static uint8_t _ALU_SLL(EmuContext_t *ctx, register uint8_t data, register uint8_t count) {
 	uint16_t retVal;
 	if( count == 0 ) {
 		return data;
 	}
 	retVal = data << (count & 0x07);
+	SYNC_FLAGS();
 	PSW.field.C = (retVal & 0x100)? 1 : 0;
 	return (uint8_t)(retVal & 0xff);
 }
 
 // 8-bit logical right shift
-static uint8_t _ALU_SRL(register uint8_t data, register uint8_t count) {
+static uint8_t _ALU_SRL(EmuContext_t *ctx, register uint8_t data, register uint8_t count) {
 	uint16_t retVal;
 	if( count == 0 ) {
 		return data;
 	}
 	retVal = (data << 1) >> (count & 0x07);	// leave space for carry flag
+	SYNC_FLAGS();
 	PSW.field.C = retVal & 0x01;
 	return (uint8_t)((retVal >> 1) & 0xff);
 }
 
 // 8-bit arithmetic right shift
-static uint8_t _ALU_SRA(register uint8_t data, register uint8_t count) {
+static uint8_t _ALU_SRA(EmuContext_t *ctx, register uint8_t data, register uint8_t count) {
 	int16_t retVal;
 	if( count == 0 ) {
 		return data;
 	}
 	retVal = data << 8;		// use arithmetic shift of host processor
 	retVal >>= ((count & 0x07) + 7);	// leave space for carry flag
+	SYNC_FLAGS();
 	PSW.field.C = retVal & 0x01;
 	return (uint8_t)((retVal >> 1) & 0xff);
 }
 
 // decimal adjustment for addition
-static inline uint8_t _ALU_DAA(register uint16_t byte) {
+static inline uint8_t _ALU_DAA(EmuContext_t *ctx, register uint16_t byte) {
 	// Uh gosh this is so much of a pain
 	// reference: AMD64 general purpose and system instructions
+	SYNC_FLAGS();
 
 	// lower nibble
 	if( (byte & 0x0f) > 0x09 ) {
@@ -207,9 +502,10 @@ static inline uint8_t _ALU_DAA(register uint16_t byte) {
 }
 
 // decimal adjustment for subtraction
-static inline uint8_t _ALU_DAS(register uint16_t byte) {
+static inline uint8_t _ALU_DAS(EmuContext_t *ctx, register uint16_t byte) {
 	// This is even more confusing than DAA
 	// reference: AMD64 general purpose and system instructions
+	SYNC_FLAGS();
 
 	// lower nibble
 
@@ -234,32 +530,32 @@ static inline uint8_t _ALU_DAS(register uint16_t byte) {
 	return byte;
 }
 
-static inline uint8_t _ALU_NEG(register uint8_t byte) {
-	PSW.field.HC = (byte & 0x0f)? 1 : 0;
-	PSW.field.C = byte? 1 : 0;
-	PSW.field.OV = (byte == 0x80)? 1 : 0;		// (int8_t)0x80 == -128
-	byte = (0 - byte) & 0xff;
-	PSW.field.S = SIGN8(byte);
-	PSW.field.Z = IS_ZERO(byte);
-	return byte;
+// Same flags as `0 - byte`
+static inline uint8_t _ALU_NEG(EmuContext_t *ctx, register uint8_t byte) {
+	uint8_t retVal = (0 - byte) & 0xff;
+	SET_SUB8_FLAGS(0, byte, retVal);
+	return retVal;
 }
 
 // set bit
-static uint8_t _ALU_SB(register uint8_t data, register uint8_t bit) {
+static uint8_t _ALU_SB(EmuContext_t *ctx, register uint8_t data, register uint8_t bit) {
 	bit = 0x01 << (bit & 0x07);
+	SYNC_FLAGS();
 	PSW.field.Z = IS_ZERO(data & bit);
 	return (data | bit);
 }
 
 // test bit
-static void _ALU_TB(register uint8_t data, register uint8_t bit) {
+static void _ALU_TB(EmuContext_t *ctx, register uint8_t data, register uint8_t bit) {
 	bit = 0x01 << (bit & 0x07);
+	SYNC_FLAGS();
 	PSW.field.Z = IS_ZERO(data & bit);
 }
 
 // reset bit
-static uint8_t _ALU_RB(register uint8_t data, register uint8_t bit) {
+static uint8_t _ALU_RB(EmuContext_t *ctx, register uint8_t data, register uint8_t bit) {
 	bit = 0x01 << (bit & 0x07);
+	SYNC_FLAGS();
 	PSW.field.Z = IS_ZERO(data & bit);
 	return (data & ~bit);
 }
@@ -267,18 +563,18 @@ static uint8_t _ALU_RB(register uint8_t data, register uint8_t bit) {
 
 // Pushes a value onto U8/U16 stack
 // Note that it modifies SP
-static void _pushValue(uint64_t value, uint8_t bytes) {
+static void _pushValue(EmuContext_t *ctx, uint64_t value, uint8_t bytes) {
 	bytes = ((bytes > 8)? 8 : bytes);
 
 #ifdef CORE_IS_U16
 	if( bytes == 1 ) {
 		SP -= 2;
-		memorySetData(0, SP, 1, value);
+		memorySetData(ctx, 0, SP, 1, value);
 	}
 	else {
 		bytes = (bytes + 1) & 0xfffe;
 		SP -= bytes;
-		memorySetData(0, SP, bytes, value);
+		memorySetData(ctx, 0, SP, bytes, value);
 	}
 #else	// U8 stack
 	int i = 0;
@@ -286,7 +582,7 @@ static void _pushValue(uint64_t value, uint8_t bytes) {
 		--SP;
 	SP -= bytes;
 	while( bytes-- > 0 ) {
-		memorySetData(0, SP + i++, 1, value);
+		memorySetData(ctx, 0, SP + i++, 1, value);
 		value >>= 8;
 	}
 #endif
@@ -294,18 +590,18 @@ static void _pushValue(uint64_t value, uint8_t bytes) {
 
 // Pops a value from U8/U16 stack
 // Note that it modifies SP
-static uint64_t _popValue(uint8_t bytes) {
+static uint64_t _popValue(EmuContext_t *ctx, uint8_t bytes) {
 	uint64_t retVal = 0;
 
 #ifdef CORE_IS_U16
 	bytes = ((bytes > 8)? 8 : ((bytes + 1) & 0xfffe));
-	retVal = memoryGetData(0, SP, bytes);
+	retVal = memoryGetData(ctx, 0, SP, bytes);
 	SP += bytes;
 #else	// U8 stack
 	EA_t adj = (bytes + 1) & 0xfffe;
 	bytes = ((bytes > 8)? 8 : bytes);
 	while( bytes-- > 0 ) {
-		retVal = (retVal << 8) | memoryGetData(0, SP + bytes, 1);
+		retVal = (retVal << 8) | memoryGetData(ctx, 0, SP + bytes, 1);
 	}
 	SP += adj;
 #endif
@@ -314,7 +610,7 @@ static uint64_t _popValue(uint8_t bytes) {
 
 
 // Gets pointer to current EPSW
-static PSW_t* _getCurrEPSW(void) {
+static PSW_t* _getCurrEPSW(EmuContext_t *ctx) {
 	switch( PSW.field.ELevel ) {
 		case 2:
 			return &EPSW2;
@@ -326,13 +622,13 @@ static PSW_t* _getCurrEPSW(void) {
 }
 
 // Gets pointer to current ELR
-static inline PC_t* _getCurrELR(void) {
-	return &CoreRegister.LRs[PSW.field.ELevel];
+static inline PC_t* _getCurrELR(EmuContext_t *ctx) {
+	return &ctx -> CoreRegister.LRs[PSW.field.ELevel];
 }
 
 // Gets pointer to current ECSR
-static inline SR_t* _getCurrECSR(void) {
-	return &CoreRegister.LCSRs[PSW.field.ELevel];
+static inline SR_t* _getCurrECSR(EmuContext_t *ctx) {
+	return &ctx -> CoreRegister.LCSRs[PSW.field.ELevel];
 }
 
 
@@ -342,1481 +638,2088 @@ static uint16_t _signExtend(uint16_t num, uint8_t bits) {
 	return (retVal >> (16 - bits));
 }
 
-
-// Zeros all registers
-CORE_STATUS coreZero(void) {
-	DSR = 0;
-	CSR = 0;
-	LCSR = 0;
-	ECSR1 = 0;
-	ECSR2 = 0;
-	ECSR3 = 0;
-	PC = 0;
-	LR = 0;
-	ELR1 = 0;
-	ELR2 = 0;
-	ELR3 = 0;
-	EA = 0;
-	SP = 0;
-	PSW.raw = 0;
-	EPSW1.raw = 0;
-	EPSW2.raw = 0;
-	EPSW3.raw = 0;
-	GR.qrs[0] = 0;
-	GR.qrs[1] = 0;
-
-	return CORE_OK;
+// Fills in the opcode of a 1-word instruction
+static inline void _setOp(CoreInstruction_t *insn, CORE_OP op, uint8_t cycles) {
+	insn -> op = op;
+	insn -> cycles = cycles;
 }
 
+// Fills in the opcode of a 2-word instruction
+static inline void _setWideOp(CoreInstruction_t *insn, CORE_OP op, uint8_t cycles) {
+	insn -> op = op;
+	insn -> cycles = cycles;
+	insn -> words = 2;
+}
 
-// resets core
-CORE_STATUS coreReset(void) {
-	if( IsMemoryInited == false )
-		return CORE_MEMORY_UNINITIALIZED;
-
-	// reset registers
-	PSW.raw = 0;
-	CSR = 0;
-	DSR = 0;
-
-	// initialize SP
-	setSP(memoryGetCodeWord((SR_t)0, (PC_t)0x0000));
 
-	// initialize PC
-	PC = memoryGetCodeWord((SR_t)0, (PC_t)0x0002);
+// Decodes `MOV CRn, [EA]` and the rest of the 0xf_ _d group
+// 1111_nnnn_swwi_1101, s: store; w: CRn/CERn/CXRn/CQRn; i: [EA+]
+// They take as many cycles as the GR loads and stores of the same width.
+static void _decodeCoproTransfer(CoreInstruction_t *insn, uint16_t codeWord) {
+	static const uint8_t CYCLE_COUNT[4] = { 1, CYCLES(2, 1), CYCLES(4, 2), CYCLES(8, 4) };
+	unsigned int width = (codeWord >> 5) & 3;
 
-	// reset other core states
-	IntMaskCycle = 0;
-	NextAccess = DATA_ACCESS_PAGE0;
-	CycleCount = 0;
+	if( (insn -> dest & ((1 << width) - 1)) != 0 )
+		return;
 
-	return CORE_OK;
+	switch( codeWord & 0x0090 ) {
+		case 0x0000:
+			_setOp(insn, OP_L_CR_EA, CYCLE_COUNT[width]);
+			break;
+		case 0x0010:
+			_setOp(insn, OP_L_CR_EAP, CYCLE_COUNT[width]);
+			break;
+		case 0x0080:
+			_setOp(insn, OP_ST_CR_EA, CYCLE_COUNT[width]);
+			break;
+		case 0x0090:
+			_setOp(insn, OP_ST_CR_EAP, CYCLE_COUNT[width]);
+			break;
+	}
 }
 
-
-CORE_STATUS coreStep(void) {
-	CORE_STATUS retVal = CORE_OK;
-	CycleCount = 0;
+// Decodes `codeWord` into `insn`
+// For 2-word instructions (`insn -> words == 2`), the caller has to put the
+// trailing word into `insn -> imm`.
+void VARIANT(coreDecode)(CoreInstruction_t *insn, uint16_t codeWord) {
 	// xxxx_dddd_ssss_xxxx
 	// x: decodeIndex; d: Dest, s: src
-	uint8_t decodeIndex, regNumDest, regNumSrc, immNum;
-	uint16_t codeWord;
-	bool isEAInc = false;
-	bool isDSRSet = false;
-
-	uint64_t dest = 0, src = 0;
+	uint8_t decodeIndex = ((codeWord >> 8) & 0xf0) | (codeWord & 0x0f);
+	uint8_t immNum = codeWord & 0xff;
+
+	insn -> op = OP_ILLEGAL;
+	insn -> dest = (codeWord >> 8) & 0x0f;
+	insn -> src = (codeWord >> 4) & 0x0f;
+	insn -> cycles = 0;
+	insn -> imm = immNum;
+	insn -> words = 1;
+	insn -> isFused = false;
+
+	switch( decodeIndex >> 4 ) {
+		case 0x0:
+			_setOp(insn, OP_MOV_R_IMM, 1);
+			return;
+		case 0x1:
+			_setOp(insn, OP_ADD_R_IMM, 1);
+			return;
+		case 0x2:
+			_setOp(insn, OP_AND_R_IMM, 1);
+			return;
+		case 0x3:
+			_setOp(insn, OP_OR_R_IMM, 1);
+			return;
+		case 0x4:
+			_setOp(insn, OP_XOR_R_IMM, 1);
+			return;
+		case 0x5:
+			_setOp(insn, OP_CMPC_R_IMM, 1);
+			return;
+		case 0x6:
+			_setOp(insn, OP_ADDC_R_IMM, 1);
+			return;
+		case 0x7:
+			_setOp(insn, OP_CMP_R_IMM, 1);
+			return;
+
+		case 0xb:
+			insn -> imm = _signExtend(codeWord & 0x003f, 6);
+			switch( codeWord & 0x01c0 ) {
+				case 0x0000:
+					_setOp(insn, OP_L_ER_BP, 3);
+					break;
+				case 0x0040:
+					_setOp(insn, OP_L_ER_FP, 3);
+					break;
+				case 0x0080:
+					_setOp(insn, OP_ST_ER_BP, 3);
+					break;
+				case 0x00c0:
+					_setOp(insn, OP_ST_ER_FP, 3);
+					break;
+			}
+			return;
+
+		case 0xc:
+			// B<cond> Radr
+			if( (codeWord & 0x0f00) == 0x0f00 )
+				return;
+			insn -> imm = (_signExtend(immNum, 8) << 1) & 0xffff;
+			_setOp(insn, OP_BGE + ((codeWord >> 8) & 0x0f), 1);
+			return;
+
+		case 0xd:
+			insn -> imm = _signExtend(codeWord & 0x003f, 6);
+			switch( codeWord & 0x00c0 ) {
+				case 0x0000:
+					_setOp(insn, OP_L_R_BP, 3);
+					break;
+				case 0x0040:
+					_setOp(insn, OP_L_R_FP, 3);
+					break;
+				case 0x0080:
+					_setOp(insn, OP_ST_R_BP, 3);
+					break;
+				case 0x00c0:
+					_setOp(insn, OP_ST_R_FP, 3);
+					break;
+			}
+			return;
 
-	if( IsMemoryInited == false ) {
-		retVal = CORE_MEMORY_UNINITIALIZED;
-		goto exit;
+		case 0xe:
+			// I don't like it when it has immediates on the end of the instructions
+			if( (codeWord & 0x0180) == 0x0000 ) {
+				insn -> imm = _signExtend(codeWord & 0x007f, 7);
+				_setOp(insn, OP_MOV_ER_IMM, CYCLES(2, 1));
+				return;
+			}
+			if( (codeWord & 0x0180) == 0x0080 ) {
+				insn -> imm = _signExtend(codeWord & 0x007f, 7);
+				_setOp(insn, OP_ADD_ER_IMM, CYCLES(2, 1));
+				return;
+			}
+			switch( codeWord & 0x0f00 ) {
+				case 0x0100:
+					insn -> imm = _signExtend(immNum, 8);
+					_setOp(insn, OP_ADD_SP_IMM, 2);
+					break;
+				case 0x0300:
+					_setOp(insn, OP_LDSR_IMM, 1);
+					break;
+				case 0x0500:
+					// cycles are counted by `coreDoSWI()`
+					_setOp(insn, OP_SWI, 0);
+					break;
+				case 0x0900:
+					_setOp(insn, OP_MOV_PSW_IMM, 1);
+					break;
+				case 0x0b00:
+					if( codeWord == 0xeb7f )
+						_setOp(insn, OP_RC, 1);
+					else if( codeWord == 0xebf7 )
+						_setOp(insn, OP_DI, 3);
+					break;
+				case 0x0d00:
+					if( codeWord == 0xed08 )
+						_setOp(insn, OP_EI, 1);
+					else if( codeWord == 0xed80 )
+						_setOp(insn, OP_SC, 1);
+					break;
+				default:
+					// not an instruction, but the core never complained about it
+					_setOp(insn, OP_NONE, 0);
+					break;
+			}
+			return;
 	}
 
-	// fetch instruction
-	codeWord = memoryGetCodeWord(CSR, PC);
-	PC = (PC + 2) & 0xfffe;		// increment PC
-
-	decodeIndex = ((codeWord >> 8) & 0xf0) | (codeWord & 0x0f);
-	regNumDest = (codeWord >> 8) & 0x0f;
-	regNumSrc = (codeWord >> 4) & 0x0f;
-	immNum = codeWord & 0xff;
 	switch( decodeIndex ) {
-		case 0x00:
-		case 0x01:
-		case 0x02:
-		case 0x03:
-		case 0x04:
-		case 0x05:
-		case 0x06:
-		case 0x07:
-		case 0x08:
-		case 0x09:
-		case 0x0a:
-		case 0x0b:
-		case 0x0c:
-		case 0x0d:
-		case 0x0e:
-		case 0x0f:
-			// MOV Rn, #imm8
-			CycleCount = 1;
-			GR.rs[regNumDest] = immNum;
-
-			PSW.field.Z = IS_ZERO(immNum);
-			PSW.field.S = SIGN8(immNum);
-			break;
-
-		case 0x10:
-		case 0x11:
-		case 0x12:
-		case 0x13:
-		case 0x14:
-		case 0x15:
-		case 0x16:
-		case 0x17:
-		case 0x18:
-		case 0x19:
-		case 0x1a:
-		case 0x1b:
-		case 0x1c:
-		case 0x1d:
-		case 0x1e:
-		case 0x1f:
-			// ADD Rn, #imm8
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			GR.rs[regNumDest] = _ALU_ADD(dest, immNum);
-			break;
-
-		case 0x20:
-		case 0x21:
-		case 0x22:
-		case 0x23:
-		case 0x24:
-		case 0x25:
-		case 0x26:
-		case 0x27:
-		case 0x28:
-		case 0x29:
-		case 0x2a:
-		case 0x2b:
-		case 0x2c:
-		case 0x2d:
-		case 0x2e:
-		case 0x2f:
-			// AND Rn, #imm8
-			CycleCount = 1;
-			dest = GR.rs[(codeWord >> 8) & 0x0f];
-			GR.rs[regNumDest] = _ALU_AND(dest, immNum);
-			break;
-
-		case 0x30:
-		case 0x31:
-		case 0x32:
-		case 0x33:
-		case 0x34:
-		case 0x35:
-		case 0x36:
-		case 0x37:
-		case 0x38:
-		case 0x39:
-		case 0x3a:
-		case 0x3b:
-		case 0x3c:
-		case 0x3d:
-		case 0x3e:
-		case 0x3f:
-			// OR Rn, #imm8
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			GR.rs[regNumDest] = _ALU_OR(dest, immNum);
-			break;
-
-		case 0x40:
-		case 0x41:
-		case 0x42:
-		case 0x43:
-		case 0x44:
-		case 0x45:
-		case 0x46:
-		case 0x47:
-		case 0x48:
-		case 0x49:
-		case 0x4a:
-		case 0x4b:
-		case 0x4c:
-		case 0x4d:
-		case 0x4e:
-		case 0x4f:
-			// XOR Rn, #imm8
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			GR.rs[regNumDest] = _ALU_XOR(dest, immNum);
-			break;
-
-		case 0x50:
-		case 0x51:
-		case 0x52:
-		case 0x53:
-		case 0x54:
-		case 0x55:
-		case 0x56:
-		case 0x57:
-		case 0x58:
-		case 0x59:
-		case 0x5a:
-		case 0x5b:
-		case 0x5c:
-		case 0x5d:
-		case 0x5e:
-		case 0x5f:
-			// CMPC Rn, #imm8
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			_ALU_CMPC(dest, immNum);
-			break;
-
-		case 0x60:
-		case 0x61:
-		case 0x62:
-		case 0x63:
-		case 0x64:
-		case 0x65:
-		case 0x66:
-		case 0x67:
-		case 0x68:
-		case 0x69:
-		case 0x6a:
-		case 0x6b:
-		case 0x6c:
-		case 0x6d:
-		case 0x6e:
-		case 0x6f:
-			// ADDC Rn, #imm8
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			GR.rs[regNumDest] = _ALU_ADDC(dest, immNum);
-			break;
-
-		case 0x70:
-		case 0x71:
-		case 0x72:
-		case 0x73:
-		case 0x74:
-		case 0x75:
-		case 0x76:
-		case 0x77:
-		case 0x78:
-		case 0x79:
-		case 0x7a:
-		case 0x7b:
-		case 0x7c:
-		case 0x7d:
-		case 0x7e:
-		case 0x7f:
-			// CMP Rn, #imm8
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			_ALU_CMP(dest, immNum);
-			break;
-
 		case 0x80:
-			// MOV Rn, Rm
-			CycleCount = 1;
-			src = GR.rs[regNumSrc];
-
-			PSW.field.Z = IS_ZERO(src);
-			PSW.field.S = SIGN8(src);
-
-			GR.rs[regNumDest] = src;
+			_setOp(insn, OP_MOV_R_R, 1);
 			break;
-
 		case 0x81:
-			// ADD Rn, Rm
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			GR.rs[regNumDest] = _ALU_ADD(dest, src);
+			_setOp(insn, OP_ADD_R_R, 1);
 			break;
-
 		case 0x82:
-			// AND Rn, Rm
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			GR.rs[regNumDest] = _ALU_AND(dest, src);
+			_setOp(insn, OP_AND_R_R, 1);
 			break;
-
 		case 0x83:
-			// OR Rn, Rm
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			GR.rs[regNumDest] = _ALU_OR(dest, src);
+			_setOp(insn, OP_OR_R_R, 1);
 			break;
-
 		case 0x84:
-			// XOR Rn, Rm
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			GR.rs[regNumDest] = _ALU_XOR(dest, src);
+			_setOp(insn, OP_XOR_R_R, 1);
 			break;
-
 		case 0x85:
-			// CMPC Rn, Rm
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			_ALU_CMPC(dest, src);
+			_setOp(insn, OP_CMPC_R_R, 1);
 			break;
-
 		case 0x86:
-			// ADDC Rn, Rm
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			GR.rs[regNumDest] = _ALU_ADDC(dest, src);
+			_setOp(insn, OP_ADDC_R_R, 1);
 			break;
-
 		case 0x87:
-			// CMP Rn, Rm
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			_ALU_CMP(dest, src);
+			_setOp(insn, OP_CMP_R_R, 1);
 			break;
-
 		case 0x88:
-			// SUB Rn, Rm
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			GR.rs[regNumDest] = _ALU_SUB(dest, src);
+			_setOp(insn, OP_SUB_R_R, 1);
 			break;
-
 		case 0x89:
-			// SUBC Rn, Rm
-			CycleCount = 1;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			GR.rs[regNumDest] = _ALU_SUBC(dest, src);
+			_setOp(insn, OP_SUBC_R_R, 1);
 			break;
-
 		case 0x8a:
-			// SLL Rn, Rm
-			CycleCount = 1 + EAIncDelay;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			GR.rs[regNumDest] = _ALU_SLL(dest, src);
+			_setOp(insn, OP_SLL_R_R, 1);
 			break;
-
 		case 0x8b:
-			// SLLC Rn, Rm
-			CycleCount = 1 + EAIncDelay;
-			src = GR.rs[regNumSrc] & 0x07;
-			if( src == 0 ) {
-				break;
-			}
-			dest = (GR.rs[regNumDest] << 8) | GR.rs[(regNumDest - 1) & 0x0f];
-
-			dest >>= (8 - src);
-			PSW.field.C = (dest & 0x100)? 1 : 0;
-
-			GR.rs[regNumDest] = (dest & 0xff);
-
+			_setOp(insn, OP_SLLC_R_R, 1);
 			break;
-
 		case 0x8c:
-			// SRL Rn, Rm
-			CycleCount = 1 + EAIncDelay;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			GR.rs[regNumDest] = _ALU_SRL(dest, src);
+			_setOp(insn, OP_SRL_R_R, 1);
 			break;
-
 		case 0x8d:
-			// SRLC Rn, Rm
-			CycleCount = 1 + EAIncDelay;
-			src = GR.rs[regNumSrc] & 0x07;
-			if( src == 0 ) {
-				break;
-			}
-			dest = (GR.rs[(regNumDest + 1) & 0x0f] << 9) | (GR.rs[regNumDest] << 1);	// bit 0 for carry
-
-			dest >>= src;
-			PSW.field.C = dest & 0x01;
-
-			GR.rs[regNumDest] = ((dest >> 1) & 0xff);
-
+			_setOp(insn, OP_SRLC_R_R, 1);
 			break;
-
 		case 0x8e:
-			// SRA Rn, Rm
-			CycleCount = 1 + EAIncDelay;
-			dest = GR.rs[regNumDest];
-			src = GR.rs[regNumSrc];
-			GR.rs[regNumDest] = _ALU_SRA(dest, src);
+			_setOp(insn, OP_SRA_R_R, 1);
 			break;
 
 		case 0x8f:
 			if( (codeWord & 0xf11f) == 0x810f ) {
-				//EXTBW ERn
-				src = GR.rs[regNumSrc];
-
-				PSW.field.S = SIGN8(src);
-				PSW.field.Z = IS_ZERO(src);
-
-				GR.rs[regNumDest] = PSW.field.S? 0xff : 0;
+				// EXTBW never set a cycle count
+				_setOp(insn, OP_EXTBW, 0);
 				break;
 			}
 			switch( codeWord & 0xf0ff ) {
 				case 0x801f:
-					// DAA Rn
-					// Uh gosh this is so much of a pain
-					// reference: AMD64 general purpose and system instructions
-					CycleCount = 1;
-					dest = GR.rs[regNumDest];
-					GR.rs[regNumDest] = _ALU_DAA(dest);
+					_setOp(insn, OP_DAA, 1);
 					break;
-
 				case 0x803f:
-					// DAS Rn
-					// This is even more confusing than DAA
-					// reference: AMD64 general purpose and system instructions
-					CycleCount = 1;
-					dest = GR.rs[regNumDest];
-					GR.rs[regNumDest] = _ALU_DAS(dest);
+					_setOp(insn, OP_DAS, 1);
 					break;
-
 				case 0x805f:
-					//NEG Rn
-					CycleCount = 1;
-					dest = GR.rs[regNumDest];
-					GR.rs[regNumDest] = _ALU_NEG(dest);
-					break;
-
-				default:
-					retVal = CORE_ILLEGAL_INSTRUCTION;
+					_setOp(insn, OP_NEG, 1);
 					break;
 			}
 			break;
 
 		case 0x90:
 			if( (codeWord & 0x0010) == 0x0000 ) {
-				// L Rn, [ERm]
-				src = GR.ers[regNumSrc >> 1];
-				CycleCount += EAIncDelay;
+				_setOp(insn, OP_L_R_ERM, 1);
+				break;
 			}
-			else {
-				switch( codeWord & 0xf0ff ) {
-					case 0x9010:
-						// L Rn, [adr]
-						// fetch source address
-						src = memoryGetCodeWord(CSR, PC);
-						PC = (PC + 2) & 0xfffe;
-						CycleCount += EAIncDelay;
-						break;
-
-					case 0x9030:
-						// L Rn, [EA]
-						src = EA;
-						break;
-
-					case 0x9050:
-						// L Rn, [EA+]
-						src = EA;
-						EA += 1; isEAInc = true;
-						break;
-
-					default:
-						retVal = CORE_ILLEGAL_INSTRUCTION;
-						goto exit;
-				}
+			switch( codeWord & 0xf0ff ) {
+				case 0x9010:
+					_setWideOp(insn, OP_L_R_ADR, 1);
+					break;
+				case 0x9030:
+					_setOp(insn, OP_L_R_EA, 1);
+					break;
+				case 0x9050:
+					_setOp(insn, OP_L_R_EAP, 1);
+					break;
 			}
-
-			dest = memoryGetData(GET_DATA_SEG, src, 1);
-			CycleCount += 1 + ROMWinAccessCount;
-
-			PSW.field.S = SIGN8(dest);
-			PSW.field.Z = IS_ZERO(dest);
-			GR.rs[regNumDest] = dest;
 			break;
 
 		case 0x91:
 			if( (codeWord & 0x0010) == 0x0000 ) {
-				// ST Rn, [ERm]
-				dest = GR.ers[regNumSrc >> 1];
-				CycleCount += EAIncDelay;
+				_setOp(insn, OP_ST_R_ERM, 1);
+				break;
 			}
-			else {
-				switch( codeWord & 0xf0ff ) {
-					case 0x9011:
-						// ST Rn, [adr]
-						// fetch destination address
-						dest = memoryGetCodeWord(CSR, PC);
-						PC = (PC + 2) & 0xfffe;
-						CycleCount += EAIncDelay;
-						break;
-
-					case 0x9031:
-						// ST Rn, [EA]
-						dest = EA;
-						break;
-
-					case 0x9051:
-						// ST Rn, [EA+]
-						dest = EA;
-						EA += 1; isEAInc = true;
-						break;
-
-					default:
-						retVal = CORE_ILLEGAL_INSTRUCTION;
-						goto exit;
-				}
+			switch( codeWord & 0xf0ff ) {
+				case 0x9011:
+					_setWideOp(insn, OP_ST_R_ADR, 1);
+					break;
+				case 0x9031:
+					_setOp(insn, OP_ST_R_EA, 1);
+					break;
+				case 0x9051:
+					_setOp(insn, OP_ST_R_EAP, 1);
+					break;
 			}
-
-			memorySetData(GET_DATA_SEG, dest, 1, GR.rs[regNumDest]);
-			CycleCount += 1;
 			break;
 
 		case 0x92:
 			if( (codeWord & 0x0110) == 0x0000 ) {
-				// L ERn, [ERm]
-				src = GR.ers[regNumSrc >> 1];
-				CycleCount += EAIncDelay;
+				_setOp(insn, OP_L_ER_ERM, CYCLES(2, 1));
+				break;
 			}
-			else {
-				switch( codeWord & 0xf1ff ) {
-					case 0x9012:
-						// L ERn, [adr]
-						// fetch source address
-						src = memoryGetCodeWord(CSR, PC);
-						PC = (PC + 2) & 0xfffe;
-						CycleCount += EAIncDelay;
-						break;
-
-					case 0x9032:
-						// L ERn, [EA]
-						src = EA;
-						break;
-
-					case 0x9052:
-						// L ERn, [EA+]
-						src = EA;
-						EA = (EA + 2) & 0xfffe; isEAInc = true;
-						break;
-
-					default:
-						retVal = CORE_ILLEGAL_INSTRUCTION;
-						goto exit;
-				}
+			switch( codeWord & 0xf1ff ) {
+				case 0x9012:
+					_setWideOp(insn, OP_L_ER_ADR, CYCLES(2, 1));
+					break;
+				case 0x9032:
+					_setOp(insn, OP_L_ER_EA, CYCLES(2, 1));
+					break;
+				case 0x9052:
+					_setOp(insn, OP_L_ER_EAP, CYCLES(2, 1));
+					break;
 			}
-
-			dest = memoryGetData(GET_DATA_SEG, src, 2);
-#ifdef CORE_IS_U16
-				CycleCount += 1 + (ROMWinAccessCount + 1) / 2;
-#else
-				CycleCount += 2 + ROMWinAccessCount;
-#endif
-
-			PSW.field.S = SIGN16(dest);
-			PSW.field.Z = IS_ZERO(dest);
-			GR.ers[regNumDest >> 1] = dest;
 			break;
 
 		case 0x93:
 			if( (codeWord & 0x0110) == 0x0000 ) {
-				// ST ERn, [ERm]
-				dest = GR.ers[regNumSrc >> 1];
-				CycleCount += EAIncDelay;
+				_setOp(insn, OP_ST_ER_ERM, CYCLES(2, 1));
+				break;
 			}
-			else {
-				switch( codeWord & 0xf1ff ) {
-					case 0x9013:
-						// ST ERn, [adr]
-						// fetch destination address
-						dest = memoryGetCodeWord(CSR, PC);
-						PC = (PC + 2) & 0xfffe;
-						CycleCount += EAIncDelay;
-						break;
-
-					case 0x9033:
-						// ST ERn, [EA]
-						dest = EA;
-						break;
-
-					case 0x9053:
-						// ST ERn, [EA+]
-						dest = EA;
-						EA = (EA + 2) & 0xfffe; isEAInc = true;
-						break;
-
-					default:
-						retVal = CORE_ILLEGAL_INSTRUCTION;
-						goto exit;
-				}
+			switch( codeWord & 0xf1ff ) {
+				case 0x9013:
+					_setWideOp(insn, OP_ST_ER_ADR, CYCLES(2, 1));
+					break;
+				case 0x9033:
+					_setOp(insn, OP_ST_ER_EA, CYCLES(2, 1));
+					break;
+				case 0x9053:
+					_setOp(insn, OP_ST_ER_EAP, CYCLES(2, 1));
+					break;
 			}
-
-			memorySetData(GET_DATA_SEG, dest, 2, GR.ers[regNumDest >> 1]);
-#ifdef CORE_IS_U16
-				CycleCount += 1;
-#else
-				CycleCount += 2;
-#endif
 			break;
 
 		case 0x94:
-			src = EA;
 			switch( codeWord & 0xf3ff ) {
 				case 0x9034:
-					// L XRn, [EA]
+					_setOp(insn, OP_L_XR_EA, CYCLES(4, 2));
 					break;
-
 				case 0x9054:
-					// L XRn, [EA+]
-					EA = (EA + 4) & 0xfffe;
-					isEAInc = true;
+					_setOp(insn, OP_L_XR_EAP, CYCLES(4, 2));
 					break;
-
-				default:
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					goto exit;
 			}
-
-			dest = memoryGetData(GET_DATA_SEG, src, 4);
-#ifdef CORE_IS_U16
-				CycleCount = 2 + (ROMWinAccessCount + 1) / 2;
-#else
-				CycleCount = 4 + ROMWinAccessCount;
-#endif
-
-			PSW.field.S = SIGN32(dest);
-			PSW.field.Z = IS_ZERO(dest);
-			GR.xrs[regNumDest >> 2] = dest;
 			break;
 
 		case 0x95:
-			dest = EA;
 			switch( codeWord & 0xf3ff ) {
 				case 0x9035:
-					// ST XRn, [EA]
+					_setOp(insn, OP_ST_XR_EA, CYCLES(4, 2));
 					break;
-
 				case 0x9055:
-					// ST XRn, [EA+]
-					EA = (EA + 4) & 0xfffe;
-					isEAInc = true;
+					_setOp(insn, OP_ST_XR_EAP, CYCLES(4, 2));
 					break;
-
-				default:
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					goto exit;
 			}
-
-			memorySetData(GET_DATA_SEG, dest, 4, GR.xrs[regNumDest >> 2]);
-#ifdef CORE_IS_U16
-				CycleCount = 2;
-#else
-				CycleCount = 4;
-#endif
 			break;
 
 		case 0x96:
-			src = EA;
 			switch( codeWord & 0xf7ff ) {
 				case 0x9036:
-					// L QRn, [EA]
+					_setOp(insn, OP_L_QR_EA, CYCLES(8, 4));
 					break;
-
 				case 0x9056:
-					// L QRn, [EA+]
-					EA = (EA + 8) & 0xfffe;
-					isEAInc = true;
+					_setOp(insn, OP_L_QR_EAP, CYCLES(8, 4));
 					break;
-
-				default:
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					goto exit;
 			}
-
-			dest = memoryGetData(GET_DATA_SEG, src, 8);
-#ifdef CORE_IS_U16
-				CycleCount = 4 + (ROMWinAccessCount + 1) / 2;
-#else
-				CycleCount = 8 + ROMWinAccessCount;
-#endif
-
-			PSW.field.S = SIGN64(dest);
-			PSW.field.Z = IS_ZERO(dest);
-			GR.qrs[regNumDest >> 3] = dest;
 			break;
 
 		case 0x97:
-			dest = EA;
 			switch( codeWord & 0xf7ff ) {
 				case 0x9037:
-					// ST QRn, [EA]
+					_setOp(insn, OP_ST_QR_EA, CYCLES(8, 4));
 					break;
-
 				case 0x9057:
-					// ST QRn, [EA+]
-					EA = (EA + 8) & 0xfffe;
-					isEAInc = true;
+					_setOp(insn, OP_ST_QR_EAP, CYCLES(8, 4));
 					break;
-
-				default:
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					goto exit;
 			}
-
-			memorySetData(GET_DATA_SEG, dest, 8, GR.qrs[regNumDest >> 3]);
-#ifdef CORE_IS_U16
-				CycleCount = 4;
-#else
-				CycleCount = 8;
-#endif
 			break;
 
 		case 0x98:
-			if( (codeWord & 0xf01f) != 0x9008 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// L Rn, d16[ERm]
-			src = GR.ers[regNumSrc >> 1];
-			src = (src + memoryGetCodeWord(CSR, PC)) & 0xffff;
-			PC = (PC + 2) & 0xfffe;
-			dest = memoryGetData(GET_DATA_SEG, src, 1);
-			GR.rs[regNumDest] = dest;
-			PSW.field.S = SIGN8(dest);
-			PSW.field.Z = IS_ZERO(dest);
-			CycleCount = 2 + ROMWinAccessCount + EAIncDelay;
+			if( (codeWord & 0xf01f) == 0x9008 )
+				_setWideOp(insn, OP_L_R_D16, 2);
 			break;
 
 		case 0x99:
-			if( (codeWord & 0xf01f) != 0x9009 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// ST Rn, d16[ERm]
-			dest = GR.ers[regNumSrc >> 1];
-			dest = (dest + memoryGetCodeWord(CSR, PC)) & 0xffff;
-			PC = (PC + 2) & 0xfffe;
-			memorySetData(GET_DATA_SEG, dest, 1, GR.rs[regNumDest]);
-			CycleCount = 2 + EAIncDelay;
+			if( (codeWord & 0xf01f) == 0x9009 )
+				_setWideOp(insn, OP_ST_R_D16, 2);
 			break;
 
 		case 0x9a:
-			if( (codeWord & 0x0080) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// SLL Rn, #width
-			CycleCount = 1 + EAIncDelay;
-			dest = GR.rs[regNumDest];
-			src = regNumSrc;
-			GR.rs[regNumDest] = _ALU_SLL(dest, src);
+			if( (codeWord & 0x0080) == 0x0000 )
+				_setOp(insn, OP_SLL_R_IMM, 1);
 			break;
 
 		case 0x9b:
-			if( (codeWord & 0x0080) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// SLLC Rn, #width
-			CycleCount = 1 + EAIncDelay;
-			src = regNumSrc;
-			if( src == 0 ) {
-				break;
-			}
-			dest = (GR.rs[regNumDest] << 8) | GR.rs[(regNumDest - 1) & 0x0f];
-
-			dest >>= (8 - src);
-			PSW.field.C = (dest & 0x100)? 1 : 0;
-
-			GR.rs[regNumDest] = (dest & 0xff);
-
+			if( (codeWord & 0x0080) == 0x0000 )
+				_setOp(insn, OP_SLLC_R_IMM, 1);
 			break;
 
 		case 0x9c:
-			if( (codeWord & 0x0080) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// SRL Rn, #width
-			CycleCount = 1 + EAIncDelay;
-			dest = GR.rs[regNumDest];
-			src = regNumSrc;
-			GR.rs[regNumDest] = _ALU_SRL(dest, src);
+			if( (codeWord & 0x0080) == 0x0000 )
+				_setOp(insn, OP_SRL_R_IMM, 1);
 			break;
 
 		case 0x9d:
-			if( (codeWord & 0x0080) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// SRLC Rn, #width
-			CycleCount = 1 + EAIncDelay;
-			src = regNumSrc;
-			if( src == 0 ) {
-				break;
-			}
-			dest = (GR.rs[(regNumDest + 1) & 0x0f] << 9) | (GR.rs[regNumDest] << 1);	// bit 0 for carry
-
-			dest >>= src;
-			PSW.field.C = dest & 0x01;
-
-			GR.rs[regNumDest] = ((dest >> 1) & 0xff);
-
+			if( (codeWord & 0x0080) == 0x0000 )
+				_setOp(insn, OP_SRLC_R_IMM, 1);
 			break;
 
 		case 0x9e:
-			if( (codeWord & 0x0080) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// SRA Rn, #width
-			CycleCount = 1 + EAIncDelay;
-			dest = GR.rs[regNumDest];
-			src = regNumSrc;
-			GR.rs[regNumDest] = _ALU_SRA(dest, src);
+			if( (codeWord & 0x0080) == 0x0000 )
+				_setOp(insn, OP_SRA_R_IMM, 1);
 			break;
 
 		case 0x9f:
-			if( (codeWord & 0x0f00) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// _LDSR Rd
-			CycleCount = 1;
-			DSR = GR.rs[regNumSrc];
-			isDSRSet = true;
+			if( (codeWord & 0x0f00) == 0x0000 )
+				_setOp(insn, OP_LDSR_R, 1);
 			break;
 
 		case 0xa0:
-			src = regNumSrc & 0x07;
-			if( (codeWord & 0x0080) != 0x0000 ) {
-				if( (codeWord & 0x0f80) != 0x0080 ) {
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					break;
-				}
-				// SB Dbitadr
-				codeWord = memoryGetCodeWord(CSR, PC);	// sorry I don't have variable to hold the address
-				PC = (PC + 2) & 0xfffe;
-				dest = memoryGetData(GET_DATA_SEG, (EA_t)codeWord, 1);
-				memorySetData(GET_DATA_SEG, codeWord, 1, _ALU_SB(dest, src));
-				CycleCount = 2 + EAIncDelay;
-				break;
-			}
-			// SB Rn.b
-			GR.rs[regNumDest] = _ALU_SB(GR.rs[regNumDest], src);
-			CycleCount = 1;
+			if( (codeWord & 0x0080) == 0x0000 )
+				_setOp(insn, OP_SB_R, 1);
+			else if( (codeWord & 0x0f80) == 0x0080 )
+				_setWideOp(insn, OP_SB_ADR, 2);
 			break;
 
 		case 0xa1:
-			src = regNumSrc & 0x07;
-			if( (codeWord & 0x0080) != 0x0000 ) {
-				if( (codeWord & 0x0f80) != 0x0080 ) {
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					break;
-				}
-				// TB Dbitadr
-				dest = memoryGetData(GET_DATA_SEG, (EA_t)memoryGetCodeWord(CSR, PC), 1);
-				PC = (PC + 2) & 0xfffe;
-				_ALU_TB(dest, src);
-				CycleCount = 2 + ROMWinAccessCount + EAIncDelay;
-				break;
-			}
-			// TB Rn.b
-			_ALU_TB(GR.rs[regNumDest], src);
-			CycleCount = 1;
+			if( (codeWord & 0x0080) == 0x0000 )
+				_setOp(insn, OP_TB_R, 1);
+			else if( (codeWord & 0x0f80) == 0x0080 )
+				_setWideOp(insn, OP_TB_ADR, 2);
 			break;
 
 		case 0xa2:
-			src = regNumSrc & 0x07;
-			if( (codeWord & 0x0080) != 0x0000 ) {
-				if( (codeWord & 0x0f80) != 0x0080 ) {
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					break;
-				}
-				// RB Dbitadr
-				codeWord = memoryGetCodeWord(CSR, PC);	// same as `SB Dbitadr`
-				PC = (PC + 2) & 0xfffe;
-				dest = memoryGetData(GET_DATA_SEG, (EA_t)codeWord, 1);
-				memorySetData(GET_DATA_SEG, codeWord, 1, _ALU_RB(dest, src));
-				CycleCount = 2 + EAIncDelay;
-				break;
-			}
-			// RB Rn.b
-			GR.rs[regNumDest] = _ALU_RB(GR.rs[regNumDest], src);
-			CycleCount = 1;
+			if( (codeWord & 0x0080) == 0x0000 )
+				_setOp(insn, OP_RB_R, 1);
+			else if( (codeWord & 0x0f80) == 0x0080 )
+				_setWideOp(insn, OP_RB_ADR, 2);
 			break;
 
 		case 0xa3:
-			if( (codeWord & 0x00f0) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// MOV Rn, PSW
-			GR.rs[regNumDest] = PSW.raw;
-			CycleCount = 1;
+			if( (codeWord & 0x00f0) == 0x0000 )
+				_setOp(insn, OP_MOV_R_PSW, 1);
 			break;
 
 		case 0xa4:
-			if( (codeWord & 0x00f0) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// MOV Rn, EPSW
-			if( PSW.field.ELevel != 0 )
-				GR.rs[regNumDest] = _getCurrEPSW()->raw;
-#ifdef CORE_IS_U16
-			else
-				GR.rs[regNumDest] = 0xFF;
-			CycleCount = 1;
-#else
-			CycleCount = 2;
-#endif
+			if( (codeWord & 0x00f0) == 0x0000 )
+				_setOp(insn, OP_MOV_R_EPSW, CYCLES(2, 1));
 			break;
 
 		case 0xa5:
-			if( (codeWord & 0x01f0) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// MOV ERn, ELR
-			GR.ers[regNumDest] = *_getCurrELR();
-#ifdef CORE_IS_U16
-			CycleCount = 1;
-#else
-			CycleCount = 3;
-#endif
+			if( (codeWord & 0x01f0) == 0x0000 )
+				_setOp(insn, OP_MOV_ER_ELR, CYCLES(3, 1));
 			break;
 
 		case 0xa6:
-			// MOV Rn, CRm
-			retVal = CORE_UNIMPLEMENTED;
+			_setOp(insn, OP_MOV_R_CR, 1);
 			break;
 
 		case 0xa7:
-			if( (codeWord & 0x00f0) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// MOV Rn, ECSR
-			GR.rs[regNumDest] = *_getCurrECSR();
-#ifdef CORE_IS_U16
-			CycleCount = 1;
-#else
-			CycleCount = 2;
-#endif
+			if( (codeWord & 0x00f0) == 0x0000 )
+				_setOp(insn, OP_MOV_R_ECSR, CYCLES(2, 1));
 			break;
 
 		case 0xa8:
-			if( (codeWord & 0xf11f) != 0xa008 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// L ERn, d16[ERm]
-			src = GR.ers[regNumSrc >> 1];
-			src = (src + memoryGetCodeWord(CSR, PC)) & 0xffff;
-			PC = (PC + 2) & 0xfffe;
-			dest = memoryGetData(GET_DATA_SEG, src, 2);
-			GR.ers[regNumDest >> 1] = dest;
-			PSW.field.S = SIGN16(dest);
-			PSW.field.Z = IS_ZERO(dest);
-			CycleCount = 3 + ROMWinAccessCount + EAIncDelay;
+			if( (codeWord & 0xf11f) == 0xa008 )
+				_setWideOp(insn, OP_L_ER_D16, 3);
 			break;
 
 		case 0xa9:
-			if( (codeWord & 0xf11f) != 0xa009 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// ST ERn, d16[ERm]
-			dest = GR.ers[regNumSrc >> 1];
-			dest = (dest + memoryGetCodeWord(CSR, PC)) & 0xffff;
-			PC = (PC + 2) & 0xfffe;
-			memorySetData(GET_DATA_SEG, dest, 2, GR.ers[regNumDest >> 1]);
-			CycleCount = 3 + EAIncDelay;
+			if( (codeWord & 0xf11f) == 0xa009 )
+				_setWideOp(insn, OP_ST_ER_D16, 3);
 			break;
 
 		case 0xaa:
-			if( (codeWord & 0x01f0) == 0x0010 ) {
-				// MOV ERn, SP
-				GR.ers[regNumDest >> 1] = SP;
-#ifdef CORE_IS_U16
-				CycleCount = 1;
-#else
-				CycleCount = 2;
-#endif
-				break;
-			}
-			if( (codeWord & 0x0f10) == 0x0100 ) {
-				// MOV SP, ERm
-				setSP(GR.ers[regNumSrc >> 1]);
-				CycleCount = 1;
-				break;
-			}
-			retVal = CORE_ILLEGAL_INSTRUCTION;
+			if( (codeWord & 0x01f0) == 0x0010 )
+				_setOp(insn, OP_MOV_ER_SP, CYCLES(2, 1));
+			else if( (codeWord & 0x0f10) == 0x0100 )
+				_setOp(insn, OP_MOV_SP_ER, 1);
 			break;
 
 		case 0xab:
-			if( (codeWord & 0x0f00) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// MOV PSW, Rm
-			PSW.raw = GR.rs[regNumSrc];
-			CycleCount = 1;
+			if( (codeWord & 0x0f00) == 0x0000 )
+				_setOp(insn, OP_MOV_PSW_R, 1);
 			break;
 
 		case 0xac:
-			if( (codeWord & 0x0f00) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// MOV EPSW, Rm
-			if( PSW.field.ELevel != 0 )
-				_getCurrEPSW()->raw = GR.rs[regNumSrc];
-			CycleCount = 1;
+			if( (codeWord & 0x0f00) == 0x0000 )
+				_setOp(insn, OP_MOV_EPSW_R, 1);
 			break;
 
 		case 0xad:
-			if( (codeWord & 0x01f0) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// MOV ELR, ERm
-			*_getCurrELR() = GR.ers[regNumDest >> 1];
-#ifdef CORE_IS_U16
-			CycleCount = 1;
-#else
-			CycleCount = 3;
-#endif
+			if( (codeWord & 0x01f0) == 0x0000 )
+				_setOp(insn, OP_MOV_ELR_ER, CYCLES(3, 1));
 			break;
 
 		case 0xae:
-			// MOV CRn, Rm
-			retVal = CORE_UNIMPLEMENTED;
+			_setOp(insn, OP_MOV_CR_R, 1);
 			break;
 
 		case 0xaf:
-			if( (codeWord & 0x0f00) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
-			// MOV ECSR, Rm
-			*_getCurrECSR() = GR.rs[regNumSrc] & 0x0f;
-#ifdef CORE_IS_U16
-			CycleCount = 1;
-#else
-			CycleCount = 2;
-#endif
+			if( (codeWord & 0x0f00) == 0x0000 )
+				_setOp(insn, OP_MOV_ECSR_R, CYCLES(2, 1));
 			break;
 
-		case 0xb0:
-		case 0xb1:
-		case 0xb2:
-		case 0xb3:
-		case 0xb4:
-		case 0xb5:
-		case 0xb6:
-		case 0xb7:
-		case 0xb8:
-		case 0xb9:
-		case 0xba:
-		case 0xbb:
-		case 0xbc:
-		case 0xbd:
-		case 0xbe:
-		case 0xbf:
-			switch( codeWord & 0x01c0 ) {
-				case 0x0000:
-					// L ERn, disp6[BP]
-					src = GR.ers[12 >> 1];		// src = ER12
-					src = (src + _signExtend(codeWord & 0x003f, 6)) & 0xffff;
-					dest = memoryGetData(GET_DATA_SEG, src, 2);
-					GR.ers[regNumDest >> 1] = dest;
-					PSW.field.S = SIGN16(dest);
-					PSW.field.Z = IS_ZERO(dest);
-					CycleCount += ROMWinAccessCount;
-					break;
+		case 0xf0:
+			if( (codeWord & 0x00f0) == 0x0000 )
+				_setWideOp(insn, OP_B_CADR, 2);
+			break;
 
-				case 0x0040:
-					// L ERn, disp6[FP]
-					src = GR.ers[14 >> 1];		// src = ER14
-					src = (src + _signExtend(codeWord & 0x003f, 6)) & 0xffff;
-					dest = memoryGetData(GET_DATA_SEG, src, 2);
-					GR.ers[regNumDest >> 1] = dest;
-					PSW.field.S = SIGN16(dest);
-					PSW.field.Z = IS_ZERO(dest);
-					CycleCount += ROMWinAccessCount;
-					break;
+		case 0xf1:
+			if( (codeWord & 0x00f0) == 0x0000 )
+				_setWideOp(insn, OP_BL_CADR, 2);
+			break;
 
-				case 0x0080:
-					// ST ERn, disp6[BP]
-					dest = GR.ers[12 >> 1];		// dest = ER12
-					dest = (dest + _signExtend(codeWord & 0x003f, 6)) & 0xffff;
-					memorySetData(GET_DATA_SEG, dest, 2, GR.ers[regNumDest >> 1]);
-					break;
+		case 0xf2:
+			if( (codeWord & 0x0f10) == 0x0000 )
+				_setOp(insn, OP_B_ER, 2);
+			break;
 
-				case 0x00c0:
-					// ST ERn, disp6[FP]
-					dest = GR.ers[14 >> 1];		// dest = ER14
-					dest = (dest + _signExtend(codeWord & 0x003f, 6)) & 0xffff;
-					memorySetData(GET_DATA_SEG, dest, 2, GR.ers[regNumDest >> 1]);
-					break;
+		case 0xf3:
+			if( (codeWord & 0x0f10) == 0x0000 )
+				_setOp(insn, OP_BL_ER, 2);
+			break;
 
-				default:
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					goto exit;
-			}
-			CycleCount += 3 + EAIncDelay;
-			break;
-
-		case 0xc0:
-		case 0xc1:
-		case 0xc2:
-		case 0xc3:
-		case 0xc4:
-		case 0xc5:
-		case 0xc6:
-		case 0xc7:
-		case 0xc8:
-		case 0xc9:
-		case 0xca:
-		case 0xcb:
-		case 0xcc:
-		case 0xcd:
-		case 0xce:
-		case 0xcf:
-			switch( codeWord & 0x0f00 ) {
+		case 0xf4:
+			if( (codeWord & 0x0100) == 0x0000 )
+				_setOp(insn, OP_MUL, 9);
+			break;
+
+		case 0xf5:
+			if( (codeWord & 0x0110) == 0x0000 )
+				_setOp(insn, OP_MOV_ER_ER, CYCLES(2, 1));
+			break;
+
+		case 0xf6:
+			if( (codeWord & 0x0110) == 0x0000 )
+				_setOp(insn, OP_ADD_ER_ER, CYCLES(2, 1));
+			break;
+
+		case 0xf7:
+			if( (codeWord & 0x0110) == 0x0000 )
+				_setOp(insn, OP_CMP_ER_ER, CYCLES(2, 1));
+			break;
+
+		case 0xf9:
+			if( (codeWord & 0x0100) == 0x0000 )
+				_setOp(insn, OP_DIV, 17);
+			break;
+
+		case 0xfa:
+			if( (codeWord & 0x0010) == 0x0000 )
+				_setOp(insn, OP_LEA_ER, 1);
+			break;
+
+		case 0xfb:
+			if( (codeWord & 0x0010) == 0x0000 )
+				_setWideOp(insn, OP_LEA_D16, 2);
+			break;
+
+		case 0xfc:
+			if( (codeWord & 0x0010) == 0x0000 )
+				_setWideOp(insn, OP_LEA_ADR, 2);
+			break;
+
+		case 0xfd:
+			// coprocessor data transfers
+			_decodeCoproTransfer(insn, codeWord);
+			break;
+
+		case 0xfe:
+			switch( codeWord & 0x00f0 ) {
 				case 0x0000:
-					// GE
-					src = !PSW.field.C;
+					_setOp(insn, OP_POP_R, CYCLES(2, 1));
 					break;
-				case 0x0100:
-					// LT
-					src = PSW.field.C;
+				case 0x0010:
+					if( (insn -> dest & 0x01) == 0x00 )
+						_setOp(insn, OP_POP_ER, CYCLES(2, 1));
 					break;
-				case 0x0200:
-					// GT
-					src = !(PSW.field.C | PSW.field.Z);
+				case 0x0020:
+					if( (insn -> dest & 0x03) == 0x00 )
+						_setOp(insn, OP_POP_XR, CYCLES(4, 2));
 					break;
-				case 0x0300:
-					// LE
-					src = PSW.field.C | PSW.field.Z;
+				case 0x0030:
+					if( (insn -> dest & 0x07) == 0x00 )
+						_setOp(insn, OP_POP_QR, CYCLES(8, 4));
 					break;
-				case 0x0400:
-					// GES
-					src = !(PSW.field.OV ^ PSW.field.S);
+				case 0x0040:
+					_setOp(insn, OP_PUSH_R, CYCLES(2, 1));
 					break;
-				case 0x0500:
-					// LTS
-					src = PSW.field.OV ^ PSW.field.S;
+				case 0x0050:
+					if( (insn -> dest & 0x01) == 0x00 )
+						_setOp(insn, OP_PUSH_ER, CYCLES(2, 1));
 					break;
-				case 0x0600:
-					// GTS
-					src = !((PSW.field.OV ^ PSW.field.S) | PSW.field.Z);
+				case 0x0060:
+					if( (insn -> dest & 0x03) == 0x00 )
+						_setOp(insn, OP_PUSH_XR, CYCLES(4, 2));
 					break;
-				case 0x0700:
-					// LES
-					src = (PSW.field.OV ^ PSW.field.S) | PSW.field.Z;
+				case 0x0070:
+					if( (insn -> dest & 0x07) == 0x00 )
+						_setOp(insn, OP_PUSH_QR, CYCLES(8, 4));
 					break;
-				case 0x0800:
-					// NE
-					src = !PSW.field.Z;
+				case 0x0080:
+					// cycles depend on the register list
+					_setOp(insn, OP_POP_LEPA, 0);
 					break;
-				case 0x0900:
-					// EQ
-					src = PSW.field.Z;
+				case 0x00c0:
+					_setOp(insn, OP_PUSH_LEPA, 0);
 					break;
-				case 0x0a00:
-					// NV
-					src = !PSW.field.OV;
+			}
+			break;
+
+		case 0xff:
+			switch( codeWord ) {
+				case 0xfe0f:
+					_setOp(insn, OP_RTI, 2);
 					break;
-				case 0x0b00:
-					// OV
-					src = PSW.field.OV;
+				case 0xfe1f:
+					_setOp(insn, OP_RT, 2);
 					break;
-				case 0x0c00:
-					// PS
-					src = !PSW.field.S;
+				case 0xfe2f:
+					_setOp(insn, OP_INC_EA, 2);
 					break;
-				case 0x0d00:
-					// NS
-					src = PSW.field.S;
+				case 0xfe3f:
+					_setOp(insn, OP_DEC_EA, 2);
+					break;
+				case 0xfe8f:
+					_setOp(insn, OP_NOP, 1);
 					break;
-				case 0x0e00:
-					// AL
-					src = 1;
+				case 0xfe9f:
+					_setOp(insn, OP_UDSR, 1);
+					break;
+				case 0xfecf:
+					_setOp(insn, OP_CPLC, 1);
+					break;
+				case 0xffff:
+					_setOp(insn, OP_BRK, 7);
 					break;
-				case 0x0f00:
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					goto exit;
-			}
-			CycleCount = 1;
-			if( src ) {
-				PC += (_signExtend(immNum, 8) << 1) & 0xffff;
-				CycleCount = 3;
 			}
 			break;
+	}
+}
+
+
+// Resolves `CSR` for instruction fetch, following the same page mirrowing rules as `memoryGetCodeWord()`
+// Called whenever `CSR` changes, and whenever `_coreExecute()` starts, as the host may have changed it.
+static inline void _coreSetCodeSegment(EmuContext_t *ctx) {
+	SR_t segment = CSR & 0x0f;
+
+	if( (segment & ctx -> Model.codeMirrorMask) >= ctx -> Model.codePageCount ) {
+		ctx -> CodeSegment = NULL;
+		return;
+	}
+
+	segment &= ctx -> Model.codeMirrorMask;
+	ctx -> CodeSegment = (const uint8_t *)ctx -> CodeMemory + ((uint32_t)segment << 16);
+	ctx -> CodeSegmentIndex = segment;
+}
+
+// Returns the decoded instruction at `offset` of mapped page `segment`, whose code memory is at `code`
+static inline const CoreInstruction_t* _coreFetchFrom(EmuContext_t *ctx, SR_t segment, const uint8_t *code, PC_t offset) {
+	CoreInstruction_t *p;
+
+#ifdef CORE_PREDECODE
+	p = &ctx -> DecodeCache[segment][offset >> 1];
+
+	if( p -> op != OP_UNDECODED )
+		return p;
+#else
+	unsigned int line = (offset >> 1) & (CORE_DECODE_CACHE_LINES - 1);
+	uint32_t tag = ((uint32_t)segment << 16) | offset;
+	p = &ctx -> DecodeCache[line];
+
+	if( (p -> op != OP_UNDECODED) && (ctx -> DecodeCacheTag[line] == tag) )
+		return p;
+
+	ctx -> DecodeCacheTag[line] = tag;
+#endif
+
+	VARIANT(coreDecode)(p, *((const uint16_t *)(code + offset)));
+	if( p -> words == 2 )
+		p -> imm = *((const uint16_t *)(code + ((offset + 2) & 0xfffe)));
+
+	return p;
+}
+
+// Returns the decoded instruction at `segment:offset`, decoding it if it isn't cached
+// Follows the same page mirrowing rules as `memoryGetCodeWord()`
+const CoreInstruction_t* VARIANT(coreFetchDecoded)(EmuContext_t *ctx, SR_t segment, PC_t offset) {
+	segment &= 0x0f;
+	offset &= 0xfffe;
+
+	if( (segment & ctx -> Model.codeMirrorMask) >= ctx -> Model.codePageCount ) {
+		// unmapped pages read `0xffff`
+		VARIANT(coreDecode)(&ctx -> UnmappedInstruction, 0xffff);
+		return &ctx -> UnmappedInstruction;
+	}
+
+	segment &= ctx -> Model.codeMirrorMask;
+	return _coreFetchFrom(ctx, segment, (const uint8_t *)ctx -> CodeMemory + ((uint32_t)segment << 16), offset);
+}
+
+// Returns the decoded instruction at `CSR:PC`, through what `_coreSetCodeSegment()` has resolved
+static inline const CoreInstruction_t* _coreFetchCurrent(EmuContext_t *ctx) {
+	if( ctx -> CodeSegment == NULL )
+		return VARIANT(coreFetchDecoded)(ctx, CSR, PC);
+
+	return _coreFetchFrom(ctx, ctx -> CodeSegmentIndex, ctx -> CodeSegment, PC & 0xfffe);
+}
+
+#ifndef CORE_U16_COPY
+// Drops all decoded instructions and blocks
+// Call this whenever code memory is reloaded
+void coreFlushDecodeCache(EmuContext_t *ctx) {
+	CoreInstruction_t *p = (CoreInstruction_t *)ctx -> DecodeCache;
+	size_t i;
+
+	for( i = 0; i < sizeof(ctx -> DecodeCache) / sizeof(CoreInstruction_t); ++i ) {
+		p[i].op = OP_UNDECODED;
+	}
+
+#ifdef CORE_BLOCK_CACHE
+	for( i = 0; i < CORE_BLOCK_CACHE_LINES; ++i ) {
+		ctx -> BlockCache[i].length = 0;
+	}
+#endif
+#ifdef CORE_JIT
+	jitFlush(ctx);
+#endif
+}
+#endif
+
+
+#ifdef CORE_BLOCK_CACHE
+// Checks if an instruction ends a basic block
+// Anything that may not continue with the next instruction does.
+static bool _isBlockEnd(const CoreInstruction_t *insn) {
+	switch( insn -> op ) {
+		case OP_B_CADR:
+		case OP_BL_CADR:
+		case OP_B_ER:
+		case OP_BL_ER:
+		case OP_RT:
+		case OP_RTI:
+		case OP_SWI:
+		case OP_BRK:
+		case OP_ILLEGAL:
+		case OP_UNIMPLEMENTED:
+			return true;
+
+		case OP_POP_LEPA:
+			// only `POP PC` branches
+			return (insn -> dest & 0x02)? true : false;
+
+		default:
+			// B<cond>
+			return (insn -> op >= OP_BGE) && (insn -> op <= OP_BAL);
+	}
+}
+
+// Checks if an instruction accesses data memory through `GET_DATA_SEG`, so that a DSR prefix applies to it
+static bool _isDataAccess(uint8_t op) {
+	switch( op ) {
+		case OP_SB_ADR:
+		case OP_TB_ADR:
+		case OP_RB_ADR:
+		case OP_INC_EA:
+		case OP_DEC_EA:
+		case OP_L_CR_EA:
+		case OP_L_CR_EAP:
+		case OP_ST_CR_EA:
+		case OP_ST_CR_EAP:
+			return true;
+
+		default:
+			return (op >= OP_L_R_ERM) && (op <= OP_ST_R_FP);
+	}
+}
+
+// Returns the basic block starting at `segment:offset`, building it if it isn't cached
+// A DSR prefix followed by a data access is marked `isFused`, so that the core runs the pair in one go.
+const CoreBlock_t* VARIANT(coreFetchBlock)(EmuContext_t *ctx, SR_t segment, PC_t offset) {
+	const CoreInstruction_t *insn;
+	CoreInstruction_t *prev;
+	CoreBlock_t *p;
+	uint32_t tag;
+
+	segment &= 0x0f;
+	offset &= 0xfffe;
+	tag = ((uint32_t)segment << 16) | offset;
+	p = &ctx -> BlockCache[((offset >> 1) ^ (segment << 11)) & (CORE_BLOCK_CACHE_LINES - 1)];
+
+	if( (p -> length != 0) && (p -> tag == tag) ) {
+#ifdef CORE_JIT
+		if( (p -> native != NULL) && (p -> nativeGeneration != ctx -> JitGeneration) ) {
+			// its code has been thrown away
+			p -> native = NULL;
+			p -> hits = 0;
+		}
+		if( (p -> hits < CORE_JIT_THRESHOLD) && (++p -> hits == CORE_JIT_THRESHOLD) )
+			jitTranslate(ctx, p);
+#endif
+		return p;
+	}
+
+	p -> tag = tag;
+	p -> cycles = 0;
+	p -> length = 0;
+#ifdef CORE_JIT
+	p -> native = NULL;
+	p -> hits = 0;
+#endif
+
+	do {
+		// copy it out, the decode cache line may be reused by the next fetch
+		insn = VARIANT(coreFetchDecoded)(ctx, segment, offset);
+		p -> ops[p -> length++] = *insn;
+		p -> cycles += insn -> cycles;
+		if( (p -> length > 1) && _isDataAccess(insn -> op) ) {
+			prev = &p -> ops[p -> length - 2];
+			prev -> isFused = (prev -> op == OP_LDSR_R) || (prev -> op == OP_LDSR_IMM) || (prev -> op == OP_UDSR);
+		}
+		offset = (offset + (insn -> words << 1)) & 0xfffe;
+	} while( (p -> length < CORE_BLOCK_MAX_LENGTH) && !_isBlockEnd(insn) );
+
+	return p;
+}
+
+#ifdef CORE_JIT
+// Checks if an instruction increments EA
+static bool _isEAInc(uint8_t op) {
+	switch( op ) {
+		case OP_L_R_EAP:
+		case OP_ST_R_EAP:
+		case OP_L_ER_EAP:
+		case OP_ST_ER_EAP:
+		case OP_L_XR_EAP:
+		case OP_ST_XR_EAP:
+		case OP_L_QR_EAP:
+		case OP_ST_QR_EAP:
+		case OP_L_CR_EAP:
+		case OP_ST_CR_EAP:
+			return true;
+
+		default:
+			return false;
+	}
+}
+#endif
+
+// Points `*next` and `*end` at the instructions to run next, at most `count - *executed` of them
+// A single step skips the block cache, so that stepping never builds a block per PC.
+// With `CORE_JIT`, translated code is run right away, as long as all of it fits,
+// in both instructions and cycles. It may stop early if a stop is requested.
+static void _coreNextBlock(EmuContext_t *ctx, const CoreInstruction_t **next, const CoreInstruction_t **end, unsigned int *executed, unsigned int count, int *totalCycles, int cycleBudget) {
+	const CoreBlock_t *block;
+	unsigned int left = count - *executed;
+	unsigned int start = 0;
+#ifdef CORE_JIT
+	int cycles;
+#endif
+
+	if( left == 1 ) {
+		*next = _coreFetchCurrent(ctx);
+		*end = *next + 1;
+		return;
+	}
+
+	block = VARIANT(coreFetchBlock)(ctx, CSR, PC);
+
+#ifdef CORE_JIT
+	if( (block -> native != NULL) && (block -> nativeGeneration == ctx -> JitGeneration) && (block -> nativeLength <= left) &&
+		(block -> nativeCycles < cycleBudget - *totalCycles) && (ctx -> NextAccess == DATA_ACCESS_PAGE0) && (ctx -> EAIncDelay == 0) &&
+		(ctx -> WatchCount == 0) && !IS_TRACED() ) {
+		SYNC_FLAGS();
+		ctx -> JitCycles = 0;
+		ctx -> JitLength = block -> nativeLength;
+		cycles = block -> native(ctx) + ctx -> JitCycles;
+
+		// what `RETIRE()` would have done after each of them
+		ctx -> EAIncDelay = _isEAInc(block -> ops[ctx -> JitLength - 1].op)? 1 : 0;
+		if( (ctx -> IntMaskCycle -= cycles) < 0 )
+			ctx -> IntMaskCycle = 0;
+		*totalCycles += cycles;
+		ctx -> RunCycles = *totalCycles;
+		*executed += ctx -> JitLength;
+		left -= ctx -> JitLength;
+		start = ctx -> JitLength;
+	}
+#endif
+
+	*next = block -> ops + start;
+	*end = block -> ops + ((block -> length < start + left)? block -> length : start + left);
+}
+#endif
+
+
+#ifndef CORE_U16_COPY
+// Zeros all registers
+CORE_STATUS coreZero(EmuContext_t *ctx) {
+	DSR = 0;
+	CSR = 0;
+	LCSR = 0;
+	ECSR1 = 0;
+	ECSR2 = 0;
+	ECSR3 = 0;
+	PC = 0;
+	LR = 0;
+	ELR1 = 0;
+	ELR2 = 0;
+	ELR3 = 0;
+	EA = 0;
+	SP = 0;
+	PSW.raw = 0;
+	EPSW1.raw = 0;
+	EPSW2.raw = 0;
+	EPSW3.raw = 0;
+	GR.qrs[0] = 0;
+	GR.qrs[1] = 0;
+	CR.qrs[0] = 0;
+	CR.qrs[1] = 0;
+
+	return CORE_OK;
+}
+#endif
+
+
+// resets core
+CORE_STATUS VARIANT(coreReset)(EmuContext_t *ctx) {
+	if( ctx -> IsMemoryInited == false )
+		return CORE_MEMORY_UNINITIALIZED;
+
+	// reset registers
+	PSW.raw = 0;
+	CSR = 0;
+	DSR = 0;
+	_coreSetCodeSegment(ctx);
+
+	// initialize SP
+	setSP(memoryGetCodeWord(ctx, (SR_t)0, (PC_t)0x0000));
+
+	// initialize PC
+	PC = memoryGetCodeWord(ctx, (SR_t)0, (PC_t)0x0002);
+
+	// reset other core states
+	ctx -> IntMaskCycle = 0;
+	ctx -> NextAccess = DATA_ACCESS_PAGE0;
+	ctx -> EAIncDelay = 0;
+	ctx -> CycleCount = 0;
+
+	// code memory may have been reloaded since last reset
+	coreFlushDecodeCache(ctx);
+
+	return CORE_OK;
+}
+
+
+#ifdef CORE_IDLE_SKIP
+// Packs everything but memory contents that decides what the core does next into `key`
+static void _coreIdleKey(const EmuContext_t *ctx, uint64_t *key) {
+	key[0] = GR.qrs[0];
+	key[1] = GR.qrs[1];
+	key[2] = PC | ((uint64_t)CSR << 16) | ((uint64_t)DSR << 24) | ((uint64_t)EA << 32) | ((uint64_t)SP << 48);
+	key[3] = LR | ((uint64_t)ELR1 << 16) | ((uint64_t)ELR2 << 32) | ((uint64_t)ELR3 << 48);
+	key[4] = LCSR | ((uint64_t)ECSR1 << 8) | ((uint64_t)ECSR2 << 16) | ((uint64_t)ECSR3 << 24) |
+		((uint64_t)PSW.raw << 32) | ((uint64_t)EPSW1.raw << 40) | ((uint64_t)EPSW2.raw << 48) | ((uint64_t)EPSW3.raw << 56);
+	key[5] = (uint32_t)ctx -> IntMaskCycle | ((uint64_t)ctx -> MemoryWrites << 32);
+	key[6] = ctx -> ROMWinAccessCount | ((uint64_t)ctx -> EAIncDelay << 32) | ((uint64_t)ctx -> NextAccess << 40);
+	key[7] = CR.qrs[0];
+	key[8] = CR.qrs[1];
+}
+
+// Called when a backward branch is taken, before it retires
+// If the core is where it was last time, every iteration in between has been the same loop, and so will
+// the following ones, so as many of them as the budgets allow are charged without running them.
+static void _coreSkipIdle(EmuContext_t *ctx, int *totalCycles, unsigned int *executed, unsigned int count, int cycleBudget) {
+	uint64_t key[CORE_IDLE_KEY_SIZE];
+	unsigned int cycles, length, iterations;
+	bool isIdle = ctx -> IsIdleValid;
+	int i;
+
+	SYNC_FLAGS();
+	_coreIdleKey(ctx, key);
+	for( i = 0; i < CORE_IDLE_KEY_SIZE; ++i ) {
+		if( key[i] != ctx -> IdleKey[i] ) {
+			isIdle = false;
+			ctx -> IdleKey[i] = key[i];
+		}
+	}
+
+	if( isIdle ) {
+		cycles = *totalCycles - ctx -> IdleCycles;
+		length = *executed - ctx -> IdleExecuted;
+		if( (cycles != 0) && (length != 0) ) {
+			// the core would have stopped right before the branch once a budget was used up
+			iterations = (unsigned int)(cycleBudget - *totalCycles - 1) / cycles;
+			if( (count - *executed - 1) / length < iterations )
+				iterations = (count - *executed - 1) / length;
+			*totalCycles += iterations * cycles;
+			*executed += iterations * length;
+		}
+	}
+
+	ctx -> IsIdleValid = true;
+	ctx -> IdleCycles = *totalCycles;
+	ctx -> IdleExecuted = *executed;
+}
+#endif
+
+
+// Runs up to `count` instructions, or until they have taken `cycleBudget` cycles
+// Stops early if an instruction doesn't return `CORE_OK`.
+// `CycleCount` is set to the cycles taken by all the instructions run.
+// If `result` isn't NULL, it also stops on BRK and stop requests, and tells why it has stopped.
+static CORE_STATUS _coreExecute(EmuContext_t *ctx, unsigned int count, int cycleBudget, CoreRunResult_t *result) {
+	CORE_STATUS retVal = CORE_OK;
+	CORE_STOP_REASON reason = CORE_STOP_BUDGET;
+	bool isStoppable = (result != NULL);
+	const CoreInstruction_t *insn;
+	uint8_t regNumDest, regNumSrc;
+	uint16_t imm;
+	bool isEAInc;
+	bool isDSRSet;
+	unsigned int executed = 0;
+	int totalCycles = 0;
+#ifdef CORE_BLOCK_CACHE
+	const CoreInstruction_t *blockNext = NULL, *blockEnd = NULL;
+#endif
+
+	uint64_t dest = 0, src = 0;
+
+#ifdef CORE_COMPUTED_GOTO
+	static const void *DispatchTable[OP_COUNT] = {
+		[OP_UNDECODED] = &&L_OP_ILLEGAL,
+		[OP_ILLEGAL] = &&L_OP_ILLEGAL,
+		[OP_UNIMPLEMENTED] = &&L_OP_UNIMPLEMENTED,
+		LABEL(OP_MOV_R_IMM),
+		LABEL(OP_ADD_R_IMM),
+		LABEL(OP_AND_R_IMM),
+		LABEL(OP_OR_R_IMM),
+		LABEL(OP_XOR_R_IMM),
+		LABEL(OP_CMPC_R_IMM),
+		LABEL(OP_ADDC_R_IMM),
+		LABEL(OP_CMP_R_IMM),
+		LABEL(OP_MOV_R_R),
+		LABEL(OP_ADD_R_R),
+		LABEL(OP_AND_R_R),
+		LABEL(OP_OR_R_R),
+		LABEL(OP_XOR_R_R),
+		LABEL(OP_CMPC_R_R),
+		LABEL(OP_ADDC_R_R),
+		LABEL(OP_CMP_R_R),
+		LABEL(OP_SUB_R_R),
+		LABEL(OP_SUBC_R_R),
+		LABEL(OP_SLL_R_R),
+		LABEL(OP_SLLC_R_R),
+		LABEL(OP_SRL_R_R),
+		LABEL(OP_SRLC_R_R),
+		LABEL(OP_SRA_R_R),
+		LABEL(OP_EXTBW),
+		LABEL(OP_DAA),
+		LABEL(OP_DAS),
+		LABEL(OP_NEG),
+		LABEL(OP_L_R_ERM),
+		LABEL(OP_L_R_ADR),
+		LABEL(OP_L_R_EA),
+		LABEL(OP_L_R_EAP),
+		LABEL(OP_ST_R_ERM),
+		LABEL(OP_ST_R_ADR),
+		LABEL(OP_ST_R_EA),
+		LABEL(OP_ST_R_EAP),
+		LABEL(OP_L_ER_ERM),
+		LABEL(OP_L_ER_ADR),
+		LABEL(OP_L_ER_EA),
+		LABEL(OP_L_ER_EAP),
+		LABEL(OP_ST_ER_ERM),
+		LABEL(OP_ST_ER_ADR),
+		LABEL(OP_ST_ER_EA),
+		LABEL(OP_ST_ER_EAP),
+		LABEL(OP_L_XR_EA),
+		LABEL(OP_L_XR_EAP),
+		LABEL(OP_ST_XR_EA),
+		LABEL(OP_ST_XR_EAP),
+		LABEL(OP_L_QR_EA),
+		LABEL(OP_L_QR_EAP),
+		LABEL(OP_ST_QR_EA),
+		LABEL(OP_ST_QR_EAP),
+		LABEL(OP_L_R_D16),
+		LABEL(OP_ST_R_D16),
+		LABEL(OP_SLL_R_IMM),
+		LABEL(OP_SLLC_R_IMM),
+		LABEL(OP_SRL_R_IMM),
+		LABEL(OP_SRLC_R_IMM),
+		LABEL(OP_SRA_R_IMM),
+		LABEL(OP_LDSR_R),
+		LABEL(OP_SB_ADR),
+		LABEL(OP_SB_R),
+		LABEL(OP_TB_ADR),
+		LABEL(OP_TB_R),
+		LABEL(OP_RB_ADR),
+		LABEL(OP_RB_R),
+		LABEL(OP_MOV_R_PSW),
+		LABEL(OP_MOV_R_EPSW),
+		LABEL(OP_MOV_ER_ELR),
+		LABEL(OP_MOV_R_ECSR),
+		LABEL(OP_L_ER_D16),
+		LABEL(OP_ST_ER_D16),
+		LABEL(OP_MOV_ER_SP),
+		LABEL(OP_MOV_SP_ER),
+		LABEL(OP_MOV_PSW_R),
+		LABEL(OP_MOV_EPSW_R),
+		LABEL(OP_MOV_ELR_ER),
+		LABEL(OP_MOV_ECSR_R),
+		LABEL(OP_L_ER_BP),
+		LABEL(OP_L_ER_FP),
+		LABEL(OP_ST_ER_BP),
+		LABEL(OP_ST_ER_FP),
+		LABEL(OP_BGE),
+		LABEL(OP_BLT),
+		LABEL(OP_BGT),
+		LABEL(OP_BLE),
+		LABEL(OP_BGES),
+		LABEL(OP_BLTS),
+		LABEL(OP_BGTS),
+		LABEL(OP_BLES),
+		LABEL(OP_BNE),
+		LABEL(OP_BEQ),
+		LABEL(OP_BNV),
+		LABEL(OP_BOV),
+		LABEL(OP_BPS),
+		LABEL(OP_BNS),
+		LABEL(OP_BAL),
+		LABEL(OP_L_R_BP),
+		LABEL(OP_L_R_FP),
+		LABEL(OP_ST_R_BP),
+		LABEL(OP_ST_R_FP),
+		LABEL(OP_MOV_ER_IMM),
+		LABEL(OP_ADD_ER_IMM),
+		LABEL(OP_ADD_SP_IMM),
+		LABEL(OP_LDSR_IMM),
+		LABEL(OP_SWI),
+		LABEL(OP_MOV_PSW_IMM),
+		LABEL(OP_MOV_R_CR),
+		LABEL(OP_MOV_CR_R),
+		LABEL(OP_L_CR_EA),
+		LABEL(OP_L_CR_EAP),
+		LABEL(OP_ST_CR_EA),
+		LABEL(OP_ST_CR_EAP),
+		LABEL(OP_RC),
+		LABEL(OP_DI),
+		LABEL(OP_EI),
+		LABEL(OP_SC),
+		LABEL(OP_B_CADR),
+		LABEL(OP_BL_CADR),
+		LABEL(OP_B_ER),
+		LABEL(OP_BL_ER),
+		LABEL(OP_MUL),
+		LABEL(OP_MOV_ER_ER),
+		LABEL(OP_ADD_ER_ER),
+		LABEL(OP_CMP_ER_ER),
+		LABEL(OP_DIV),
+		LABEL(OP_LEA_ER),
+		LABEL(OP_LEA_D16),
+		LABEL(OP_LEA_ADR),
+		LABEL(OP_POP_R),
+		LABEL(OP_POP_ER),
+		LABEL(OP_POP_XR),
+		LABEL(OP_POP_QR),
+		LABEL(OP_PUSH_R),
+		LABEL(OP_PUSH_ER),
+		LABEL(OP_PUSH_XR),
+		LABEL(OP_PUSH_QR),
+		LABEL(OP_POP_LEPA),
+		LABEL(OP_PUSH_LEPA),
+		LABEL(OP_RTI),
+		LABEL(OP_RT),
+		LABEL(OP_INC_EA),
+		LABEL(OP_DEC_EA),
+		LABEL(OP_NOP),
+		LABEL(OP_UDSR),
+		LABEL(OP_CPLC),
+		LABEL(OP_BRK),
+		LABEL(OP_NONE),
+	};
+#endif
+
+	ctx -> CycleCount = 0;
+#ifdef CORE_TRACE
+	ctx -> TraceClock += (uint64_t)ctx -> RunCycles;
+#endif
+	ctx -> RunCycles = 0;
+#ifdef CORE_IDLE_SKIP
+	ctx -> IsIdleValid = false;
+#endif
+
+	if( ctx -> IsMemoryInited == false ) {
+		retVal = CORE_MEMORY_UNINITIALIZED;
+		goto exit;
+	}
+
+	_coreSetCodeSegment(ctx);
+	FETCH();
+	DISPATCH_BEGIN
+		TARGET(OP_MOV_R_IMM)
+			// MOV Rn, #imm8
+			GR.rs[regNumDest] = imm;
+
+			SET_ZS(imm, 8);
+			NEXT();
+
+		TARGET(OP_ADD_R_IMM)
+			// ADD Rn, #imm8
+			dest = GR.rs[regNumDest];
+			GR.rs[regNumDest] = _ALU_ADD(ctx, dest, imm);
+			NEXT();
+
+		TARGET(OP_AND_R_IMM)
+			// AND Rn, #imm8
+			dest = GR.rs[regNumDest];
+			GR.rs[regNumDest] = _ALU_AND(ctx, dest, imm);
+			NEXT();
+
+		TARGET(OP_OR_R_IMM)
+			// OR Rn, #imm8
+			dest = GR.rs[regNumDest];
+			GR.rs[regNumDest] = _ALU_OR(ctx, dest, imm);
+			NEXT();
+
+		TARGET(OP_XOR_R_IMM)
+			// XOR Rn, #imm8
+			dest = GR.rs[regNumDest];
+			GR.rs[regNumDest] = _ALU_XOR(ctx, dest, imm);
+			NEXT();
+
+		TARGET(OP_CMPC_R_IMM)
+			// CMPC Rn, #imm8
+			dest = GR.rs[regNumDest];
+			_ALU_CMPC(dest, imm);
+			NEXT();
+
+		TARGET(OP_ADDC_R_IMM)
+			// ADDC Rn, #imm8
+			dest = GR.rs[regNumDest];
+			GR.rs[regNumDest] = _ALU_ADDC(ctx, dest, imm);
+			NEXT();
+
+		TARGET(OP_CMP_R_IMM)
+			// CMP Rn, #imm8
+			dest = GR.rs[regNumDest];
+			_ALU_CMP(dest, imm);
+			NEXT();
+
+		TARGET(OP_MOV_R_R)
+			// MOV Rn, Rm
+			src = GR.rs[regNumSrc];
+
+			SET_ZS(src, 8);
+
+			GR.rs[regNumDest] = src;
+			NEXT();
+
+		TARGET(OP_ADD_R_R)
+			// ADD Rn, Rm
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			GR.rs[regNumDest] = _ALU_ADD(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_AND_R_R)
+			// AND Rn, Rm
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			GR.rs[regNumDest] = _ALU_AND(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_OR_R_R)
+			// OR Rn, Rm
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			GR.rs[regNumDest] = _ALU_OR(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_XOR_R_R)
+			// XOR Rn, Rm
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			GR.rs[regNumDest] = _ALU_XOR(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_CMPC_R_R)
+			// CMPC Rn, Rm
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			_ALU_CMPC(dest, src);
+			NEXT();
+
+		TARGET(OP_ADDC_R_R)
+			// ADDC Rn, Rm
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			GR.rs[regNumDest] = _ALU_ADDC(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_CMP_R_R)
+			// CMP Rn, Rm
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			_ALU_CMP(dest, src);
+			NEXT();
+
+		TARGET(OP_SUB_R_R)
+			// SUB Rn, Rm
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			GR.rs[regNumDest] = _ALU_SUB(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_SUBC_R_R)
+			// SUBC Rn, Rm
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			GR.rs[regNumDest] = _ALU_SUBC(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_SLL_R_R)
+			// SLL Rn, Rm
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			GR.rs[regNumDest] = _ALU_SLL(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_SLLC_R_R)
+			// SLLC Rn, Rm
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			src = GR.rs[regNumSrc] & 0x07;
+			if( src == 0 ) {
+				NEXT();
+			}
+			dest = (GR.rs[regNumDest] << 8) | GR.rs[(regNumDest - 1) & 0x0f];
+
+			dest >>= (8 - src);
+			SYNC_FLAGS();
+			PSW.field.C = (dest & 0x100)? 1 : 0;
+
+			GR.rs[regNumDest] = (dest & 0xff);
+
+			NEXT();
+
+		TARGET(OP_SRL_R_R)
+			// SRL Rn, Rm
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			GR.rs[regNumDest] = _ALU_SRL(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_SRLC_R_R)
+			// SRLC Rn, Rm
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			src = GR.rs[regNumSrc] & 0x07;
+			if( src == 0 ) {
+				NEXT();
+			}
+			dest = (GR.rs[(regNumDest + 1) & 0x0f] << 9) | (GR.rs[regNumDest] << 1);	// bit 0 for carry
+
+			dest >>= src;
+			SYNC_FLAGS();
+			PSW.field.C = dest & 0x01;
+
+			GR.rs[regNumDest] = ((dest >> 1) & 0xff);
+
+			NEXT();
+
+		TARGET(OP_SRA_R_R)
+			// SRA Rn, Rm
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			dest = GR.rs[regNumDest];
+			src = GR.rs[regNumSrc];
+			GR.rs[regNumDest] = _ALU_SRA(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_EXTBW)
+			//EXTBW ERn
+			src = GR.rs[regNumSrc];
+
+			SET_ZS(src, 8);
+
+			GR.rs[regNumDest] = SIGN8(src)? 0xff : 0;
+			NEXT();
+
+		TARGET(OP_DAA)
+			// DAA Rn
+			dest = GR.rs[regNumDest];
+			GR.rs[regNumDest] = _ALU_DAA(ctx, dest);
+			NEXT();
+
+		TARGET(OP_DAS)
+			// DAS Rn
+			dest = GR.rs[regNumDest];
+			GR.rs[regNumDest] = _ALU_DAS(ctx, dest);
+			NEXT();
+
+		TARGET(OP_NEG)
+			//NEG Rn
+			dest = GR.rs[regNumDest];
+			GR.rs[regNumDest] = _ALU_NEG(ctx, dest);
+			NEXT();
+
+		TARGET(OP_L_R_ERM)
+			// L Rn, [ERm]
+			src = GR.ers[regNumSrc >> 1];
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			goto load_r;
+
+		TARGET(OP_L_R_ADR)
+			// L Rn, [adr]
+			src = imm;
+			PC = (PC + 2) & 0xfffe;
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			goto load_r;
+
+		TARGET(OP_L_R_EA)
+			// L Rn, [EA]
+			src = EA;
+			goto load_r;
+
+		TARGET(OP_L_R_EAP)
+			// L Rn, [EA+]
+			src = EA;
+			EA += 1; isEAInc = true;
+		load_r:
+			dest = memoryGetData(ctx, GET_DATA_SEG, src, 1);
+			ctx -> CycleCount += ctx -> ROMWinAccessCount;
+
+			SET_ZS(dest, 8);
+			GR.rs[regNumDest] = dest;
+			NEXT();
+
+		TARGET(OP_ST_R_ERM)
+			// ST Rn, [ERm]
+			dest = GR.ers[regNumSrc >> 1];
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			goto store_r;
+
+		TARGET(OP_ST_R_ADR)
+			// ST Rn, [adr]
+			dest = imm;
+			PC = (PC + 2) & 0xfffe;
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			goto store_r;
+
+		TARGET(OP_ST_R_EA)
+			// ST Rn, [EA]
+			dest = EA;
+			goto store_r;
+
+		TARGET(OP_ST_R_EAP)
+			// ST Rn, [EA+]
+			dest = EA;
+			EA += 1; isEAInc = true;
+		store_r:
+			memorySetData(ctx, GET_DATA_SEG, dest, 1, GR.rs[regNumDest]);
+			NEXT();
+
+		TARGET(OP_L_ER_ERM)
+			// L ERn, [ERm]
+			src = GR.ers[regNumSrc >> 1];
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			goto load_er;
+
+		TARGET(OP_L_ER_ADR)
+			// L ERn, [adr]
+			src = imm;
+			PC = (PC + 2) & 0xfffe;
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			goto load_er;
+
+		TARGET(OP_L_ER_EA)
+			// L ERn, [EA]
+			src = EA;
+			goto load_er;
+
+		TARGET(OP_L_ER_EAP)
+			// L ERn, [EA+]
+			src = EA;
+			EA = (EA + 2) & 0xfffe; isEAInc = true;
+		load_er:
+			dest = memoryGetData(ctx, GET_DATA_SEG, src, 2);
+#ifdef CORE_IS_U16
+			ctx -> CycleCount += (ctx -> ROMWinAccessCount + 1) / 2;
+#else
+			ctx -> CycleCount += ctx -> ROMWinAccessCount;
+#endif
+
+			SET_ZS(dest, 16);
+			GR.ers[regNumDest >> 1] = dest;
+			NEXT();
+
+		TARGET(OP_ST_ER_ERM)
+			// ST ERn, [ERm]
+			dest = GR.ers[regNumSrc >> 1];
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			goto store_er;
+
+		TARGET(OP_ST_ER_ADR)
+			// ST ERn, [adr]
+			dest = imm;
+			PC = (PC + 2) & 0xfffe;
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			goto store_er;
+
+		TARGET(OP_ST_ER_EA)
+			// ST ERn, [EA]
+			dest = EA;
+			goto store_er;
+
+		TARGET(OP_ST_ER_EAP)
+			// ST ERn, [EA+]
+			dest = EA;
+			EA = (EA + 2) & 0xfffe; isEAInc = true;
+		store_er:
+			memorySetData(ctx, GET_DATA_SEG, dest, 2, GR.ers[regNumDest >> 1]);
+			NEXT();
+
+		TARGET(OP_L_XR_EA)
+			// L XRn, [EA]
+			src = EA;
+			goto load_xr;
+
+		TARGET(OP_L_XR_EAP)
+			// L XRn, [EA+]
+			src = EA;
+			EA = (EA + 4) & 0xfffe;
+			isEAInc = true;
+		load_xr:
+			dest = memoryGetData(ctx, GET_DATA_SEG, src, 4);
+#ifdef CORE_IS_U16
+			ctx -> CycleCount += (ctx -> ROMWinAccessCount + 1) / 2;
+#else
+			ctx -> CycleCount += ctx -> ROMWinAccessCount;
+#endif
+
+			SET_ZS(dest, 32);
+			GR.xrs[regNumDest >> 2] = dest;
+			NEXT();
+
+		TARGET(OP_ST_XR_EA)
+			// ST XRn, [EA]
+			dest = EA;
+			goto store_xr;
+
+		TARGET(OP_ST_XR_EAP)
+			// ST XRn, [EA+]
+			dest = EA;
+			EA = (EA + 4) & 0xfffe;
+			isEAInc = true;
+		store_xr:
+			memorySetData(ctx, GET_DATA_SEG, dest, 4, GR.xrs[regNumDest >> 2]);
+			NEXT();
+
+		TARGET(OP_L_QR_EA)
+			// L QRn, [EA]
+			src = EA;
+			goto load_qr;
+
+		TARGET(OP_L_QR_EAP)
+			// L QRn, [EA+]
+			src = EA;
+			EA = (EA + 8) & 0xfffe;
+			isEAInc = true;
+		load_qr:
+			dest = memoryGetData(ctx, GET_DATA_SEG, src, 8);
+#ifdef CORE_IS_U16
+			ctx -> CycleCount += (ctx -> ROMWinAccessCount + 1) / 2;
+#else
+			ctx -> CycleCount += ctx -> ROMWinAccessCount;
+#endif
+
+			SET_ZS(dest, 64);
+			GR.qrs[regNumDest >> 3] = dest;
+			NEXT();
+
+		TARGET(OP_ST_QR_EA)
+			// ST QRn, [EA]
+			dest = EA;
+			goto store_qr;
+
+		TARGET(OP_ST_QR_EAP)
+			// ST QRn, [EA+]
+			dest = EA;
+			EA = (EA + 8) & 0xfffe;
+			isEAInc = true;
+		store_qr:
+			memorySetData(ctx, GET_DATA_SEG, dest, 8, GR.qrs[regNumDest >> 3]);
+			NEXT();
+
+		TARGET(OP_L_R_D16)
+			// L Rn, d16[ERm]
+			src = GR.ers[regNumSrc >> 1];
+			src = (src + imm) & 0xffff;
+			PC = (PC + 2) & 0xfffe;
+			dest = memoryGetData(ctx, GET_DATA_SEG, src, 1);
+			GR.rs[regNumDest] = dest;
+			SET_ZS(dest, 8);
+			ctx -> CycleCount += ctx -> ROMWinAccessCount + ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_ST_R_D16)
+			// ST Rn, d16[ERm]
+			dest = GR.ers[regNumSrc >> 1];
+			dest = (dest + imm) & 0xffff;
+			PC = (PC + 2) & 0xfffe;
+			memorySetData(ctx, GET_DATA_SEG, dest, 1, GR.rs[regNumDest]);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_SLL_R_IMM)
+			// SLL Rn, #width
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			dest = GR.rs[regNumDest];
+			src = regNumSrc;
+			GR.rs[regNumDest] = _ALU_SLL(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_SLLC_R_IMM)
+			// SLLC Rn, #width
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			src = regNumSrc;
+			if( src == 0 ) {
+				NEXT();
+			}
+			dest = (GR.rs[regNumDest] << 8) | GR.rs[(regNumDest - 1) & 0x0f];
+
+			dest >>= (8 - src);
+			SYNC_FLAGS();
+			PSW.field.C = (dest & 0x100)? 1 : 0;
+
+			GR.rs[regNumDest] = (dest & 0xff);
+
+			NEXT();
+
+		TARGET(OP_SRL_R_IMM)
+			// SRL Rn, #width
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			dest = GR.rs[regNumDest];
+			src = regNumSrc;
+			GR.rs[regNumDest] = _ALU_SRL(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_SRLC_R_IMM)
+			// SRLC Rn, #width
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			src = regNumSrc;
+			if( src == 0 ) {
+				NEXT();
+			}
+			dest = (GR.rs[(regNumDest + 1) & 0x0f] << 9) | (GR.rs[regNumDest] << 1);	// bit 0 for carry
+
+			dest >>= src;
+			SYNC_FLAGS();
+			PSW.field.C = dest & 0x01;
+
+			GR.rs[regNumDest] = ((dest >> 1) & 0xff);
+
+			NEXT();
+
+		TARGET(OP_SRA_R_IMM)
+			// SRA Rn, #width
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			dest = GR.rs[regNumDest];
+			src = regNumSrc;
+			GR.rs[regNumDest] = _ALU_SRA(ctx, dest, src);
+			NEXT();
+
+		TARGET(OP_LDSR_R)
+			// _LDSR Rd
+			DSR = GR.rs[regNumSrc];
+			isDSRSet = true;
+			FUSE();
+
+		TARGET(OP_SB_ADR)
+			// SB Dbitadr
+			PC = (PC + 2) & 0xfffe;
+			dest = memoryGetData(ctx, GET_DATA_SEG, imm, 1);
+			memorySetData(ctx, GET_DATA_SEG, imm, 1, _ALU_SB(ctx, dest, regNumSrc & 0x07));
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_SB_R)
+			// SB Rn.b
+			GR.rs[regNumDest] = _ALU_SB(ctx, GR.rs[regNumDest], regNumSrc & 0x07);
+			NEXT();
+
+		TARGET(OP_TB_ADR)
+			// TB Dbitadr
+			dest = memoryGetData(ctx, GET_DATA_SEG, imm, 1);
+			PC = (PC + 2) & 0xfffe;
+			_ALU_TB(ctx, dest, regNumSrc & 0x07);
+			ctx -> CycleCount += ctx -> ROMWinAccessCount + ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_TB_R)
+			// TB Rn.b
+			_ALU_TB(ctx, GR.rs[regNumDest], regNumSrc & 0x07);
+			NEXT();
+
+		TARGET(OP_RB_ADR)
+			// RB Dbitadr
+			PC = (PC + 2) & 0xfffe;
+			dest = memoryGetData(ctx, GET_DATA_SEG, imm, 1);
+			memorySetData(ctx, GET_DATA_SEG, imm, 1, _ALU_RB(ctx, dest, regNumSrc & 0x07));
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_RB_R)
+			// RB Rn.b
+			GR.rs[regNumDest] = _ALU_RB(ctx, GR.rs[regNumDest], regNumSrc & 0x07);
+			NEXT();
+
+		TARGET(OP_MOV_R_PSW)
+			// MOV Rn, PSW
+			SYNC_FLAGS();
+			GR.rs[regNumDest] = PSW.raw;
+			NEXT();
+
+		TARGET(OP_MOV_R_EPSW)
+			// MOV Rn, EPSW
+			if( PSW.field.ELevel != 0 )
+				GR.rs[regNumDest] = _getCurrEPSW(ctx)->raw;
+#ifdef CORE_IS_U16
+			else
+				GR.rs[regNumDest] = 0xFF;
+#endif
+			NEXT();
+
+		TARGET(OP_MOV_ER_ELR)
+			// MOV ERn, ELR
+			GR.ers[regNumDest] = *_getCurrELR(ctx);
+			NEXT();
+
+		TARGET(OP_MOV_R_ECSR)
+			// MOV Rn, ECSR
+			GR.rs[regNumDest] = *_getCurrECSR(ctx);
+			NEXT();
+
+		TARGET(OP_L_ER_D16)
+			// L ERn, d16[ERm]
+			src = GR.ers[regNumSrc >> 1];
+			src = (src + imm) & 0xffff;
+			PC = (PC + 2) & 0xfffe;
+			dest = memoryGetData(ctx, GET_DATA_SEG, src, 2);
+			GR.ers[regNumDest >> 1] = dest;
+			SET_ZS(dest, 16);
+			ctx -> CycleCount += ctx -> ROMWinAccessCount + ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_ST_ER_D16)
+			// ST ERn, d16[ERm]
+			dest = GR.ers[regNumSrc >> 1];
+			dest = (dest + imm) & 0xffff;
+			PC = (PC + 2) & 0xfffe;
+			memorySetData(ctx, GET_DATA_SEG, dest, 2, GR.ers[regNumDest >> 1]);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
 
-		case 0xd0:
-		case 0xd1:
-		case 0xd2:
-		case 0xd3:
-		case 0xd4:
-		case 0xd5:
-		case 0xd6:
-		case 0xd7:
-		case 0xd8:
-		case 0xd9:
-		case 0xda:
-		case 0xdb:
-		case 0xdc:
-		case 0xdd:
-		case 0xde:
-		case 0xdf:
-			switch( codeWord & 0x00c0 ) {
-				case 0x0000:
-					// L Rn, disp6[BP]
-					src = GR.ers[12 >> 1];		// src = ER12
-					src = (src + _signExtend(codeWord & 0x003f, 6)) & 0xffff;
-					dest = memoryGetData(GET_DATA_SEG, src, 1);
-					GR.rs[regNumDest] = dest;
-					PSW.field.S = SIGN8(dest);
-					PSW.field.Z = IS_ZERO(dest);
-					CycleCount += ROMWinAccessCount;
-					break;
+		TARGET(OP_MOV_ER_SP)
+			// MOV ERn, SP
+			GR.ers[regNumDest >> 1] = SP;
+			NEXT();
 
-				case 0x0040:
-					// L Rn, disp6[FP]
-					src = GR.ers[14 >> 1];		// src = ER14
-					src = (src + _signExtend(codeWord & 0x003f, 6)) & 0xffff;
-					dest = memoryGetData(GET_DATA_SEG, src, 1);
-					GR.rs[regNumDest] = dest;
-					PSW.field.S = SIGN8(dest);
-					PSW.field.Z = IS_ZERO(dest);
-					CycleCount += ROMWinAccessCount;
-					break;
+		TARGET(OP_MOV_SP_ER)
+			// MOV SP, ERm
+			setSP(GR.ers[regNumSrc >> 1]);
+			NEXT();
 
-				case 0x0080:
-					// ST Rn, disp6[BP]
-					dest = GR.ers[12 >> 1];		// dest = ER12
-					dest = (dest + _signExtend(codeWord & 0x003f, 6)) & 0xffff;
-					memorySetData(GET_DATA_SEG, dest, 1, GR.rs[regNumDest]);
-					break;
+		TARGET(OP_MOV_PSW_R)
+			// MOV PSW, Rm
+			SYNC_FLAGS();
+			PSW.raw = GR.rs[regNumSrc];
+			NEXT();
 
-				case 0x00c0:
-					// ST Rn, disp6[FP]
-					dest = GR.ers[14 >> 1];		// dest = ER14
-					dest = (dest + _signExtend(codeWord & 0x003f, 6)) & 0xffff;
-					memorySetData(GET_DATA_SEG, dest, 1, GR.rs[regNumDest]);
-					break;
+		TARGET(OP_MOV_EPSW_R)
+			// MOV EPSW, Rm
+			if( PSW.field.ELevel != 0 )
+				_getCurrEPSW(ctx)->raw = GR.rs[regNumSrc];
+			NEXT();
 
-				default:
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					goto exit;
-			}
-			CycleCount += 3 + EAIncDelay;
-			break;
-
-		case 0xe0:
-		case 0xe1:
-		case 0xe2:
-		case 0xe3:
-		case 0xe4:
-		case 0xe5:
-		case 0xe6:
-		case 0xe7:
-		case 0xe8:
-		case 0xe9:
-		case 0xea:
-		case 0xeb:
-		case 0xec:
-		case 0xed:
-		case 0xee:
-		case 0xef:
-			// I don't like it when it has immediates on the end of the instructions
-			if( (codeWord & 0x0180) == 0x0000 ) {
-				// MOV ERn, #imm7
-				src = _signExtend(codeWord & 0x007f, 7);
-				GR.ers[regNumDest >> 1] = src;
-				PSW.field.Z = IS_ZERO(src);
-				PSW.field.S = SIGN16(src);
-#ifdef CORE_IS_U16
-				CycleCount = 1;
-#else
-				CycleCount = 2;
+		TARGET(OP_MOV_ELR_ER)
+			// MOV ELR, ERm
+			*_getCurrELR(ctx) = GR.ers[regNumDest >> 1];
+			NEXT();
+
+		TARGET(OP_MOV_ECSR_R)
+			// MOV ECSR, Rm
+			*_getCurrECSR(ctx) = GR.rs[regNumSrc] & 0x0f;
+			NEXT();
+
+		TARGET(OP_L_ER_BP)
+			// L ERn, disp6[BP]
+			src = GR.ers[12 >> 1];		// src = ER12
+			goto load_er_disp6;
+
+		TARGET(OP_L_ER_FP)
+			// L ERn, disp6[FP]
+			src = GR.ers[14 >> 1];		// src = ER14
+		load_er_disp6:
+			src = (src + imm) & 0xffff;
+			dest = memoryGetData(ctx, GET_DATA_SEG, src, 2);
+			GR.ers[regNumDest >> 1] = dest;
+			SET_ZS(dest, 16);
+			ctx -> CycleCount += ctx -> ROMWinAccessCount + ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_ST_ER_BP)
+			// ST ERn, disp6[BP]
+			dest = GR.ers[12 >> 1];		// dest = ER12
+			goto store_er_disp6;
+
+		TARGET(OP_ST_ER_FP)
+			// ST ERn, disp6[FP]
+			dest = GR.ers[14 >> 1];		// dest = ER14
+		store_er_disp6:
+			dest = (dest + imm) & 0xffff;
+			memorySetData(ctx, GET_DATA_SEG, dest, 2, GR.ers[regNumDest >> 1]);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_BGE)
+			src = !FLAG_C;
+			goto branch;
+		TARGET(OP_BLT)
+			src = FLAG_C;
+			goto branch;
+		TARGET(OP_BGT)
+			src = !(FLAG_C | FLAG_Z);
+			goto branch;
+		TARGET(OP_BLE)
+			src = FLAG_C | FLAG_Z;
+			goto branch;
+		TARGET(OP_BGES)
+			src = !(FLAG_OV ^ FLAG_S);
+			goto branch;
+		TARGET(OP_BLTS)
+			src = FLAG_OV ^ FLAG_S;
+			goto branch;
+		TARGET(OP_BGTS)
+			src = !((FLAG_OV ^ FLAG_S) | FLAG_Z);
+			goto branch;
+		TARGET(OP_BLES)
+			src = (FLAG_OV ^ FLAG_S) | FLAG_Z;
+			goto branch;
+		TARGET(OP_BNE)
+			src = !FLAG_Z;
+			goto branch;
+		TARGET(OP_BEQ)
+			src = FLAG_Z;
+			goto branch;
+		TARGET(OP_BNV)
+			src = !FLAG_OV;
+			goto branch;
+		TARGET(OP_BOV)
+			src = FLAG_OV;
+			goto branch;
+		TARGET(OP_BPS)
+			src = !FLAG_S;
+			goto branch;
+		TARGET(OP_BNS)
+			src = FLAG_S;
+			goto branch;
+		TARGET(OP_BAL)
+			src = 1;
+		branch:
+			if( src ) {
+				PC += imm;
+				ctx -> CycleCount = 3;
+#ifdef CORE_IDLE_SKIP
+				if( imm & 0x8000 )
+					_coreSkipIdle(ctx, &totalCycles, &executed, count, cycleBudget);
 #endif
-				break;
 			}
-			if( (codeWord & 0x0180) == 0x0080 ) {
-				// ADD ERn, #imm7
-				src = _signExtend(codeWord & 0x007f, 7);
-				GR.ers[regNumDest >> 1] = _ALU_ADD_W(GR.ers[regNumDest >> 1], src);
+			NEXT();
+
+		TARGET(OP_L_R_BP)
+			// L Rn, disp6[BP]
+			src = GR.ers[12 >> 1];		// src = ER12
+			goto load_r_disp6;
+
+		TARGET(OP_L_R_FP)
+			// L Rn, disp6[FP]
+			src = GR.ers[14 >> 1];		// src = ER14
+		load_r_disp6:
+			src = (src + imm) & 0xffff;
+			dest = memoryGetData(ctx, GET_DATA_SEG, src, 1);
+			GR.rs[regNumDest] = dest;
+			SET_ZS(dest, 8);
+			ctx -> CycleCount += ctx -> ROMWinAccessCount + ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_ST_R_BP)
+			// ST Rn, disp6[BP]
+			dest = GR.ers[12 >> 1];		// dest = ER12
+			goto store_r_disp6;
+
+		TARGET(OP_ST_R_FP)
+			// ST Rn, disp6[FP]
+			dest = GR.ers[14 >> 1];		// dest = ER14
+		store_r_disp6:
+			dest = (dest + imm) & 0xffff;
+			memorySetData(ctx, GET_DATA_SEG, dest, 1, GR.rs[regNumDest]);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_MOV_ER_IMM)
+			// MOV ERn, #imm7
+			GR.ers[regNumDest >> 1] = imm;
+			SET_ZS(imm, 16);
+			NEXT();
+
+		TARGET(OP_ADD_ER_IMM)
+			// ADD ERn, #imm7
+			GR.ers[regNumDest >> 1] = _ALU_ADD_W(ctx, GR.ers[regNumDest >> 1], imm);
+			NEXT();
+
+		TARGET(OP_ADD_SP_IMM)
+			// ADD SP, #signed8
+			setSP(SP + imm);
+			NEXT();
+
+		TARGET(OP_LDSR_IMM)
+			// _LDSR #imm8
+			DSR = imm;
+			isDSRSet = true;
+			FUSE();
+
+		TARGET(OP_SWI)
+			// SWI #snum
+			SYNC_FLAGS();
+			coreDoSWI(ctx, imm);
+			NEXT();
+
+		TARGET(OP_MOV_PSW_IMM)
+			// MOV PSW, #unsigned8
+			SYNC_FLAGS();
+			PSW.raw = imm;
+			NEXT();
+
+		TARGET(OP_MOV_R_CR)
+			// MOV Rn, CRm
+			GR.rs[regNumDest] = CR.rs[regNumSrc];
+			NEXT();
+
+		TARGET(OP_MOV_CR_R)
+			// MOV CRn, Rm
+			CR.rs[regNumDest] = GR.rs[regNumSrc];
+			COPRO_WRITTEN(regNumDest, 1);
+			NEXT();
+
+		TARGET(OP_L_CR_EA)
+			// MOV CRn/CERn/CXRn/CQRn, [EA]
+			src = EA;
+			goto load_cr;
+
+		TARGET(OP_L_CR_EAP)
+			// MOV CRn/CERn/CXRn/CQRn, [EA+]
+			src = EA;
+			EA = (CR_WIDTH == 1)? EA + 1 : (EA + CR_WIDTH) & 0xfffe;
+			isEAInc = true;
+		load_cr:
+			// all of it in one access, whatever the width
+			dest = memoryGetData(ctx, GET_DATA_SEG, src, CR_WIDTH);
 #ifdef CORE_IS_U16
-				CycleCount = 1;
+			ctx -> CycleCount += (CR_WIDTH == 1)? ctx -> ROMWinAccessCount : (ctx -> ROMWinAccessCount + 1) / 2;
 #else
-				CycleCount = 2;
+			ctx -> CycleCount += ctx -> ROMWinAccessCount;
 #endif
-				break;
-			}
-			switch( codeWord & 0x0f00 ) {
-				case 0x0100:
-					// ADD SP, #signed8
-					setSP(SP + _signExtend(immNum, 8));
-					CycleCount = 2;
-					break;
 
-				case 0x0300:
-					// _LDSR #imm8
-					DSR = immNum;
-					isDSRSet = true;
-					CycleCount = 1;
+			switch( CR_WIDTH ) {
+				case 1:
+					CR.rs[regNumDest] = dest;
 					break;
-
-				case 0x0500:
-					// SWI #snum
-					coreDoSWI(immNum);
+				case 2:
+					CR.ers[regNumDest >> 1] = dest;
 					break;
-
-				case 0x0900:
-					// MOV PSW, #unsigned8
-					PSW.raw = immNum;
-					CycleCount = 1;
+				case 4:
+					CR.xrs[regNumDest >> 2] = dest;
 					break;
+				default:
+					CR.qrs[regNumDest >> 3] = dest;
+			}
+			COPRO_WRITTEN(regNumDest, CR_WIDTH);
+			NEXT();
 
-				case 0x0b00:
-					if( codeWord == 0xeb7f ) {
-						// RC
-						PSW.field.C = 0;
-						CycleCount = 1;
-						break;
-					}
-					if( codeWord == 0xebf7 ) {
-						// DI
-						PSW.field.MIE = 0;
-						CycleCount = 3;
-						break;
-					}
-
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					break;
+		TARGET(OP_ST_CR_EA)
+			// MOV [EA], CRm/CERm/CXRm/CQRm
+			dest = EA;
+			goto store_cr;
 
-				case 0x0d00:
-					if( codeWord == 0xed08 ) {
-						// EI
-						PSW.field.MIE = 1;
-						CycleCount = 1;
-						// Todo: Disable maskable interrupts for 2 cycles
-						break;
-					}
-					if( codeWord == 0xed80 ) {
-						// SC
-						PSW.field.C = 1;
-						CycleCount = 1;
-						break;
-					}
-
-					retVal = CORE_ILLEGAL_INSTRUCTION;
+		TARGET(OP_ST_CR_EAP)
+			// MOV [EA+], CRm/CERm/CXRm/CQRm
+			dest = EA;
+			EA = (CR_WIDTH == 1)? EA + 1 : (EA + CR_WIDTH) & 0xfffe;
+			isEAInc = true;
+		store_cr:
+			switch( CR_WIDTH ) {
+				case 1:
+					src = CR.rs[regNumDest];
+					break;
+				case 2:
+					src = CR.ers[regNumDest >> 1];
 					break;
+				case 4:
+					src = CR.xrs[regNumDest >> 2];
+					break;
+				default:
+					src = CR.qrs[regNumDest >> 3];
 			}
-			break;
+			memorySetData(ctx, GET_DATA_SEG, dest, CR_WIDTH, src);
+			NEXT();
 
-		case 0xf0:
-			if( (codeWord & 0x00f0) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_RC)
+			// RC
+			SYNC_FLAGS();
+			PSW.field.C = 0;
+			NEXT();
+
+		TARGET(OP_DI)
+			// DI
+			PSW.field.MIE = 0;
+			NEXT();
+
+		TARGET(OP_EI)
+			// EI
+			PSW.field.MIE = 1;
+			// Todo: Disable maskable interrupts for 2 cycles
+			NEXT();
+
+		TARGET(OP_SC)
+			// SC
+			SYNC_FLAGS();
+			PSW.field.C = 1;
+			NEXT();
+
+		TARGET(OP_B_CADR)
 			// B Cadr
-			PC = memoryGetCodeWord(CSR, PC) & 0xfffe;
+			PC = imm & 0xfffe;
 			CSR = regNumDest;
-			CycleCount = 2 + EAIncDelay;
-			break;
+			_coreSetCodeSegment(ctx);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
 
-		case 0xf1:
-			if( (codeWord & 0x00f0) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_BL_CADR)
 			// BL Cadr
 			LR = (PC + 2) & 0xfffe;
 			LCSR = CSR;
-			PC = memoryGetCodeWord(CSR, PC) & 0xfffe;
+			PC = imm & 0xfffe;
 			CSR = regNumDest;
-			CycleCount = 2 + EAIncDelay;
-			break;
+			_coreSetCodeSegment(ctx);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
 
-		case 0xf2:
-			if( (codeWord & 0x0f10) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_B_ER)
 			// B ERn
 			PC = GR.ers[regNumSrc >> 1] & 0xfffe;
-			CycleCount = 2 + EAIncDelay;
-			break;
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
 
-		case 0xf3:
-			if( (codeWord & 0x0f10) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_BL_ER)
 			// BL ERn
 			LR = PC;	// Pc has been incremented and this instruction is 1 word long
 			LCSR = CSR;
 			PC = GR.ers[regNumSrc >> 1] & 0xfffe;
-			CycleCount = 2 + EAIncDelay;
-			break;
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
 
-		case 0xf4:
-			if( (codeWord & 0x0100) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_MUL)
 			// MUL ERn, Rm
-			CycleCount = 9;
 			dest = GR.rs[regNumDest] * GR.rs[regNumSrc];
+			SYNC_FLAGS();
 			PSW.field.Z = IS_ZERO(dest);
 			GR.ers[regNumDest >> 1] = dest & 0xffff;
-			break;
+			NEXT();
 
-		case 0xf5:
-			if( (codeWord & 0x0110) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_MOV_ER_ER)
 			// MOV ERn, ERm
-#ifdef CORE_IS_U16
-			CycleCount = 1;
-#else
-			CycleCount = 2;
-#endif
 			dest = GR.ers[regNumSrc >> 1];
-			PSW.field.Z = IS_ZERO(dest);
-			PSW.field.S = SIGN16(dest);
+			SET_ZS(dest, 16);
 			GR.ers[regNumDest >> 1] = dest;
-			break;
+			NEXT();
 
-		case 0xf6:
-			if( (codeWord & 0x0110) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_ADD_ER_ER)
 			// ADD ERn, ERm
-#ifdef CORE_IS_U16
-				CycleCount = 1;
-#else
-				CycleCount = 2;
-#endif
-			GR.ers[regNumDest >> 1] = _ALU_ADD_W(GR.ers[regNumDest >> 1], GR.ers[regNumSrc >> 1]);
-			break;
+			GR.ers[regNumDest >> 1] = _ALU_ADD_W(ctx, GR.ers[regNumDest >> 1], GR.ers[regNumSrc >> 1]);
+			NEXT();
 
-		case 0xf7:
-			if( (codeWord & 0x0110) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_CMP_ER_ER)
 			// CMP ERn, ERm
-#ifdef CORE_IS_U16
-				CycleCount = 1;
-#else
-				CycleCount = 2;
-#endif
-			_ALU_CMP_W(GR.ers[regNumDest >> 1], GR.ers[regNumSrc >> 1]);
-			break;
+			_ALU_CMP_W(ctx, GR.ers[regNumDest >> 1], GR.ers[regNumSrc >> 1]);
+			NEXT();
 
-		case 0xf9:
-			if( (codeWord & 0x0100) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_DIV)
 			// DIV ERn, Rm
 			dest = GR.ers[regNumDest >> 1];
 			src = GR.rs[regNumSrc];
-			CycleCount = 17;
+			SYNC_FLAGS();
 			PSW.field.Z = dest < src? 1 : 0;	// if dividend < divisor, the result will be 0
 			PSW.field.C = 0;
 			if( src == 0 ) {
@@ -1824,384 +2727,419 @@ CORE_STATUS coreStep(void) {
 				PSW.field.C = 1;
 				GR.rs[regNumSrc] = dest & 0xff;		// remainder
 				GR.ers[regNumDest >> 1] = 0xffff;	// result
-				break;
+				NEXT();
 			}
 			// Else both number are not zero
 			GR.rs[regNumSrc] = (dest % src) & 0xff;
 			GR.ers[regNumDest >> 1] = (dest / src) & 0xffff;
-			break;
+			NEXT();
 
-		case 0xfa:
-			if( (codeWord & 0x0010) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_LEA_ER)
 			// LEA [ERm]
 			EA = GR.ers[regNumSrc >> 1];
-			CycleCount = 1;
-			break;
+			NEXT();
 
-		case 0xfb:
-			if( (codeWord & 0x0010) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_LEA_D16)
 			// LEA disp16[ERm]
 			dest = GR.ers[regNumSrc >> 1];
-			EA = (memoryGetCodeWord(CSR, PC) + dest) & 0xffff;
+			EA = (imm + dest) & 0xffff;
 			PC = (PC + 2) & 0xfffe;
-			CycleCount = 2;
-			break;
+			NEXT();
 
-		case 0xfc:
-			if( (codeWord & 0x0010) != 0x0000 ) {
-				retVal = CORE_ILLEGAL_INSTRUCTION;
-				break;
-			}
+		TARGET(OP_LEA_ADR)
 			// LEA Dadr
-			EA = memoryGetCodeWord(CSR, PC);
+			EA = imm;
 			PC = (PC + 2) & 0xfffe;
-			CycleCount = 2;
-			break;
-
-		case 0xfd:
-			// MOV CRn, [EA]
-			// MOV CRn, [EA+]
-			// MOV CERn, [EA]
-			// MOV CERn, [EA+]
-			// MOV CXRn, [EA]
-			// MOV CXRn, [EA+]
-			// MOV CQRn, [EA]
-			// MOV CQRn, [EA+]
-			// MOV [EA], CRm
-			// MOV [EA+], CRm
-			// MOV [EA], CERm
-			// MOV [EA+], CERm
-			// MOV [EA], CXRm
-			// MOV [EA+], CXRm
-			// MOV [EA], CQRm
-			// MOV [EA+], CQRm
-			retVal = CORE_UNIMPLEMENTED;
-			break;
-
-		case 0xfe:
-			switch( codeWord & 0x00f0 ) {
-				case 0x0000:
-					// POP Rn
-					GR.rs[regNumDest] = _popValue(1);
+			NEXT();
+
+		TARGET(OP_POP_R)
+			// POP Rn
+			GR.rs[regNumDest] = _popValue(ctx, 1);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_POP_ER)
+			// POP ERn
+			GR.ers[regNumDest >> 1] = _popValue(ctx, 2);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_POP_XR)
+			// POP XRn
+			GR.xrs[regNumDest >> 2] = _popValue(ctx, 4);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_POP_QR)
+			// POP QRn
+			GR.qrs[regNumDest >> 3] = _popValue(ctx, 8);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_PUSH_R)
+			// PUSH Rn
+			_pushValue(ctx, GR.rs[regNumDest], 1);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_PUSH_ER)
+			// PUSH ERn
+			_pushValue(ctx, GR.ers[regNumDest >> 1], 2);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_PUSH_XR)
+			// PUSH XRn
+			_pushValue(ctx, GR.xrs[regNumDest >> 2], 4);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_PUSH_QR)
+			// PUSH QRn
+			_pushValue(ctx, GR.qrs[regNumDest >> 3], 8);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_POP_LEPA)
+			// POP lepa
+			// Assume LARGE model (with CSR)
+			if( regNumDest & 0x01 ) {
+				// EA
+				EA = _popValue(ctx, 2);
 #ifdef CORE_IS_U16
-					CycleCount = 1 + EAIncDelay;
+				ctx -> CycleCount += 1;
 #else
-					CycleCount = 2 + EAIncDelay;
+				ctx -> CycleCount += 2;
 #endif
-					break;
-
-				case 0x0010:
-					// POP ERn
-					if( (regNumDest & 0x01) != 0x00 ) {
-						retVal = CORE_ILLEGAL_INSTRUCTION;
-						break;
-					}
-					GR.ers[regNumDest >> 1] = _popValue(2);
+			}
+			if( regNumDest & 0x08 ) {
+				// LR
+				LR = _popValue(ctx, 2);
+				LCSR = _popValue(ctx, 1) & 0x0f;
 #ifdef CORE_IS_U16
-					CycleCount = 1 + EAIncDelay;
+				ctx -> CycleCount += 2;
 #else
-					CycleCount = 2 + EAIncDelay;
+				ctx -> CycleCount += 4;
 #endif
-					break;
-
-				case 0x0020:
-					// POP XRn
-					if( (regNumDest & 0x03) != 0x00 ) {
-						retVal = CORE_ILLEGAL_INSTRUCTION;
-						break;
-					}
-					GR.xrs[regNumDest >> 2] = _popValue(4);
+			}
+			if( regNumDest & 0x04 ) {
+				// PSW
+				SYNC_FLAGS();
+				PSW.raw = _popValue(ctx, 1);
 #ifdef CORE_IS_U16
-					CycleCount = 2 + EAIncDelay;
+				ctx -> CycleCount += 1;
 #else
-					CycleCount = 4 + EAIncDelay;
+				ctx -> CycleCount += 2;
 #endif
-					break;
-
-				case 0x0030:
-					// POP QRn
-					if( (regNumDest & 0x07) != 0x00 ) {
-						retVal = CORE_ILLEGAL_INSTRUCTION;
-						break;
-					}
-					GR.qrs[regNumDest >> 3] = _popValue(8);
+			}
+			if( regNumDest & 0x02 ) {
+				// PC
+				PC = _popValue(ctx, 2) & 0xfffe;
+				CSR = _popValue(ctx, 1) & 0x0f;
+				_coreSetCodeSegment(ctx);
 #ifdef CORE_IS_U16
-					CycleCount = 4 + EAIncDelay;
+				ctx -> CycleCount += 4;
 #else
-					CycleCount = 8 + EAIncDelay;
+				ctx -> CycleCount += 5;
 #endif
-					break;
-
-				case 0x0040:
-					// PUSH Rn
-					_pushValue(GR.rs[regNumDest], 1);
+			}
+			if( ctx -> CycleCount )
+				ctx -> CycleCount = 1;		// Assume 1 cycle if no register
+			else
+				ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_PUSH_LEPA)
+			// PUSH lepa
+			// Assume LARGE model (with CSR)
+			if( regNumDest & 0x02 ) {
+				// ELR
+				_pushValue(ctx, *_getCurrECSR(ctx), 1);
+				_pushValue(ctx, *_getCurrELR(ctx), 2);
 #ifdef CORE_IS_U16
-					CycleCount = 1 + EAIncDelay;
+				ctx -> CycleCount += 2;
 #else
-					CycleCount = 2 + EAIncDelay;
+				ctx -> CycleCount += 4;
 #endif
-					break;
-
-				case 0x0050:
-					// PUSH ERn
-					if( (regNumDest & 0x01) != 0x00 ) {
-						retVal = CORE_ILLEGAL_INSTRUCTION;
-						break;
-					}
-					_pushValue(GR.ers[regNumDest >> 1], 2);
+			}
+			if( regNumDest & 0x04 ) {
+				// EPSW
+				_pushValue(ctx, _getCurrEPSW(ctx)->raw, 1);
 #ifdef CORE_IS_U16
-					CycleCount = 1 + EAIncDelay;
+				ctx -> CycleCount += 1;
 #else
-					CycleCount = 2 + EAIncDelay;
+				ctx -> CycleCount += 2;
 #endif
-					break;
-
-				case 0x0060:
-					// PUSH XRn
-					if( (regNumDest & 0x03) != 0x00 ) {
-						retVal = CORE_ILLEGAL_INSTRUCTION;
-						break;
-					}
-					_pushValue(GR.xrs[regNumDest >> 2], 4);
+			}
+			if( regNumDest & 0x08 ) {
+				// LR
+				_pushValue(ctx, LCSR, 1);
+				_pushValue(ctx, LR, 2);
 #ifdef CORE_IS_U16
-					CycleCount = 2 + EAIncDelay;
+				ctx -> CycleCount += 2;
 #else
-					CycleCount = 4 + EAIncDelay;
+				ctx -> CycleCount += 4;
 #endif
-					break;
-
-				case 0x0070:
-					// PUSH QRn
-					if( (regNumDest & 0x07) != 0x00 ) {
-						retVal = CORE_ILLEGAL_INSTRUCTION;
-						break;
-					}
-					_pushValue(GR.qrs[regNumDest >> 3], 8);
+			}
+			if( regNumDest & 0x01 ) {
+				// EA
+				_pushValue(ctx, EA, 2);
 #ifdef CORE_IS_U16
-					CycleCount = 4 + EAIncDelay;
+				ctx -> CycleCount += 1;
 #else
-					CycleCount = 8 + EAIncDelay;
+				ctx -> CycleCount += 2;
 #endif
-					break;
+			}
+			if( ctx -> CycleCount )
+				ctx -> CycleCount = 1;		// Assume 1 cycle if no register
+			else
+				ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_RTI)
+			// RTI
+			CSR = *_getCurrECSR(ctx);
+			PC = *_getCurrELR(ctx);
+			_coreSetCodeSegment(ctx);
+			SYNC_FLAGS();
+			PSW.raw = _getCurrEPSW(ctx)->raw;
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_RT)
+			// RT
+			CSR = LCSR;
+			PC = LR;
+			_coreSetCodeSegment(ctx);
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_INC_EA)
+			// INC [EA]
+			// Yes, OKI decided that `INC [EA]` shouldn't affect carry flag
+			SYNC_FLAGS();
+			dest = PSW.field.C;
+			memorySetData(ctx, GET_DATA_SEG, EA, 1, _ALU_ADD(ctx, memoryGetData(ctx, GET_DATA_SEG, EA, 1), 1));
+			SYNC_FLAGS();
+			PSW.field.C = dest;
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_DEC_EA)
+			// DEC [EA]
+			// Same for `DEC [EA]`
+			SYNC_FLAGS();
+			dest = PSW.field.C;
+			memorySetData(ctx, GET_DATA_SEG, EA, 1, _ALU_SUB(ctx, memoryGetData(ctx, GET_DATA_SEG, EA, 1), 1));
+			SYNC_FLAGS();
+			PSW.field.C = dest;
+			ctx -> CycleCount += ctx -> EAIncDelay;
+			NEXT();
+
+		TARGET(OP_NOP)
+			// NOP
+			NEXT();
+
+		TARGET(OP_UDSR)
+			// _UDSR
+			isDSRSet = true;
+			FUSE();
+
+		TARGET(OP_CPLC)
+			// CPLC
+			SYNC_FLAGS();
+			PSW.field.C ^= 1;
+			NEXT();
+
+		TARGET(OP_BRK)
+			// BRK
+			// Actually this code should call a standard interrupt implementation
+			SYNC_FLAGS();
+			if( PSW.field.ELevel > 1 ) {
+				// reset if ELEVEL is 2 or 3
+				VARIANT(coreReset)(ctx);
+			}
+			else {
+				ELR2 = PC;
+				ECSR2 = CSR;
+				EPSW2 = PSW;
+				PSW.field.ELevel = 2;
+				CSR = 0;
+				PC = memoryGetCodeWord(ctx, (SR_t)0, (PC_t)0x0004);
+				_coreSetCodeSegment(ctx);
+			}
+			ctx -> CycleCount = 7 + ctx -> EAIncDelay;
+			if( isStoppable ) {
+				RETIRE();
+				reason = CORE_STOP_BRK;
+				goto stop;
+			}
+			NEXT();
 
-				case 0x0080:
-					// POP lepa
-					// Assume LARGE model (with CSR)
-					if( regNumDest & 0x01 ) {
-						// EA
-						EA = _popValue(2);
-#ifdef CORE_IS_U16
-						CycleCount += 1;
-#else
-						CycleCount += 2;
-#endif
-					}
-					if( regNumDest & 0x08 ) {
-						// LR
-						LR = _popValue(2);
-						LCSR = _popValue(1) & 0x0f;
-#ifdef CORE_IS_U16
-						CycleCount += 2;
-#else
-						CycleCount += 4;
-#endif
-					}
-					if( regNumDest & 0x04 ) {
-						// PSW
-						PSW.raw = _popValue(1);
-#ifdef CORE_IS_U16
-						CycleCount += 1;
-#else
-						CycleCount += 2;
-#endif
-					}
-					if( regNumDest & 0x02 ) {
-						// PC
-						PC = _popValue(2) & 0xfffe;
-						CSR = _popValue(1) & 0x0f;
-#ifdef CORE_IS_U16
-						CycleCount += 4;
-#else
-						CycleCount += 5;
-#endif
-					}
-					if( CycleCount )
-						CycleCount = 1;		// Assume 1 cycle if no register
-					else
-						CycleCount += EAIncDelay;
-					break;
+		TARGET(OP_NONE)
+			NEXT();
 
-				case 0x00c0:
-					// PUSH lepa
-					// Assume LARGE model (with CSR)
-					if( regNumDest & 0x02 ) {
-						// ELR
-						_pushValue(*_getCurrECSR(), 1);
-						_pushValue(*_getCurrELR(), 2);
-#ifdef CORE_IS_U16
-						CycleCount += 2;
-#else
-						CycleCount += 4;
-#endif
-					}
-					if( regNumDest & 0x04 ) {
-						// EPSW
-						_pushValue(_getCurrEPSW()->raw, 1);
-#ifdef CORE_IS_U16
-						CycleCount += 1;
-#else
-						CycleCount += 2;
-#endif
-					}
-					if( regNumDest & 0x08 ) {
-						// LR
-						_pushValue(LCSR, 1);
-						_pushValue(LR, 2);
-#ifdef CORE_IS_U16
-						CycleCount += 2;
-#else
-						CycleCount += 4;
-#endif
-					}
-					if( regNumDest & 0x01 ) {
-						// EA
-						_pushValue(EA, 2);
-#ifdef CORE_IS_U16
-						CycleCount += 1;
-#else
-						CycleCount += 2;
-#endif
-					}
-					if( CycleCount )
-						CycleCount = 1;		// Assume 1 cycle if no register
-					else
-						CycleCount += EAIncDelay;
-					break;
+		TARGET(OP_UNIMPLEMENTED)
+			retVal = CORE_UNIMPLEMENTED;
+			goto exit;
 
-				default:
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					break;
+		TARGET_DEFAULT(OP_ILLEGAL)
+			retVal = CORE_ILLEGAL_INSTRUCTION;
+			goto exit;
+	DISPATCH_END
+
+done:
+	// a stop request may have stopped us
+	if( isStoppable ) {
+		if( ctx -> CoreStopRequests[CORE_STOP_REQUEST_HOST] ) {
+			ctx -> CoreStopRequests[CORE_STOP_REQUEST_HOST] = 0;
+			reason = CORE_STOP_HOST;
+		}
+		else if( ctx -> CoreStopRequests[CORE_STOP_REQUEST_WATCH] ) {
+			ctx -> CoreStopRequests[CORE_STOP_REQUEST_WATCH] = 0;
+			reason = CORE_STOP_WATCH;
+		}
+		else if( ctx -> CoreStopRequests[CORE_STOP_REQUEST_INTERRUPT] ) {
+			ctx -> CoreStopRequests[CORE_STOP_REQUEST_INTERRUPT] = 0;
+			reason = CORE_STOP_INTERRUPT;
+		}
+	}
+stop:
+	ctx -> CycleCount = totalCycles;
+	goto leave;
 
-			}
+exit:
+	// the instruction that stopped us still counts
+	ctx -> CycleCount += totalCycles;
+	switch( retVal ) {
+		case CORE_UNIMPLEMENTED:
+			reason = CORE_STOP_UNIMPLEMENTED;
 			break;
+		case CORE_MEMORY_UNINITIALIZED:
+			reason = CORE_STOP_MEMORY_UNINITIALIZED;
+			break;
+		default:
+			reason = CORE_STOP_ILLEGAL_INSTRUCTION;
+	}
 
-		case 0xff:
-			switch( codeWord ) {
-				case 0xfe0f:
-					// RTI
-					CSR = *_getCurrECSR();
-					PC = *_getCurrELR();
-					PSW.raw = _getCurrEPSW()->raw;
-					CycleCount = 2 + EAIncDelay;
-					break;
+leave:
+	SYNC_FLAGS();
+	if( isStoppable ) {
+		result -> reason = reason;
+		result -> cycles = ctx -> CycleCount;
+		result -> instructions = executed;
+	}
+	return retVal;
+}
 
-				case 0xfe1f:
-					// RT
-					CSR = LCSR;
-					PC = LR;
-					CycleCount = 2 + EAIncDelay;
-					break;
 
-				case 0xfe2f:
-					// INC [EA]
-					// Yes, OKI decided that `INC [EA]` shouldn't affect carry flag
-					dest = PSW.field.C;
-					memorySetData(GET_DATA_SEG, EA, 1, _ALU_ADD(memoryGetData(GET_DATA_SEG, EA, 1), 1));
-					PSW.field.C = dest;
-					CycleCount = 2 + EAIncDelay;
-					break;
+CORE_STATUS VARIANT(coreStep)(EmuContext_t *ctx) {
+	return _coreExecute(ctx, 1, INT_MAX, NULL);
+}
 
-				case 0xfe3f:
-					// DEC [EA]
-					// Same for `DEC [EA]`
-					dest = PSW.field.C;
-					memorySetData(GET_DATA_SEG, EA, 1, _ALU_SUB(memoryGetData(GET_DATA_SEG, EA, 1), 1));
-					PSW.field.C = dest;
-					CycleCount = 2 + EAIncDelay;
-					break;
+// Runs up to `count` instructions in one go
+// Returns as soon as an instruction doesn't return `CORE_OK`.
+// `CycleCount` is set to the cycles taken by all the instructions run.
+CORE_STATUS VARIANT(coreStepMany)(EmuContext_t *ctx, unsigned int count) {
+	return _coreExecute(ctx, count, INT_MAX, NULL);
+}
 
-				case 0xfe8f:
-					// NOP
-					CycleCount = 1;
-					break;
+// Runs until `cycleBudget` cycles or `instructionBudget` instructions are used up,
+// whichever comes first, or until something stops it (see `CORE_STOP_REASON`)
+// The instruction that uses the budget up is run to the end, so it may take a few more cycles.
+// Pass `INT_MAX`/`UINT_MAX` to leave a budget out.
+// `CycleCount` is set to the cycles taken as well.
+CoreRunResult_t VARIANT(coreRun)(EmuContext_t *ctx, int cycleBudget, unsigned int instructionBudget) {
+	CoreRunResult_t result;
 
-				case 0xfe9f:
-					// _UDSR
-					isDSRSet = true;
-					CycleCount = 1;
-					break;
+	_coreExecute(ctx, instructionBudget, cycleBudget, &result);
+	return result;
+}
 
-				case 0xfecf:
-					// CPLC
-					PSW.field.C ^= 1;
-					CycleCount = 1;
-					break;
+#ifndef CORE_U16_COPY
+#ifdef CORE_DUAL_VARIANT
+CORE_STATUS coreReset(EmuContext_t *ctx) {
+	return ctx -> IsU16? coreResetU16(ctx) : coreResetU8(ctx);
+}
 
-				case 0xffff:
-					// BRK
-					// Actually this code should call a standard interrupt implementation
-					if( PSW.field.ELevel > 1 ) {
-						// reset if ELEVEL is 2 or 3
-						coreReset();
-					}
-					else {
-						ELR2 = PC;
-						ECSR2 = CSR;
-						EPSW2 = PSW;
-						PSW.field.ELevel = 2;
-						CSR = 0;
-						PC = memoryGetCodeWord((SR_t)0, (PC_t)0x0004);
-					}
-					CycleCount = 7 + EAIncDelay;
-					break;
+CORE_STATUS coreStep(EmuContext_t *ctx) {
+	return ctx -> IsU16? coreStepU16(ctx) : coreStepU8(ctx);
+}
 
-				default:
-					retVal = CORE_ILLEGAL_INSTRUCTION;
-					break;
+CORE_STATUS coreStepMany(EmuContext_t *ctx, unsigned int count) {
+	return ctx -> IsU16? coreStepManyU16(ctx, count) : coreStepManyU8(ctx, count);
+}
 
-			}
-			break;
+CoreRunResult_t coreRun(EmuContext_t *ctx, int cycleBudget, unsigned int instructionBudget) {
+	return ctx -> IsU16? coreRunU16(ctx, cycleBudget, instructionBudget) : coreRunU8(ctx, cycleBudget, instructionBudget);
+}
 
-		default:
-			retVal = CORE_ILLEGAL_INSTRUCTION;
-			break;
-	}
+const CoreInstruction_t* coreFetchDecoded(EmuContext_t *ctx, SR_t segment, PC_t offset) {
+	return ctx -> IsU16? coreFetchDecodedU16(ctx, segment, offset) : coreFetchDecodedU8(ctx, segment, offset);
+}
 
+#ifdef CORE_BLOCK_CACHE
+const CoreBlock_t* coreFetchBlock(EmuContext_t *ctx, SR_t segment, PC_t offset) {
+	return ctx -> IsU16? coreFetchBlockU16(ctx, segment, offset) : coreFetchBlockU8(ctx, segment, offset);
+}
+#endif
+#endif
 
-	if( retVal == CORE_OK ) {
-		EAIncDelay = isEAInc? 1 : 0;
-		NextAccess = isDSRSet? DATA_ACCESS_DSR : DATA_ACCESS_PAGE0;
+// Makes `coreRun()` stop before the next instruction, with `CORE_STOP_HOST`
+// Safe to call from memory handlers and signal handlers, or from another thread.
+void coreRequestStop(EmuContext_t *ctx) {
+	ctx -> CoreStopRequests[CORE_STOP_REQUEST_HOST] = 1;
+}
 
-		if( (IntMaskCycle -= CycleCount) < 0 )
-			IntMaskCycle = 0;
+// Makes `coreRun()` stop before the next instruction, with `CORE_STOP_INTERRUPT`
+// Call it when a peripheral raises an interrupt, then deliver it with `coreDoMI()`/`coreDoNMI()`.
+void coreSignalInterrupt(EmuContext_t *ctx) {
+	ctx -> CoreStopRequests[CORE_STOP_REQUEST_INTERRUPT] = 1;
+}
 
-		// Mask interrupts if DSR prefix instruction is used
-		if( isDSRSet && (IntMaskCycle == 0) )
-			++IntMaskCycle;
-		}
+// Releases what the core has allocated for `ctx`, call it along with `memoryFree()`
+// The context can be reset and run again afterwards.
+void coreFree(EmuContext_t *ctx) {
+#ifdef CORE_JIT
+	jitFree(ctx);
+#else
+	(void)ctx;
+#endif
+}
 
-exit:
-	return retVal;
+// Makes the core of `child` continue from where the one of `parent` has stopped, along with `memoryFork()`
+// Its caches are kept, they're still right as long as it runs the same ROM. What the host keeps in the
+// context (`UserData`, scheduled events, the interrupt controller) is left to the host.
+void coreFork(EmuContext_t *child, const EmuContext_t *parent) {
+	child -> CoreRegister = parent -> CoreRegister;
+	child -> IntMaskCycle = parent -> IntMaskCycle;
+	child -> NextAccess = parent -> NextAccess;
+	child -> EAIncDelay = parent -> EAIncDelay;
+	child -> CycleCount = parent -> CycleCount;
+	child -> CoproHandler = parent -> CoproHandler;
+#ifdef CORE_DUAL_VARIANT
+	child -> IsU16 = parent -> IsU16;
+#endif
+#ifdef CORE_LAZY_FLAGS
+	child -> LazyCarries = parent -> LazyCarries;
+	child -> LazyResult = parent -> LazyResult;
+	child -> IsLazyZS = parent -> IsLazyZS;
+#endif
 }
 
 
-void coreDoNMI(void) {
+void coreDoNMI(EmuContext_t *ctx) {
 	ELR2 = PC;
 	ECSR2 = CSR;
 	EPSW2 = PSW;
 	PSW.field.ELevel = 2;
 	CSR = 0;
-	PC = memoryGetCodeWord(0, 0x0008);
-	CycleCount = 3 + EAIncDelay + IntMaskCycle;
+	PC = memoryGetCodeWord(ctx, 0, 0x0008);
+	_coreSetCodeSegment(ctx);
+	ctx -> CycleCount = 3 + ctx -> EAIncDelay + ctx -> IntMaskCycle;
 }
 
-bool coreDoMI(uint8_t index) {
+bool coreDoMI(EmuContext_t *ctx, uint8_t index) {
 	if( (PSW.field.ELevel <= 1) && (PSW.field.MIE == 1) && (index < 59) ) {
 		ELR1 = PC;
 		ECSR1 = CSR;
@@ -2209,14 +3147,15 @@ bool coreDoMI(uint8_t index) {
 		PSW.field.ELevel = 1;
 		PSW.field.MIE = 0;
 		CSR = 0;
-		PC = memoryGetCodeWord(0, 0x000A + (index << 1));
-		CycleCount = 3 + EAIncDelay + IntMaskCycle;
+		PC = memoryGetCodeWord(ctx, 0, 0x000A + (index << 1));
+		_coreSetCodeSegment(ctx);
+		ctx -> CycleCount = 3 + ctx -> EAIncDelay + ctx -> IntMaskCycle;
 		return true;
 	}
 	return false;
 }
 
-void coreDoSWI(uint8_t index) {
+void coreDoSWI(EmuContext_t *ctx, uint8_t index) {
 	if( index < 64 ) {
 		ELR1 = PC;
 		ECSR1 = CSR;
@@ -2224,8 +3163,10 @@ void coreDoSWI(uint8_t index) {
 		PSW.field.ELevel = 1;
 		PSW.field.MIE = 0;
 		CSR = 0;
-		PC = memoryGetCodeWord(0, 0x0080 + (index << 1));
-		CycleCount = 3 + EAIncDelay + IntMaskCycle;
+		PC = memoryGetCodeWord(ctx, 0, 0x0080 + (index << 1));
+		_coreSetCodeSegment(ctx);
+		ctx -> CycleCount = 3 + ctx -> EAIncDelay + ctx -> IntMaskCycle;
 	}
 
 }
+#endif
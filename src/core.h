@@ -6,47 +6,138 @@
 
 #include "regtypes.h"
 #include "coretypes.h"
+#include "contexttypes.h"
 
 
 // Defining this makes it emulate nX-U16/100
 // differences: cycle count, SP word alignment, EPSW interacting behavior, etc.
 //#define CORE_IS_U16
 
+// Defining this builds both the nX-U8/100 and the nX-U16/100 core, and every context runs the one
+// picked by `ctx -> IsU16`, set it before `coreReset()`. `CORE_IS_U16` is ignored then.
+// `core_u16.c` builds `core.c` once more as the U16 core, so that neither core checks which one it is.
+//#define CORE_DUAL_VARIANT
+
+// Decoded instructions are cached so that they don't have to be decoded again.
+// Defining this makes the core keep decoded instructions of the whole ROM,
+// which costs `CODE_PAGE_COUNT * 256KiB` of RAM, so leave it off on small targets
+//#define CORE_PREDECODE
+// Otherwise, this many recently used instructions are cached (8 bytes + 4 bytes each)
+// Must be a power of 2
+#define CORE_DECODE_CACHE_LINES 256
+
+// Defining this makes `coreStepMany()` run straight-line code as cached basic blocks
+// Costs `CORE_BLOCK_CACHE_LINES * (8 + 8 * CORE_BLOCK_MAX_LENGTH)` bytes of RAM
+//#define CORE_BLOCK_CACHE
+// `CORE_BLOCK_CACHE_LINES` must be a power of 2, `CORE_BLOCK_MAX_LENGTH` can't go above 255
+#define CORE_BLOCK_CACHE_LINES 1024
+#define CORE_BLOCK_MAX_LENGTH 32
+
+// Defining this translates blocks that keep being run into x86-64 host code, see `jit_x64.c`
+// Only works on x86-64 POSIX hosts that allow executable memory, and turns on `CORE_BLOCK_CACHE`.
+//#define CORE_JIT
+// Times a block has to run before it gets translated
+#define CORE_JIT_THRESHOLD 16
+// Defining this makes the JIT write `/tmp/perf-<pid>.map`, so that `perf` can name translated code
+//#define CORE_JIT_PERF_MAP
+
+// Defining this makes the core work out C, Z, S, OV and HC only when something reads them,
+// instead of after every instruction that sets them
+// `PSW` is exact whenever the core returns, but memory handlers called by an instruction may see stale flags.
+//#define CORE_LAZY_FLAGS
+
+// Defining this makes 8-bit ADD/ADDC/SUB/SUBC/CMP/CMPC look their flags up in a constant table,
+// instead of working them out bit by bit
+// Costs 128KiB of read-only data, shared by all contexts, and whether it's faster depends on the host's caches, so measure it.
+//#define CORE_ALU_TABLES
+
+// Defining this makes `coreRun()` and `coreStepMany()` skip busy-wait loops, e.g. polling an SFR with `TB`/`L` and `Bcond`
+// Once a backward branch is taken twice with nothing changed in between (registers and hidden states alike, and no
+// data memory written), the loop can only be left by memory changing under it, so the iterations that still fit
+// the budgets are charged at once. SFR reads mustn't have side effects then, and peripherals should only update
+// SFRs between `coreRun()` calls, whose budget should end at their next event, as `schedRun()` does.
+// Loops that `CORE_JIT` translates whole aren't caught.
+//#define CORE_IDLE_SKIP
+// Registers (coprocessor ones too) and hidden states packed in `uint64_t`s, see `core.c`
+#define CORE_IDLE_KEY_SIZE 9
+
+// Defining this adds an interrupt controller with IE/IRQ SFRs, see `intc.c`
+// The core takes pending interrupts by itself, looking for them once per block, so there's no need to stop it
+// and call `coreDoMI()`/`coreDoNMI()`. Raise them with `intcRaise()`, from anywhere.
+//#define CORE_INTC
+
+// Defining this lets the host trace the data memory accesses of a context into a ring buffer, which
+// a thread of its own writes to a file or hands to a callback, see `trace.c`
+// Without it, nothing is traced and nothing is checked. Needs POSIX threads.
+//#define CORE_TRACE
+
+// Instructions are dispatched with computed gotos on GCC and Clang
+// Defining this forces the portable `switch` dispatcher
+//#define CORE_NO_COMPUTED_GOTO
+
+#ifdef CORE_DUAL_VARIANT
+	#undef CORE_IS_U16		// only defined inside `core_u16.c`
+#endif
+
+#ifdef CORE_JIT
+	#if !defined(__x86_64__) || defined(_WIN32)
+		#undef CORE_JIT		// fall back to the interpreter
+	#elif !defined(CORE_BLOCK_CACHE)
+		#define CORE_BLOCK_CACHE
+	#endif
+#endif
+
 // macros for compatibility
-#define DSR (CoreRegister.DSR)
-#define CSR (CoreRegister.CSR)
-#define LCSR (CoreRegister.LCSRs[0])
-#define ECSR1 (CoreRegister.LCSRs[1])
-#define ECSR2 (CoreRegister.LCSRs[2])
-#define ECSR3 (CoreRegister.LCSRs[3])
-#define PC (CoreRegister.PC)
-#define LR (CoreRegister.LRs[0])
-#define ELR1 (CoreRegister.LRs[1])
-#define ELR2 (CoreRegister.LRs[2])
-#define ELR3 (CoreRegister.LRs[3])
-#define EA (CoreRegister.EA)
-#define SP (CoreRegister.SP)
-#define PSW (CoreRegister.PSW)
-#define EPSW1 (CoreRegister.EPSWs[0])
-#define EPSW2 (CoreRegister.EPSWs[1])
-#define EPSW3 (CoreRegister.EPSWs[2])
-#define GR (CoreRegister.GR)
-
-
-// A struct containing core registers
-extern CoreRegister_t CoreRegister;
-
-// Records how many cycles the last instruction has taken
-extern int CycleCount;
-
-
-CORE_STATUS coreZero(void);
-CORE_STATUS coreReset(void);
-CORE_STATUS coreStep(void);
-
-void coreDoNMI(void);
-bool coreDoMI(uint8_t index);
-void coreDoSWI(uint8_t index);
+// They need the `EmuContext_t *ctx` in scope, like every function taking one.
+#define DSR (ctx -> CoreRegister.DSR)
+#define CSR (ctx -> CoreRegister.CSR)
+#define LCSR (ctx -> CoreRegister.LCSRs[0])
+#define ECSR1 (ctx -> CoreRegister.LCSRs[1])
+#define ECSR2 (ctx -> CoreRegister.LCSRs[2])
+#define ECSR3 (ctx -> CoreRegister.LCSRs[3])
+#define PC (ctx -> CoreRegister.PC)
+#define LR (ctx -> CoreRegister.LRs[0])
+#define ELR1 (ctx -> CoreRegister.LRs[1])
+#define ELR2 (ctx -> CoreRegister.LRs[2])
+#define ELR3 (ctx -> CoreRegister.LRs[3])
+#define EA (ctx -> CoreRegister.EA)
+#define SP (ctx -> CoreRegister.SP)
+#define PSW (ctx -> CoreRegister.PSW)
+#define EPSW1 (ctx -> CoreRegister.EPSWs[0])
+#define EPSW2 (ctx -> CoreRegister.EPSWs[1])
+#define EPSW3 (ctx -> CoreRegister.EPSWs[2])
+#define GR (ctx -> CoreRegister.GR)
+#define CR (ctx -> CoreRegister.CR)
+
+
+// Core registers and the cycles the last instruction has taken are in
+// `ctx -> CoreRegister` and `ctx -> CycleCount`, see `context.h`
+
+CORE_STATUS coreZero(EmuContext_t *ctx);
+CORE_STATUS coreReset(EmuContext_t *ctx);
+CORE_STATUS coreStep(EmuContext_t *ctx);
+CORE_STATUS coreStepMany(EmuContext_t *ctx, unsigned int count);
+CoreRunResult_t coreRun(EmuContext_t *ctx, int cycleBudget, unsigned int instructionBudget);
+void coreRequestStop(EmuContext_t *ctx);
+void coreSignalInterrupt(EmuContext_t *ctx);
+void coreFree(EmuContext_t *ctx);
+void coreFork(EmuContext_t *child, const EmuContext_t *parent);
+
+void coreDoNMI(EmuContext_t *ctx);
+bool coreDoMI(EmuContext_t *ctx, uint8_t index);
+void coreDoSWI(EmuContext_t *ctx, uint8_t index);
+
+#ifdef CORE_DUAL_VARIANT
+// the two cores behind the functions above, see `CORE_DUAL_VARIANT`
+CORE_STATUS coreResetU8(EmuContext_t *ctx);
+CORE_STATUS coreStepU8(EmuContext_t *ctx);
+CORE_STATUS coreStepManyU8(EmuContext_t *ctx, unsigned int count);
+CoreRunResult_t coreRunU8(EmuContext_t *ctx, int cycleBudget, unsigned int instructionBudget);
+CORE_STATUS coreResetU16(EmuContext_t *ctx);
+CORE_STATUS coreStepU16(EmuContext_t *ctx);
+CORE_STATUS coreStepManyU16(EmuContext_t *ctx, unsigned int count);
+CoreRunResult_t coreRunU16(EmuContext_t *ctx, int cycleBudget, unsigned int instructionBudget);
+#endif
 
 
 #endif
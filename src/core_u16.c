@@ -0,0 +1,9 @@
+// The nX-U16/100 core of a `CORE_DUAL_VARIANT` build, see `core.h`
+// It's `core.c` built once more with `CORE_IS_U16`, so leave it out of other builds (or keep it, it's empty then).
+
+#include "core.h"
+
+#ifdef CORE_DUAL_VARIANT
+	#define CORE_U16_COPY
+	#include "core.c"
+#endif
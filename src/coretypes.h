@@ -13,6 +13,24 @@ typedef enum {
 	CORE_MEMORY_UNINITIALIZED
 } CORE_STATUS;
 
+// Why `coreRun()` has returned
+typedef enum {
+	CORE_STOP_BUDGET,		// used up the cycles or instructions it was given
+	CORE_STOP_ILLEGAL_INSTRUCTION,
+	CORE_STOP_UNIMPLEMENTED,
+	CORE_STOP_BRK,			// right after BRK has run
+	CORE_STOP_INTERRUPT,		// `coreSignalInterrupt()` has been called
+	CORE_STOP_HOST,			// `coreRequestStop()` has been called
+	CORE_STOP_MEMORY_UNINITIALIZED,
+	CORE_STOP_WATCH			// a data access has hit a watch, see `ctx -> WatchHit`
+} CORE_STOP_REASON;
+
+typedef struct {
+	CORE_STOP_REASON reason;
+	int cycles;			// cycles taken by the instructions below
+	unsigned int instructions;	// instructions retired
+} CoreRunResult_t;
+
 typedef enum {
 	DATA_ACCESS_PAGE0,
 	DATA_ACCESS_DSR
@@ -29,6 +47,7 @@ typedef struct {
 	PSW_t PSW;
 	PSW_t EPSWs[3];	// EPSW1, EPSW2, EPSW3
 	GR_t GR;
+	GR_t CR;	// coprocessor registers, CR0~CR15
 } CoreRegister_t;
 
 #endif
@@ -0,0 +1,269 @@
+#ifndef DECODE_H_INCLUDED
+#define DECODE_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "regtypes.h"
+#include "core.h"
+#include "coretypes.h"
+#include "contexttypes.h"
+
+
+// Flat list of every instruction form the core knows about.
+// The decoder resolves all nested opcode checks into one of these,
+// so the core only needs a single switch to execute an instruction.
+typedef enum {
+	OP_UNDECODED = 0,	// cache slot not filled yet, never executed
+	OP_ILLEGAL,
+	OP_UNIMPLEMENTED,
+	OP_NONE,		// decodes to nothing, takes no cycle
+
+	// Rn, #imm8
+	OP_MOV_R_IMM,
+	OP_ADD_R_IMM,
+	OP_AND_R_IMM,
+	OP_OR_R_IMM,
+	OP_XOR_R_IMM,
+	OP_CMPC_R_IMM,
+	OP_ADDC_R_IMM,
+	OP_CMP_R_IMM,
+
+	// Rn, Rm
+	OP_MOV_R_R,
+	OP_ADD_R_R,
+	OP_AND_R_R,
+	OP_OR_R_R,
+	OP_XOR_R_R,
+	OP_CMPC_R_R,
+	OP_ADDC_R_R,
+	OP_CMP_R_R,
+	OP_SUB_R_R,
+	OP_SUBC_R_R,
+	OP_SLL_R_R,
+	OP_SLLC_R_R,
+	OP_SRL_R_R,
+	OP_SRLC_R_R,
+	OP_SRA_R_R,
+	OP_EXTBW,
+	OP_DAA,
+	OP_DAS,
+	OP_NEG,
+
+	// loads & stores
+	OP_L_R_ERM,
+	OP_L_R_ADR,
+	OP_L_R_EA,
+	OP_L_R_EAP,
+	OP_ST_R_ERM,
+	OP_ST_R_ADR,
+	OP_ST_R_EA,
+	OP_ST_R_EAP,
+	OP_L_ER_ERM,
+	OP_L_ER_ADR,
+	OP_L_ER_EA,
+	OP_L_ER_EAP,
+	OP_ST_ER_ERM,
+	OP_ST_ER_ADR,
+	OP_ST_ER_EA,
+	OP_ST_ER_EAP,
+	OP_L_XR_EA,
+	OP_L_XR_EAP,
+	OP_ST_XR_EA,
+	OP_ST_XR_EAP,
+	OP_L_QR_EA,
+	OP_L_QR_EAP,
+	OP_ST_QR_EA,
+	OP_ST_QR_EAP,
+	OP_L_R_D16,
+	OP_ST_R_D16,
+	OP_L_ER_D16,
+	OP_ST_ER_D16,
+	OP_L_ER_BP,
+	OP_L_ER_FP,
+	OP_ST_ER_BP,
+	OP_ST_ER_FP,
+	OP_L_R_BP,
+	OP_L_R_FP,
+	OP_ST_R_BP,
+	OP_ST_R_FP,
+
+	// Rn, #width
+	OP_SLL_R_IMM,
+	OP_SLLC_R_IMM,
+	OP_SRL_R_IMM,
+	OP_SRLC_R_IMM,
+	OP_SRA_R_IMM,
+
+	// DSR prefixes
+	OP_LDSR_R,
+	OP_LDSR_IMM,
+	OP_UDSR,
+
+	// bit operations
+	OP_SB_ADR,
+	OP_SB_R,
+	OP_TB_ADR,
+	OP_TB_R,
+	OP_RB_ADR,
+	OP_RB_R,
+
+	// control register transfers
+	OP_MOV_R_PSW,
+	OP_MOV_R_EPSW,
+	OP_MOV_ER_ELR,
+	OP_MOV_R_ECSR,
+	OP_MOV_ER_SP,
+	OP_MOV_SP_ER,
+	OP_MOV_PSW_R,
+	OP_MOV_EPSW_R,
+	OP_MOV_ELR_ER,
+	OP_MOV_ECSR_R,
+	OP_MOV_PSW_IMM,
+
+	// coprocessor transfers, the ones through EA are 1 << ((src >> 1) & 3) bytes wide
+	OP_MOV_R_CR,
+	OP_MOV_CR_R,
+	OP_L_CR_EA,
+	OP_L_CR_EAP,
+	OP_ST_CR_EA,
+	OP_ST_CR_EAP,
+
+	// conditional branches, in the order of their condition codes
+	OP_BGE,
+	OP_BLT,
+	OP_BGT,
+	OP_BLE,
+	OP_BGES,
+	OP_BLTS,
+	OP_BGTS,
+	OP_BLES,
+	OP_BNE,
+	OP_BEQ,
+	OP_BNV,
+	OP_BOV,
+	OP_BPS,
+	OP_BNS,
+	OP_BAL,
+
+	// 16-bit operations
+	OP_MOV_ER_IMM,
+	OP_ADD_ER_IMM,
+	OP_ADD_SP_IMM,
+	OP_MOV_ER_ER,
+	OP_ADD_ER_ER,
+	OP_CMP_ER_ER,
+	OP_MUL,
+	OP_DIV,
+
+	// EA
+	OP_LEA_ER,
+	OP_LEA_D16,
+	OP_LEA_ADR,
+	OP_INC_EA,
+	OP_DEC_EA,
+
+	// PSW bits
+	OP_RC,
+	OP_SC,
+	OP_CPLC,
+	OP_DI,
+	OP_EI,
+
+	// branches
+	OP_B_CADR,
+	OP_BL_CADR,
+	OP_B_ER,
+	OP_BL_ER,
+	OP_RT,
+	OP_RTI,
+	OP_SWI,
+	OP_BRK,
+	OP_NOP,
+
+	// stack
+	OP_POP_R,
+	OP_POP_ER,
+	OP_POP_XR,
+	OP_POP_QR,
+	OP_PUSH_R,
+	OP_PUSH_ER,
+	OP_PUSH_XR,
+	OP_PUSH_QR,
+	OP_POP_LEPA,
+	OP_PUSH_LEPA,
+
+	OP_COUNT
+} CORE_OP;
+
+// A decoded instruction
+// `dest` and `src` hold the raw `n` and `m` fields (xxxx_nnnn_mmmm_xxxx).
+// `imm` holds the trailing word for 2-word instructions, otherwise the
+// (already sign-extended, if needed) immediate carried in the code word.
+// `cycles` is the part of the cycle count that doesn't depend on core state.
+typedef struct {
+	uint8_t op;
+	uint8_t dest;
+	uint8_t src;
+	uint8_t cycles;
+	uint16_t imm;
+	uint8_t words;
+	bool isFused;	// for DSR prefixes in a block, if the next instruction is a data access, see `coreFetchBlock()`
+} CoreInstruction_t;
+
+#ifdef CORE_JIT
+// Translated host code of a block, see `jit_x64.c`
+// Returns the cycles it took.
+typedef int (*CoreNativeBlock_t)(EmuContext_t *ctx);
+#endif
+
+#ifdef CORE_BLOCK_CACHE
+// A straight-line run of instructions
+// Only the last one may branch, so the ones before it are always run in order.
+// `cycles` adds up their `cycles`; state dependent cycles come on top of it.
+typedef struct {
+	uint32_t tag;	// CSR:PC of the first instruction
+	uint16_t cycles;
+	uint8_t length;	// 0 for an empty cache line
+	uint8_t reserved;
+#ifdef CORE_JIT
+	// Host code for the first `nativeLength` instructions, if any
+	CoreNativeBlock_t native;
+	unsigned int nativeGeneration;
+	int nativeCycles;	// the most cycles the host code may take
+	uint8_t nativeLength;
+	uint8_t hits;		// times run, up to `CORE_JIT_THRESHOLD`
+#endif
+	CoreInstruction_t ops[CORE_BLOCK_MAX_LENGTH];
+} CoreBlock_t;
+#endif
+
+
+// Stop requests `coreRun()` checks between instructions, see `coreRequestStop()`
+// They're kept in `ctx -> CoreStopRequests`, and may be set by memory handlers or by another thread.
+#define CORE_STOP_REQUEST_HOST 0
+#define CORE_STOP_REQUEST_INTERRUPT 1
+#define CORE_STOP_REQUEST_WATCH 2
+
+// These are implemented in `core.c`
+#ifdef CORE_DUAL_VARIANT
+// Decoded cycle counts differ, so each core has its own decoder
+void coreDecodeU8(CoreInstruction_t *insn, uint16_t codeWord);
+void coreDecodeU16(CoreInstruction_t *insn, uint16_t codeWord);
+const CoreInstruction_t* coreFetchDecodedU8(EmuContext_t *ctx, SR_t segment, PC_t offset);
+const CoreInstruction_t* coreFetchDecodedU16(EmuContext_t *ctx, SR_t segment, PC_t offset);
+#else
+void coreDecode(CoreInstruction_t *insn, uint16_t codeWord);
+#endif
+const CoreInstruction_t* coreFetchDecoded(EmuContext_t *ctx, SR_t segment, PC_t offset);
+void coreFlushDecodeCache(EmuContext_t *ctx);
+#ifdef CORE_BLOCK_CACHE
+const CoreBlock_t* coreFetchBlock(EmuContext_t *ctx, SR_t segment, PC_t offset);
+#ifdef CORE_DUAL_VARIANT
+const CoreBlock_t* coreFetchBlockU8(EmuContext_t *ctx, SR_t segment, PC_t offset);
+const CoreBlock_t* coreFetchBlockU16(EmuContext_t *ctx, SR_t segment, PC_t offset);
+#endif
+#endif
+
+#endif
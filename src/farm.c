@@ -0,0 +1,221 @@
+// for `sysconf()` and `posix_memalign()` under -std=c99
+#define _DEFAULT_SOURCE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "mmu.h"
+#include "core.h"
+#include "coretypes.h"
+#include "farm.h"
+#include "intc.h"
+#include "context.h"
+
+
+// Work stealing
+//
+// Jobs are dealt out to the workers in contiguous ranges, so that jobs next to each other
+// (usually running the same ROM) stay on the same worker. A worker takes its own jobs from
+// the back of its range, and once it's empty, steals from the front of the others' ranges.
+// A job runs far longer than it takes to take one, so a plain mutex per range is enough.
+//
+// Every worker owns one context, which runs its jobs one after another. Code memory comes
+// from `job -> rom`, and the context stays set up for it, so a job on the same ROM as the one
+// before it only clears the context's state (see `CONTEXT_STATE_SIZE`) and loads its data memory.
+
+typedef struct Farm Farm_t;
+
+typedef struct {
+	Farm_t *farm;
+	EmuContext_t *ctx;
+	pthread_mutex_t lock;
+	unsigned int begin, end;	// jobs left, `[begin, end)`
+	pthread_t thread;
+	bool isStarted;
+} FarmWorker_t;
+
+struct Farm {
+	FarmJob_t *jobs;
+	FarmWorker_t *workers;
+	unsigned int workerCount;
+};
+
+
+// Takes a job from the back of the worker's own range, or from the front of another one
+// Returns NULL once there's nothing left anywhere.
+static FarmJob_t* _farmTakeJob(FarmWorker_t *worker) {
+	Farm_t *farm = worker -> farm;
+	FarmWorker_t *victim;
+	FarmJob_t *job = NULL;
+	unsigned int i;
+
+	pthread_mutex_lock(&worker -> lock);
+	if( worker -> begin < worker -> end )
+		job = &farm -> jobs[--worker -> end];
+	pthread_mutex_unlock(&worker -> lock);
+	if( job != NULL )
+		return job;
+
+	for( i = 1; i < farm -> workerCount; ++i ) {
+		victim = &farm -> workers[(worker - farm -> workers + i) % farm -> workerCount];
+		pthread_mutex_lock(&victim -> lock);
+		if( victim -> begin < victim -> end )
+			job = &farm -> jobs[victim -> begin++];
+		pthread_mutex_unlock(&victim -> lock);
+		if( job != NULL )
+			return job;
+	}
+	return NULL;
+}
+
+// Runs a job from reset until it stops
+static void _farmRunJob(EmuContext_t *ctx, FarmJob_t *job) {
+	CoreRunResult_t result;
+	unsigned int input = 0;
+	uint64_t budget;
+
+	job -> reason = CORE_STOP_BUDGET;
+	job -> cycles = 0;
+	job -> instructions = 0;
+
+	// watches set by an earlier job's `poll` don't carry over, that takes new page tables
+	if( ctx -> IsMemoryInited && (ctx -> CodeMemory == job -> rom -> CodeMemory) && (ctx -> WatchCount == 0) ) {
+		memset(ctx, 0, CONTEXT_STATE_SIZE);
+		job -> memoryStatus = memoryLoadData(ctx, job -> dataFileID);
+	}
+	else {
+		if( ctx -> IsMemoryInited )
+			memoryFree(ctx);
+		ctx -> WatchCount = 0;
+		job -> memoryStatus = memoryInitShared(ctx, job -> rom, job -> dataFileID);
+	}
+	if( job -> memoryStatus != MEMORY_OK )
+		return;
+
+	ctx -> UserData = job -> userData;
+	ctx -> CoproHandler = job -> rom -> CoproHandler;
+#ifdef CORE_DUAL_VARIANT
+	ctx -> IsU16 = job -> rom -> IsU16;
+#endif
+	ctx -> CoreStopRequests[CORE_STOP_REQUEST_HOST] = 0;
+	ctx -> CoreStopRequests[CORE_STOP_REQUEST_INTERRUPT] = 0;
+	ctx -> CoreStopRequests[CORE_STOP_REQUEST_WATCH] = 0;
+#ifdef CORE_INTC
+	intcReset(ctx);
+#endif
+	coreZero(ctx);
+	coreReset(ctx);
+
+	while( job -> cycles < job -> cycleLimit ) {
+		while( (input < job -> inputCount) && (job -> inputs[input].cycle <= job -> cycles) ) {
+			memorySetData(ctx, job -> inputs[input].segment, job -> inputs[input].offset, 1, job -> inputs[input].data);
+			++input;
+		}
+
+		// run up to the next input at most
+		budget = job -> cycleLimit - job -> cycles;
+		if( budget > FARM_SLICE_CYCLES )
+			budget = FARM_SLICE_CYCLES;
+		if( (input < job -> inputCount) && (job -> inputs[input].cycle - job -> cycles < budget) )
+			budget = job -> inputs[input].cycle - job -> cycles;
+
+		result = coreRun(ctx, (int)budget, UINT_MAX);
+		job -> cycles += result.cycles;
+		job -> instructions += result.instructions;
+		job -> reason = result.reason;
+
+		if( (result.reason != CORE_STOP_BUDGET) && (result.reason != CORE_STOP_INTERRUPT) )
+			break;
+		if( (job -> poll != NULL) && job -> poll(job, ctx) ) {
+			job -> reason = CORE_STOP_HOST;
+			break;
+		}
+		job -> reason = CORE_STOP_BUDGET;
+	}
+
+	if( job -> done != NULL )
+		job -> done(job, ctx);
+}
+
+static void* _farmWorker(void *arg) {
+	FarmWorker_t *worker = arg;
+	FarmJob_t *job;
+
+	while( (job = _farmTakeJob(worker)) != NULL ) {
+		_farmRunJob(worker -> ctx, job);
+	}
+	return NULL;
+}
+
+
+// Runs `count` jobs on `threadCount` threads, one of which is the calling thread
+// Pass 0 as `threadCount` to use all the host's cores. Returns when all the jobs are done.
+// If a thread can't be started, the others run its jobs.
+FARM_STATUS farmRun(FarmJob_t *jobs, unsigned int count, unsigned int threadCount) {
+	Farm_t farm;
+	FarmWorker_t *worker;
+	FARM_STATUS retVal = FARM_OK;
+	unsigned int i, ready;
+	void *p;
+
+	if( count == 0 )
+		return FARM_OK;
+
+	if( threadCount == 0 ) {
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		threadCount = (cores > 0)? (unsigned int)cores : 1;
+	}
+	if( threadCount > count )
+		threadCount = count;
+
+	farm.jobs = jobs;
+	farm.workerCount = threadCount;
+	if( (farm.workers = calloc(threadCount, sizeof(FarmWorker_t))) == NULL )
+		return FARM_ALLOCATION_FAILED;
+
+	for( ready = 0; ready < threadCount; ++ready ) {
+		worker = &farm.workers[ready];
+		worker -> farm = &farm;
+		worker -> begin = (unsigned int)((uint64_t)count * ready / threadCount);
+		worker -> end = (unsigned int)((uint64_t)count * (ready + 1) / threadCount);
+		// contexts must start zeroed and aligned, and are too big for the threads' stacks
+		if( posix_memalign(&p, 64, sizeof(EmuContext_t)) != 0 )
+			break;
+		worker -> ctx = memset(p, 0, sizeof(EmuContext_t));
+		if( pthread_mutex_init(&worker -> lock, NULL) != 0 ) {
+			free(worker -> ctx);
+			break;
+		}
+	}
+	if( ready < threadCount ) {
+		retVal = FARM_ALLOCATION_FAILED;
+		goto exit;
+	}
+
+	for( i = 1; i < threadCount; ++i ) {
+		worker = &farm.workers[i];
+		worker -> isStarted = (pthread_create(&worker -> thread, NULL, _farmWorker, worker) == 0);
+	}
+	_farmWorker(&farm.workers[0]);
+	for( i = 1; i < threadCount; ++i ) {
+		if( farm.workers[i].isStarted )
+			pthread_join(farm.workers[i].thread, NULL);
+	}
+
+exit:
+	for( i = 0; i < ready; ++i ) {
+		if( farm.workers[i].ctx -> IsMemoryInited )
+			memoryFree(farm.workers[i].ctx);
+		coreFree(farm.workers[i].ctx);
+		free(farm.workers[i].ctx);
+		pthread_mutex_destroy(&farm.workers[i].lock);
+	}
+	free(farm.workers);
+	return retVal;
+}
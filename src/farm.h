@@ -0,0 +1,61 @@
+#ifndef FARM_H_INCLUDED
+#define FARM_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "regtypes.h"
+#include "coretypes.h"
+#include "memtypes.h"
+#include "contexttypes.h"
+#include "mmustub.h"
+
+
+// Most cycles a job runs before its `poll` is called
+#define FARM_SLICE_CYCLES (1 << 20)
+
+typedef enum {
+	FARM_OK,
+	FARM_ALLOCATION_FAILED
+} FARM_STATUS;
+
+// A byte written to data memory once the job has run for `cycle` cycles
+// It goes through the memory handlers, so it's how key presses reach `SFRHandler`.
+typedef struct {
+	uint64_t cycle;
+	SR_t segment;
+	EA_t offset;
+	uint8_t data;
+} FarmInput_t;
+
+typedef struct FarmJob FarmJob_t;
+
+// One run of a ROM, see `farmRun()`
+struct FarmJob {
+	// set by the host
+	const EmuContext_t *rom;	// initialized context whose code memory (with its core and coprocessor) is run, it's shared by all the jobs using it
+	stub_MMUFileID_t dataFileID;	// initial data memory
+	const FarmInput_t *inputs;	// input script, sorted by `cycle`
+	unsigned int inputCount;
+	uint64_t cycleLimit;		// the job stops after this many cycles
+	void *userData;			// becomes `ctx -> UserData` while the job runs
+
+	// Called between slices of at most `FARM_SLICE_CYCLES` cycles, and whenever an interrupt is signaled, may be NULL
+	// Deliver interrupts here. Return true to stop the job.
+	bool (*poll)(FarmJob_t *job, EmuContext_t *ctx);
+	// Called when the job has stopped, before the next job reuses its context, may be NULL
+	void (*done)(FarmJob_t *job, EmuContext_t *ctx);
+
+	// set by the runner
+	MEMORY_STATUS memoryStatus;	// the job has only run if its memory was set up with `MEMORY_OK`
+	CORE_STOP_REASON reason;	// `CORE_STOP_BUDGET` for the cycle limit, `CORE_STOP_HOST` for `poll` and `coreRequestStop()`
+	uint64_t cycles;
+	uint64_t instructions;
+};
+
+
+FARM_STATUS farmRun(FarmJob_t *jobs, unsigned int count, unsigned int threadCount);
+
+
+#endif
@@ -0,0 +1,188 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "memmap.h"
+#include "core.h"
+#include "intc.h"
+#include "context.h"
+
+
+#ifdef CORE_INTC
+// Interrupt controller
+//
+// Pending interrupts are a bitmap (`IntcPending`, the IRQ registers) and so are enabled ones
+// (`IntcEnable`, the IE registers). Whenever one is both, `IntcRequest` is set, and the core
+// looks at it once per block (once per instruction without `CORE_BLOCK_CACHE`), so it costs
+// a single branch when nothing is going on. The lowest pending source is taken first.
+//
+// Other threads can't touch the bitmaps, so `intcRaise()` sets a flag per source and
+// `IntcRaisedAny` instead, which the core looks at along with `IntcRequest`, and which the
+// emulation thread folds into `IntcPending`. The source flag is released before `IntcRaisedAny`,
+// and the emulation thread takes `IntcRaisedAny` with acquire before it scans the sources,
+// so a raise it sees has its source flag visible, and one it misses leaves `IntcRaisedAny` set.
+
+// Flags shared with other threads, ordered as above
+#if defined(__GNUC__) || defined(__clang__)
+	#define FLAG_SET(flag) __atomic_store_n(&(flag), 1, __ATOMIC_RELEASE)
+	#define FLAG_TAKE(flag) __atomic_exchange_n(&(flag), 0, __ATOMIC_ACQUIRE)
+	#define FLAG_GET(flag) __atomic_load_n(&(flag), __ATOMIC_ACQUIRE)
+#else
+	// raise interrupts from the thread running the context then
+	#define FLAG_SET(flag) ((flag) = 1)
+	#define FLAG_TAKE(flag) _intcTake(&(flag))
+	#define FLAG_GET(flag) (flag)
+
+static inline uint8_t _intcTake(volatile uint8_t *flag) {
+	uint8_t value = *flag;
+
+	*flag = 0;
+	return value;
+}
+#endif
+
+// Source number of the lowest bit set in `bits`, which mustn't be 0
+static inline unsigned int _intcLowest(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned int)__builtin_ctzll(bits);
+#else
+	// de Bruijn sequence, for compilers without the builtin
+	static const uint8_t INDEX[64] = {
+		0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+		62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+		63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+		46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6
+	};
+	return INDEX[((bits & -bits) * 0x03f79d71b4cb0a89ULL) >> 58];
+#endif
+}
+
+// Moves the sources raised by `intcRaise()` into `IntcPending`
+static void _intcFold(EmuContext_t *ctx) {
+	unsigned int i;
+
+	if( !FLAG_TAKE(ctx -> IntcRaisedAny) )
+		return;
+	for( i = 0; i < INTC_SOURCES; ++i ) {
+		if( FLAG_TAKE(ctx -> IntcRaised[i]) )
+			ctx -> IntcPending |= (uint64_t)1 << i;
+	}
+}
+
+// Sets `IntcRequest` if anything is pending and enabled
+static void _intcUpdate(EmuContext_t *ctx) {
+	ctx -> IntcRequest = (ctx -> IntcPending & (ctx -> IntcEnable | 1)) != 0;
+}
+
+
+// Clears all the pending and enabled sources
+// A zeroed context starts like this.
+void intcReset(EmuContext_t *ctx) {
+	unsigned int i;
+
+	ctx -> IntcRequest = 0;
+	ctx -> IntcRaisedAny = 0;
+	for( i = 0; i < INTC_SOURCES; ++i ) {
+		ctx -> IntcRaised[i] = 0;
+	}
+	ctx -> IntcPending = 0;
+	ctx -> IntcEnable = 0;
+}
+
+// Makes `source` pending, as a peripheral does when it sets its IRQ bit
+// The core takes it without stopping, once it's enabled and the PSW lets it in.
+// Safe to call from memory handlers, scheduler events, signal handlers, or from another thread.
+void intcRaise(EmuContext_t *ctx, unsigned int source) {
+	if( source >= INTC_SOURCES )
+		return;
+
+	FLAG_SET(ctx -> IntcRaised[source]);
+	FLAG_SET(ctx -> IntcRaisedAny);
+}
+
+// Drops `source` if it's pending
+// Only call it from the thread running the context, e.g. from a memory handler.
+void intcClear(EmuContext_t *ctx, unsigned int source) {
+	if( source >= INTC_SOURCES )
+		return;
+
+	if( INTC_IS_RAISED(ctx) )
+		_intcFold(ctx);
+	ctx -> IntcPending &= ~((uint64_t)1 << source);
+	_intcUpdate(ctx);
+}
+
+// Whether `source` is pending, only call it from the thread running the context
+bool intcIsPending(EmuContext_t *ctx, unsigned int source) {
+	if( source >= INTC_SOURCES )
+		return false;
+
+	return ((ctx -> IntcPending >> source) & 1) || FLAG_GET(ctx -> IntcRaised[source]);
+}
+
+// Takes the lowest source that is pending and enabled, if the core can take interrupts right now
+// Returns the cycles it took, 0 if nothing has been taken. `PSW` must be up to date.
+// Called by the core whenever `IntcRequest` or `IntcRaisedAny` is set, see `core.c`.
+int intcDeliver(EmuContext_t *ctx) {
+	uint64_t ready;
+	unsigned int source;
+
+	if( INTC_IS_RAISED(ctx) )
+		_intcFold(ctx);
+	_intcUpdate(ctx);
+	if( !ctx -> IntcRequest )
+		return 0;
+
+	ready = ctx -> IntcPending & (ctx -> IntcEnable | 1);
+	if( (ctx -> IntMaskCycle != 0) || (PSW.field.ELevel > 1) )
+		return 0;
+
+	if( ready & 1 ) {
+		source = INTC_NMI;
+		coreDoNMI(ctx);
+	}
+	else if( PSW.field.MIE ) {
+		source = _intcLowest(ready);
+		coreDoMI(ctx, (uint8_t)(source - 1));
+	}
+	else {
+		return 0;
+	}
+
+	// the IRQ bit is cleared once the interrupt is taken
+	ctx -> IntcPending &= ~((uint64_t)1 << source);
+	_intcUpdate(ctx);
+	return ctx -> CycleCount;
+}
+
+// IE0~IE7 and IRQ0~IRQ7, see `INTC_IE_ADDRESS`
+// The ROM writes 0 to IRQ bits to drop sources, and may write 1 to raise them.
+uint8_t intcHandler(EmuContext_t *ctx, uint32_t address, uint8_t data, bool isWrite) {
+	uint64_t *bits;
+	unsigned int shift;
+
+	if( (address >= INTC_IE_ADDRESS) && (address < INTC_IE_ADDRESS + INTC_REGISTER_COUNT) ) {
+		bits = &ctx -> IntcEnable;
+		shift = (address - INTC_IE_ADDRESS) * 8;
+	}
+	else if( (address >= INTC_IRQ_ADDRESS) && (address < INTC_IRQ_ADDRESS + INTC_REGISTER_COUNT) ) {
+		bits = &ctx -> IntcPending;
+		shift = (address - INTC_IRQ_ADDRESS) * 8;
+		if( INTC_IS_RAISED(ctx) )
+			_intcFold(ctx);
+	}
+	else {
+		return SFRHandler(ctx, address, data, isWrite);
+	}
+
+	if( isWrite ) {
+		*bits = (*bits & ~((uint64_t)0xff << shift)) | ((uint64_t)data << shift);
+		// no such sources, and the NMI can't be disabled
+		*bits &= ((uint64_t)1 << INTC_SOURCES) - 1;
+		ctx -> IntcEnable &= ~(uint64_t)1;
+		_intcUpdate(ctx);
+		return 0;
+	}
+	return (uint8_t)(*bits >> shift);
+}
+
+#endif
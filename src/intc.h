@@ -0,0 +1,44 @@
+#ifndef INTC_H_INCLUDED
+#define INTC_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+#include "contexttypes.h"
+
+
+// Interrupt sources, numbered like the bits of the IE/IRQ registers
+// Source 0 is the NMI (vector 0x0008), source `n` is maskable interrupt `n - 1` (vector `0x0008 + 2 * n`).
+#define INTC_SOURCES 60
+#define INTC_NMI 0
+#define INTC_MI(index) ((index) + 1)
+
+// Where the IE0~IE7 and IRQ0~IRQ7 SFRs are, bit `n % 8` of the `n / 8`th register is source `n`
+// Adjust them to your device, the ES+ model in `MEMORY_MODELS` (in `memmap.c`) maps them to `intcHandler()`.
+// IE0 bit 0 reads 0, as the NMI can't be disabled.
+#define INTC_IE_ADDRESS 0x0f010
+#define INTC_IRQ_ADDRESS 0x0f018
+#define INTC_REGISTER_COUNT 8
+
+// Whether `intcRaise()` has raised something the emulation thread hasn't taken yet, polled by the core
+// `intcDeliver()` reads the sources with acquire once it's seen, see `intc.c`.
+#if defined(__GNUC__) || defined(__clang__)
+	#define INTC_IS_RAISED(ctx) __atomic_load_n(&(ctx) -> IntcRaisedAny, __ATOMIC_RELAXED)
+#else
+	#define INTC_IS_RAISED(ctx) ((ctx) -> IntcRaisedAny)
+#endif
+
+
+#ifdef CORE_INTC
+void intcReset(EmuContext_t *ctx);
+void intcRaise(EmuContext_t *ctx, unsigned int source);
+void intcClear(EmuContext_t *ctx, unsigned int source);
+bool intcIsPending(EmuContext_t *ctx, unsigned int source);
+int intcDeliver(EmuContext_t *ctx);
+uint8_t intcHandler(EmuContext_t *ctx, uint32_t address, uint8_t data, bool isWrite);
+#endif
+
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef JIT_H_INCLUDED
+#define JIT_H_INCLUDED
+
+
+#include "core.h"
+#include "decode.h"
+
+
+#ifdef CORE_JIT
+// State of the JIT lives in each context (see `context.h`), so every context has its own translated code.
+//
+// `ctx -> JitCycles`: cycles taken by ROM window accesses of translated code
+// Translated code only returns the cycles known at translation time,
+// the core clears this before running a block and adds it afterwards.
+//
+// `ctx -> JitLength`: instructions run by translated code
+// The core sets it to `nativeLength` before running a block, and translated
+// code only changes it when it leaves early for a stop request.
+//
+// `ctx -> JitGeneration`: bumped every time translated code is thrown away
+// A block whose `nativeGeneration` doesn't match has to be translated again.
+
+
+void jitTranslate(EmuContext_t *ctx, CoreBlock_t *block);
+void jitFlush(EmuContext_t *ctx);
+void jitFree(EmuContext_t *ctx);
+#endif
+
+#endif
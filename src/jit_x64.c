@@ -0,0 +1,1042 @@
+// for `MAP_ANONYMOUS` under -std=c99
+#define _DEFAULT_SOURCE
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mmu.h"
+#include "memmap.h"
+#include "core.h"
+#include "coretypes.h"
+#include "decode.h"
+#include "jit.h"
+#include "context.h"
+
+
+#ifdef CORE_JIT
+
+// x86-64 translation of cached blocks
+//
+// Only the leading instructions of a block which are simple enough get translated:
+// register ALU ops, moves, LEA, byte & word loads/stores through EA, ERm and BP/FP,
+// and a closing B<cond>. The core interprets the rest of the block as usual.
+// Translated code is only entered with `NextAccess == DATA_ACCESS_PAGE0` and
+// `EAIncDelay == 0`, so every data access goes to page 0 and the cycles are known
+// when translating, except for ROM window accesses which end up in `ctx -> JitCycles`.
+// Nor is it entered while the context has watches or is traced, since RAM accesses skip the page tables.
+// Memory handlers may request a stop, so translated code checks `ctx -> CoreStopRequests`
+// after each load/store, and leaves with `ctx -> JitLength` set if there's any.
+//
+// Every context translates into its own code buffer, and translated code is called with
+// the context it runs on, so it only ever touches that context.
+//
+// Host registers while running a block:
+//	rbx	ctx
+//	r12d	PSW
+//	r13d	EA
+//	r14	FlagTable
+//	r15	where the page of data memory with the RAM is, minus its address, so that [r15 + address] is a RAM byte
+// PSW, EA and PC are written back to `ctx -> CoreRegister` when the block ends and
+// before calling back into the MMU, as handlers may look at them.
+
+// Size of the code buffer
+#define JIT_CODE_SIZE (1 << 20)
+// Enough for the biggest block there can be
+#define JIT_BLOCK_SIZE_MAX (CORE_BLOCK_MAX_LENGTH * 400 + 256)
+
+// offsets into `*ctx`, `offsetof()` can't be used with the register macros around
+// They need `ctx` in scope, like the register macros.
+#define OFFSET_OF(member) ((uint32_t)((uint8_t *)&(member) - (uint8_t *)ctx))
+#define OFFSET_GR(n) (OFFSET_OF(GR) + (n))
+#define OFFSET_PSW OFFSET_OF(PSW)
+#define OFFSET_EA OFFSET_OF(EA)
+#define OFFSET_PC OFFSET_OF(PC)
+
+// Kinds of `_jitRead()`, they count ROM window cycles differently
+#define JIT_READ_BYTE 1
+#define JIT_READ_WORD 2
+#define JIT_READ_WORD_DISP 3
+
+// emits constant bytes into the code buffer of `ctx`
+#define EMIT(...) do { \
+		static const uint8_t bytes_[] = { __VA_ARGS__ }; \
+		_emitBytes(ctx, bytes_, sizeof(bytes_)); \
+	} while( 0 )
+
+
+// Maps the flags `lahf` puts in AH to PSW: CF -> C, ZF -> Z, SF -> S, AF -> HC
+// It's constant so that all the contexts can share it without filling it.
+#define FLAG_ENTRY(i) ((((i) & 0x01)? PSW_C : 0) | (((i) & 0x40)? PSW_Z : 0) | \
+		(((i) & 0x80)? PSW_S : 0) | (((i) & 0x10)? PSW_HC : 0))
+#define FLAG_ENTRY4(i) FLAG_ENTRY(i), FLAG_ENTRY((i) + 1), FLAG_ENTRY((i) + 2), FLAG_ENTRY((i) + 3)
+#define FLAG_ENTRY16(i) FLAG_ENTRY4(i), FLAG_ENTRY4((i) + 4), FLAG_ENTRY4((i) + 8), FLAG_ENTRY4((i) + 12)
+#define FLAG_ENTRY64(i) FLAG_ENTRY16(i), FLAG_ENTRY16((i) + 16), FLAG_ENTRY16((i) + 32), FLAG_ENTRY16((i) + 48)
+static const uint8_t FlagTable[256] = {
+	FLAG_ENTRY64(0), FLAG_ENTRY64(64), FLAG_ENTRY64(128), FLAG_ENTRY64(192)
+};
+
+
+// Slow paths called by translated code
+static uint32_t _jitRead(EmuContext_t *ctx, uint32_t offset, uint32_t kind) {
+	uint32_t retVal = memoryGetData(ctx, (SR_t)0, offset, (kind == JIT_READ_BYTE)? 1 : 2);
+
+#if defined(CORE_DUAL_VARIANT)
+	if( ctx -> IsU16 && (kind == JIT_READ_WORD) ) {
+#elif defined(CORE_IS_U16)
+	if( kind == JIT_READ_WORD ) {
+#else
+	if( false ) {
+#endif
+		ctx -> JitCycles += (ctx -> ROMWinAccessCount + 1) / 2;
+		return retVal;
+	}
+	ctx -> JitCycles += ctx -> ROMWinAccessCount;
+	return retVal;
+}
+
+static void _jitWrite(EmuContext_t *ctx, uint32_t offset, uint32_t size, uint32_t data) {
+	memorySetData(ctx, (SR_t)0, offset, size, data);
+}
+
+// Finds the plain RAM `[*start, *end)` on page 0, accessed without calling the MMU
+// It's the first RAM region on page 0 that no earlier region overlaps, or an empty range if there's none.
+// Only what's in the same page of data memory as its start counts, as the pages may be anywhere (see `memoryFork()`).
+static void _jitFindRAM(const EmuContext_t *ctx, uint32_t *start, uint32_t *end) {
+	const DataMemoryRegion_t *p, *q, *regions = ctx -> Model.regions;
+
+	*start = *end = 0;
+	for( p = regions; p < regions + ctx -> Model.regionCount; ++p ) {
+		if( (p -> handler != RAMHandler) || (p -> end > 0x10000) || (p -> start < ROM_WINDOW_SIZE) )
+			continue;
+		for( q = regions; q < p; ++q ) {
+			if( (q -> start < p -> end) && (p -> start < q -> end) )
+				break;
+		}
+		if( q == p ) {
+			*start = p -> start;
+			*end = ROM_WINDOW_SIZE + ((p -> start - ROM_WINDOW_SIZE) / DATA_PAGE_SIZE + 1) * DATA_PAGE_SIZE;
+			if( p -> end < *end )
+				*end = p -> end;
+			return;
+		}
+	}
+}
+
+
+static void _emitBytes(EmuContext_t *ctx, const uint8_t *bytes, size_t size) {
+	while( size-- != 0 )
+		*ctx -> JitCodeNext++ = *bytes++;
+}
+
+static void _emit8(EmuContext_t *ctx, uint8_t data) {
+	*ctx -> JitCodeNext++ = data;
+}
+
+static void _emit16(EmuContext_t *ctx, uint16_t data) {
+	_emit8(ctx, data & 0xff);
+	_emit8(ctx, data >> 8);
+}
+
+static void _emit32(EmuContext_t *ctx, uint32_t data) {
+	_emit16(ctx, data & 0xffff);
+	_emit16(ctx, data >> 16);
+}
+
+static void _emit64(EmuContext_t *ctx, uint64_t data) {
+	_emit32(ctx, data & 0xffffffff);
+	_emit32(ctx, data >> 32);
+}
+
+// ModRM for `[rbx + disp32]`
+static void _emitRBX(EmuContext_t *ctx, uint8_t reg, uint32_t disp) {
+	_emit8(ctx, 0x83 | (reg << 3));
+	_emit32(ctx, disp);
+}
+
+// Emits a forward `jcc`/`jmp` whose target is patched by `_patchJump()`
+static uint8_t* _emitJump(EmuContext_t *ctx, const uint8_t *opcode, size_t size) {
+	_emitBytes(ctx, opcode, size);
+	_emit32(ctx, 0);
+	return ctx -> JitCodeNext;
+}
+
+static void _patchJump(EmuContext_t *ctx, uint8_t *end) {
+	uint32_t rel = ctx -> JitCodeNext - end;
+	end[-4] = rel & 0xff;
+	end[-3] = (rel >> 8) & 0xff;
+	end[-2] = (rel >> 16) & 0xff;
+	end[-1] = rel >> 24;
+}
+
+
+// Writes PSW, EA and PC back to `CoreRegister`
+static void _emitSync(EmuContext_t *ctx, PC_t pc) {
+	EMIT(0x44, 0x88);	// mov [rbx + PSW], r12b
+	_emitRBX(ctx, 4, OFFSET_PSW);
+	EMIT(0x66, 0x44, 0x89);	// mov [rbx + EA], r13w
+	_emitRBX(ctx, 5, OFFSET_EA);
+	EMIT(0x66, 0xc7);	// mov word [rbx + PC], pc
+	_emitRBX(ctx, 0, OFFSET_PC);
+	_emit16(ctx, pc);
+}
+
+// Sets Z & S to constants
+static void _emitStaticFlags(EmuContext_t *ctx, uint8_t flags) {
+	EMIT(0x41, 0x81, 0xe4);	// and r12d, ~(Z | S)
+	_emit32(ctx, 0xff & ~(PSW_Z | PSW_S));
+	if( flags != 0 ) {
+		EMIT(0x41, 0x81, 0xcc);	// or r12d, flags
+		_emit32(ctx, flags);
+	}
+}
+
+// Copies ZF & SF to Z & S
+static void _emitLogicFlags(EmuContext_t *ctx) {
+	EMIT(
+		0x9f,				// lahf
+		0x0f, 0xb6, 0xcc,		// movzx ecx, ah
+		0x41, 0x0f, 0xb6, 0x0c, 0x0e,	// movzx ecx, byte [r14 + rcx]
+		0x81, 0xe1, PSW_Z | PSW_S, 0x00, 0x00, 0x00,	// and ecx, Z | S
+		0x41, 0x81, 0xe4, 0xff & ~(PSW_Z | PSW_S), 0x00, 0x00, 0x00,	// and r12d, ~(Z | S)
+		0x41, 0x09, 0xcc		// or r12d, ecx
+	);
+}
+
+// Copies CF, ZF, SF, OF & AF of an 8-bit operation to C, Z, S, OV & HC
+// Z only stays set if it was already set if `isZeroKept` is true (ADDC, SUBC)
+static void _emitArithFlags(EmuContext_t *ctx, bool isZeroKept) {
+	EMIT(
+		0x9f,				// lahf
+		0x0f, 0x90, 0xc2,		// seto dl
+		0x0f, 0xb6, 0xcc,		// movzx ecx, ah
+		0x41, 0x0f, 0xb6, 0x0c, 0x0e,	// movzx ecx, byte [r14 + rcx]
+		0xc0, 0xe2, 0x04,		// shl dl, 4
+		0x08, 0xd1			// or cl, dl
+	);
+	if( isZeroKept ) {
+		EMIT(
+			0x44, 0x89, 0xe2,	// mov edx, r12d
+			0x83, 0xca, 0xff & ~PSW_Z,	// or edx, ~Z
+			0x21, 0xd1		// and ecx, edx
+		);
+	}
+	EMIT(
+		0x41, 0x83, 0xe4, PSW_MIE | 0x03,	// and r12d, MIE | ELevel
+		0x41, 0x09, 0xcc		// or r12d, ecx
+	);
+}
+
+// 16-bit ADD/CMP of ax & cx, storing the result to `GR[offset]` if `isStored` is true
+// HC is a carry out of bit 11, which x86 doesn't have, so it comes from `dest ^ src ^ result`.
+static void _emitArith16(EmuContext_t *ctx, bool isSub, bool isStored, uint32_t offset) {
+	EMIT(
+		0x89, 0xc2,			// mov edx, eax
+		0x31, 0xca			// xor edx, ecx
+	);
+	if( isSub )
+		EMIT(0x66, 0x29, 0xc8);		// sub ax, cx
+	else
+		EMIT(0x66, 0x01, 0xc8);		// add ax, cx
+	EMIT(
+		0x89, 0xc6,			// mov esi, eax
+		0x9f,				// lahf
+		0x41, 0x0f, 0x90, 0xc0		// seto r8b
+	);
+	if( isStored ) {
+		EMIT(0x66, 0x89);		// mov [rbx + GR], si
+		_emitRBX(ctx, 6, OFFSET_GR(offset));
+	}
+	EMIT(
+		0x31, 0xd6,			// xor esi, edx
+		0xc1, 0xee, 0x0a,		// shr esi, 10
+		0x83, 0xe6, PSW_HC,		// and esi, HC
+		0x0f, 0xb6, 0xcc,		// movzx ecx, ah
+		0x41, 0x0f, 0xb6, 0x0c, 0x0e,	// movzx ecx, byte [r14 + rcx]
+		0x81, 0xe1, PSW_C | PSW_Z | PSW_S, 0x00, 0x00, 0x00,	// and ecx, C | Z | S
+		0x09, 0xf1,			// or ecx, esi
+		0x41, 0xc0, 0xe0, 0x04,		// shl r8b, 4
+		0x44, 0x08, 0xc1,		// or cl, r8b
+		0x41, 0x83, 0xe4, PSW_MIE | 0x03,	// and r12d, MIE | ELevel
+		0x41, 0x09, 0xcc		// or r12d, ecx
+	);
+}
+
+// Sets `ctx -> MemoryStatus` and `ctx -> ROMWinAccessCount` the way the MMU would for a RAM access at esi
+static void _emitRAMStatus(EmuContext_t *ctx, size_t size) {
+	if( size > 1 ) {
+		EMIT(
+			0x89, 0xf1,		// mov ecx, esi
+			0x83, 0xe1, 0x01,	// and ecx, 1
+			0x6b, 0xc9, MEMORY_UNALIGNED	// imul ecx, ecx, MEMORY_UNALIGNED
+		);
+	}
+	else {
+		EMIT(0x31, 0xc9);		// xor ecx, ecx
+	}
+	_emit8(ctx, 0x89);			// mov [rbx + MemoryStatus], ecx
+	_emitRBX(ctx, 1, OFFSET_OF(ctx -> MemoryStatus));
+	_emit8(ctx, 0xc7);			// mov dword [rbx + ROMWinAccessCount], 0
+	_emitRBX(ctx, 0, OFFSET_OF(ctx -> ROMWinAccessCount));
+	_emit32(ctx, 0);
+}
+
+// Points r15 at the page of data memory with the RAM
+// It moves when the page is copied on its first write after a fork, so it's loaded again after calling into the MMU.
+static void _emitRAMBase(EmuContext_t *ctx) {
+	uint32_t RAMStart, RAMEnd, index;
+
+	_jitFindRAM(ctx, &RAMStart, &RAMEnd);
+	if( RAMEnd == RAMStart )
+		return;
+
+	index = (RAMStart - ROM_WINDOW_SIZE) / DATA_PAGE_SIZE;
+	EMIT(0x4c, 0x8b);			// mov r15, [rbx + DataPages[index]]
+	_emitRBX(ctx, 7, OFFSET_OF(ctx -> DataPages[index]));
+	EMIT(0x49, 0x81, 0xef);			// sub r15, address of the page
+	_emit32(ctx, ROM_WINDOW_SIZE + index * DATA_PAGE_SIZE);
+}
+
+// Checks whether the access at esi hits plain RAM, leaves the word aligned address in edi
+// Returns the jump to patch to the slow path, or NULL if there's no RAM to check against.
+static uint8_t* _emitRAMCheck(EmuContext_t *ctx, size_t size) {
+	static const uint8_t jae[] = {0x0f, 0x83};
+	uint32_t RAMStart, RAMEnd;
+
+	_jitFindRAM(ctx, &RAMStart, &RAMEnd);
+	if( RAMEnd == RAMStart )
+		return NULL;
+
+	EMIT(0x89, 0xf7);			// mov edi, esi
+	if( size > 1 ) {
+		EMIT(0x81, 0xe7, 0xfe, 0xff, 0x00, 0x00);	// and edi, 0xfffe
+	}
+	EMIT(0x8d, 0x87);			// lea eax, [rdi - RAMStart]
+	_emit32(ctx, -RAMStart);
+	EMIT(0x3d);				// cmp eax, RAM size
+	_emit32(ctx, RAMEnd - RAMStart - (size - 1));
+	return _emitJump(ctx, jae, sizeof(jae));
+}
+
+// Loads from esi into eax
+static void _emitLoad(EmuContext_t *ctx, size_t size, uint32_t kind, PC_t pc) {
+	static const uint8_t jmp[] = {0xe9};
+	uint8_t *slow, *join = NULL;
+
+	slow = _emitRAMCheck(ctx, size);
+	if( slow != NULL ) {
+		if( size > 1 )
+			EMIT(0x41, 0x0f, 0xb7, 0x04, 0x3f);	// movzx eax, word [r15 + rdi]
+		else
+			EMIT(0x41, 0x0f, 0xb6, 0x04, 0x3f);	// movzx eax, byte [r15 + rdi]
+		_emitRAMStatus(ctx, size);
+		join = _emitJump(ctx, jmp, sizeof(jmp));
+		_patchJump(ctx, slow);
+	}
+
+	_emitSync(ctx, pc);
+	EMIT(0x48, 0x89, 0xdf);			// mov rdi, rbx
+	EMIT(0xba);				// mov edx, kind
+	_emit32(ctx, kind);
+	EMIT(0x48, 0xb8);			// mov rax, _jitRead
+	_emit64(ctx, (uint64_t)(uintptr_t)_jitRead);
+	EMIT(0xff, 0xd0);			// call rax
+	_emitRAMBase(ctx);
+
+	if( join != NULL )
+		_patchJump(ctx, join);
+}
+
+// Stores edx to esi
+// RAM shared with forked contexts is written by the MMU, which copies it first.
+static void _emitStore(EmuContext_t *ctx, size_t size, PC_t pc) {
+	static const uint8_t jmp[] = {0xe9};
+	static const uint8_t jnz[] = {0x0f, 0x85};
+	uint8_t *slow, *shared = NULL, *join = NULL;
+	uint32_t RAMStart, RAMEnd;
+
+	slow = _emitRAMCheck(ctx, size);
+	if( slow != NULL ) {
+		_jitFindRAM(ctx, &RAMStart, &RAMEnd);
+		_emit8(ctx, 0xf6);		// test byte [rbx + DataPagesShared], bit of the page
+		_emitRBX(ctx, 0, OFFSET_OF(ctx -> DataPagesShared));
+		_emit8(ctx, 1 << ((RAMStart - ROM_WINDOW_SIZE) / DATA_PAGE_SIZE));
+		shared = _emitJump(ctx, jnz, sizeof(jnz));
+
+		if( size > 1 )
+			EMIT(0x66, 0x41, 0x89, 0x14, 0x3f);	// mov [r15 + rdi], dx
+		else
+			EMIT(0x41, 0x88, 0x14, 0x3f);	// mov [r15 + rdi], dl
+		_emitRAMStatus(ctx, size);
+#ifdef CORE_IDLE_SKIP
+		_emit8(ctx, 0x83);		// add dword [rbx + MemoryWrites], 1
+		_emitRBX(ctx, 0, OFFSET_OF(ctx -> MemoryWrites));
+		_emit8(ctx, 1);
+#endif
+		join = _emitJump(ctx, jmp, sizeof(jmp));
+		_patchJump(ctx, slow);
+		_patchJump(ctx, shared);
+	}
+
+	_emitSync(ctx, pc);
+	EMIT(0x48, 0x89, 0xdf);			// mov rdi, rbx
+	EMIT(0x89, 0xd1);			// mov ecx, edx
+	EMIT(0xba);				// mov edx, size
+	_emit32(ctx, size);
+	EMIT(0x48, 0xb8);			// mov rax, _jitWrite
+	_emit64(ctx, (uint64_t)(uintptr_t)_jitWrite);
+	EMIT(0xff, 0xd0);			// call rax
+	_emitRAMBase(ctx);
+
+	if( join != NULL )
+		_patchJump(ctx, join);
+}
+
+static void _emitEpilogue(EmuContext_t *ctx) {
+	EMIT(
+		0x41, 0x5f,			// pop r15
+		0x41, 0x5e,			// pop r14
+		0x41, 0x5d,			// pop r13
+		0x41, 0x5c,			// pop r12
+		0x5b,				// pop rbx
+		0xc3				// ret
+	);
+}
+
+// Leaves translated code after the `count`th instruction if a stop has been requested
+static void _emitStopCheck(EmuContext_t *ctx, PC_t pc, unsigned int count, int cycles) {
+	static const uint8_t jz[] = {0x0f, 0x84};
+	uint8_t *skip;
+
+	_emit8(ctx, 0x83);			// cmp dword [rbx + CoreStopRequests], 0
+	_emitRBX(ctx, 7, OFFSET_OF(ctx -> CoreStopRequests));
+	_emit8(ctx, 0);
+	skip = _emitJump(ctx, jz, sizeof(jz));
+
+	_emitSync(ctx, pc);
+	_emit8(ctx, 0xc7);			// mov dword [rbx + JitLength], count
+	_emitRBX(ctx, 0, OFFSET_OF(ctx -> JitLength));
+	_emit32(ctx, count);
+	EMIT(0xb8);				// mov eax, cycles
+	_emit32(ctx, cycles);
+	_emitEpilogue(ctx);
+
+	_patchJump(ctx, skip);
+}
+
+// Puts the address of a load/store into esi
+static void _emitAddress(EmuContext_t *ctx, const CoreInstruction_t *insn) {
+	switch( insn -> op ) {
+		case OP_L_R_ERM:
+		case OP_ST_R_ERM:
+		case OP_L_ER_ERM:
+		case OP_ST_ER_ERM:
+			EMIT(0x0f, 0xb7);	// movzx esi, word [rbx + ERm]
+			_emitRBX(ctx, 6, OFFSET_GR(insn -> src & 0x0e));
+			return;
+
+		case OP_L_R_BP:
+		case OP_ST_R_BP:
+		case OP_L_ER_BP:
+		case OP_ST_ER_BP:
+		case OP_L_R_FP:
+		case OP_ST_R_FP:
+		case OP_L_ER_FP:
+		case OP_ST_ER_FP:
+			EMIT(0x0f, 0xb7);	// movzx esi, word [rbx + ER12/ER14]
+			switch( insn -> op ) {
+				case OP_L_R_BP:
+				case OP_ST_R_BP:
+				case OP_L_ER_BP:
+				case OP_ST_ER_BP:
+					_emitRBX(ctx, 6, OFFSET_GR(12));
+					break;
+				default:
+					_emitRBX(ctx, 6, OFFSET_GR(14));
+			}
+			EMIT(0x81, 0xc6);	// add esi, disp6
+			_emit32(ctx, insn -> imm);
+			EMIT(0x81, 0xe6, 0xff, 0xff, 0x00, 0x00);	// and esi, 0xffff
+			return;
+
+		default:
+			EMIT(0x41, 0x0f, 0xb7, 0xf5);	// movzx esi, r13w
+	}
+}
+
+// Checks if the instruction can be translated
+static bool _isTranslatable(uint8_t op) {
+	switch( op ) {
+		case OP_NONE:
+		case OP_NOP:
+		case OP_MOV_R_IMM:
+		case OP_ADD_R_IMM:
+		case OP_AND_R_IMM:
+		case OP_OR_R_IMM:
+		case OP_XOR_R_IMM:
+		case OP_CMPC_R_IMM:
+		case OP_ADDC_R_IMM:
+		case OP_CMP_R_IMM:
+		case OP_MOV_R_R:
+		case OP_ADD_R_R:
+		case OP_AND_R_R:
+		case OP_OR_R_R:
+		case OP_XOR_R_R:
+		case OP_CMPC_R_R:
+		case OP_ADDC_R_R:
+		case OP_CMP_R_R:
+		case OP_SUB_R_R:
+		case OP_SUBC_R_R:
+		case OP_MOV_ER_IMM:
+		case OP_ADD_ER_IMM:
+		case OP_MOV_ER_ER:
+		case OP_ADD_ER_ER:
+		case OP_CMP_ER_ER:
+		case OP_LEA_ER:
+		case OP_LEA_D16:
+		case OP_LEA_ADR:
+		case OP_RC:
+		case OP_SC:
+		case OP_CPLC:
+		case OP_DI:
+		case OP_EI:
+		case OP_L_R_ERM:
+		case OP_L_R_EA:
+		case OP_L_R_EAP:
+		case OP_ST_R_ERM:
+		case OP_ST_R_EA:
+		case OP_ST_R_EAP:
+		case OP_L_ER_ERM:
+		case OP_L_ER_EA:
+		case OP_L_ER_EAP:
+		case OP_ST_ER_ERM:
+		case OP_ST_ER_EA:
+		case OP_ST_ER_EAP:
+		case OP_L_R_BP:
+		case OP_L_R_FP:
+		case OP_ST_R_BP:
+		case OP_ST_R_FP:
+		case OP_L_ER_BP:
+		case OP_L_ER_FP:
+		case OP_ST_ER_BP:
+		case OP_ST_ER_FP:
+			return true;
+
+		default:
+			// B<cond>
+			return (op >= OP_BGE) && (op <= OP_BAL);
+	}
+}
+
+// Checks if the instruction takes `EAIncDelay` more cycles
+static bool _isEAIncDelayed(uint8_t op) {
+	switch( op ) {
+		case OP_L_R_ERM:
+		case OP_ST_R_ERM:
+		case OP_L_ER_ERM:
+		case OP_ST_ER_ERM:
+		case OP_L_R_BP:
+		case OP_L_R_FP:
+		case OP_ST_R_BP:
+		case OP_ST_R_FP:
+		case OP_L_ER_BP:
+		case OP_L_ER_FP:
+		case OP_ST_ER_BP:
+		case OP_ST_ER_FP:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+// Emits an 8-bit ALU op on `GR[n]`, with `src` in al if it isn't an immediate
+// `group` is the x86 opcode group number (ADD = 0, OR = 1, ADC = 2, SBB = 3, AND = 4, SUB = 5, XOR = 6, CMP = 7)
+static void _emitALU8(EmuContext_t *ctx, uint8_t group, const CoreInstruction_t *insn, bool isImm) {
+	if( isImm ) {
+		_emit8(ctx, 0x80);			// op byte [rbx + Rn], imm8
+		_emitRBX(ctx, group, OFFSET_GR(insn -> dest));
+		_emit8(ctx, insn -> imm & 0xff);
+	}
+	else {
+		_emit8(ctx, group << 3);		// op [rbx + Rn], al
+		_emitRBX(ctx, 0, OFFSET_GR(insn -> dest));
+	}
+}
+
+// Emits B<cond>, which ends a block
+// Leaves the cycles taken in eax.
+static void _emitBranch(EmuContext_t *ctx, const CoreInstruction_t *insn, PC_t pc, int cycles) {
+	static const uint8_t TestMasks[] = {
+		PSW_C, PSW_C,				// GE, LT
+		PSW_C | PSW_Z, PSW_C | PSW_Z,		// GT, LE
+		0, 0, 0, 0,				// GES, LTS, GTS, LES
+		PSW_Z, PSW_Z,				// NE, EQ
+		PSW_OV, PSW_OV,				// NV, OV
+		PSW_S, PSW_S				// PS, NS
+	};
+	unsigned int cond = insn -> op - OP_BGE;
+
+	EMIT(0x31, 0xc9);			// xor ecx, ecx
+	if( insn -> op == OP_BAL ) {
+		EMIT(0xb1, 0x01);		// mov cl, 1
+	}
+	else {
+		if( TestMasks[cond] != 0 ) {
+			EMIT(0x41, 0xf7, 0xc4);	// test r12d, mask
+			_emit32(ctx, TestMasks[cond]);
+		}
+		else {
+			// OV ^ S, and Z for GTS & LES
+			EMIT(
+				0x44, 0x89, 0xe0,	// mov eax, r12d
+				0xd1, 0xe8,		// shr eax, 1
+				0x44, 0x31, 0xe0,	// xor eax, r12d
+				0x83, 0xe0, PSW_OV	// and eax, OV
+			);
+			if( (insn -> op == OP_BGTS) || (insn -> op == OP_BLES) ) {
+				EMIT(
+					0x44, 0x89, 0xe2,	// mov edx, r12d
+					0x83, 0xe2, PSW_Z,	// and edx, Z
+					0x09, 0xd0		// or eax, edx
+				);
+			}
+			EMIT(0x85, 0xc0);	// test eax, eax
+		}
+		// even conditions branch when the bits are clear
+		if( (cond & 1) == 0 )
+			EMIT(0x0f, 0x94, 0xc1);	// sete cl
+		else
+			EMIT(0x0f, 0x95, 0xc1);	// setne cl
+	}
+
+	EMIT(0xb8);				// mov eax, cycles
+	_emit32(ctx, cycles);
+	EMIT(0xba);				// mov edx, pc
+	_emit32(ctx, pc);
+	EMIT(0xbe);				// mov esi, pc + disp
+	_emit32(ctx, (pc + insn -> imm) & 0xffff);
+	EMIT(
+		0x85, 0xc9,			// test ecx, ecx
+		0x0f, 0x45, 0xd6,		// cmovnz edx, esi
+		0x6b, 0xc9			// imul ecx, ecx, extra cycles
+	);
+	_emit8(ctx, 3 - insn -> cycles);
+	EMIT(0x01, 0xc8);			// add eax, ecx
+
+	_emitSync(ctx, pc);
+	EMIT(0x66, 0x89);			// mov [rbx + PC], dx
+	_emitRBX(ctx, 2, OFFSET_PC);
+}
+
+// Emits one instruction, `pc` points past it
+static void _emitInstruction(EmuContext_t *ctx, const CoreInstruction_t *insn, PC_t pc) {
+	uint8_t n = insn -> dest, m = insn -> src;
+
+	switch( insn -> op ) {
+		case OP_NONE:
+		case OP_NOP:
+			break;
+
+		case OP_MOV_R_IMM:
+			_emit8(ctx, 0xc6);			// mov byte [rbx + Rn], imm8
+			_emitRBX(ctx, 0, OFFSET_GR(n));
+			_emit8(ctx, insn -> imm & 0xff);
+			_emitStaticFlags(ctx, ((insn -> imm & 0xff)? 0 : PSW_Z) | ((insn -> imm & 0x80)? PSW_S : 0));
+			break;
+
+		case OP_ADD_R_IMM:
+			_emitALU8(ctx, 0, insn, true);
+			_emitArithFlags(ctx, false);
+			break;
+
+		case OP_AND_R_IMM:
+			_emitALU8(ctx, 4, insn, true);
+			_emitLogicFlags(ctx);
+			break;
+
+		case OP_OR_R_IMM:
+			_emitALU8(ctx, 1, insn, true);
+			_emitLogicFlags(ctx);
+			break;
+
+		case OP_XOR_R_IMM:
+			_emitALU8(ctx, 6, insn, true);
+			_emitLogicFlags(ctx);
+			break;
+
+		case OP_CMP_R_IMM:
+			_emitALU8(ctx, 7, insn, true);
+			_emitArithFlags(ctx, false);
+			break;
+
+		case OP_ADDC_R_IMM:
+			EMIT(0x41, 0x0f, 0xba, 0xe4, 0x07);	// bt r12d, 7
+			_emitALU8(ctx, 2, insn, true);
+			_emitArithFlags(ctx, true);
+			break;
+
+		case OP_CMPC_R_IMM:
+			_emit8(ctx, 0x8a);			// mov al, [rbx + Rn]
+			_emitRBX(ctx, 0, OFFSET_GR(n));
+			EMIT(0x41, 0x0f, 0xba, 0xe4, 0x07);	// bt r12d, 7
+			_emit8(ctx, 0x1c);			// sbb al, imm8
+			_emit8(ctx, insn -> imm & 0xff);
+			_emitArithFlags(ctx, true);
+			break;
+
+		case OP_MOV_R_R:
+			_emit8(ctx, 0x8a);			// mov al, [rbx + Rm]
+			_emitRBX(ctx, 0, OFFSET_GR(m));
+			_emit8(ctx, 0x88);			// mov [rbx + Rn], al
+			_emitRBX(ctx, 0, OFFSET_GR(n));
+			EMIT(0x84, 0xc0);		// test al, al
+			_emitLogicFlags(ctx);
+			break;
+
+		case OP_ADD_R_R:
+		case OP_AND_R_R:
+		case OP_OR_R_R:
+		case OP_XOR_R_R:
+		case OP_CMP_R_R:
+		case OP_SUB_R_R:
+		case OP_ADDC_R_R:
+		case OP_SUBC_R_R:
+			_emit8(ctx, 0x8a);			// mov al, [rbx + Rm]
+			_emitRBX(ctx, 0, OFFSET_GR(m));
+			switch( insn -> op ) {
+				case OP_ADD_R_R:
+					_emitALU8(ctx, 0, insn, false);
+					_emitArithFlags(ctx, false);
+					break;
+				case OP_AND_R_R:
+					_emitALU8(ctx, 4, insn, false);
+					_emitLogicFlags(ctx);
+					break;
+				case OP_OR_R_R:
+					_emitALU8(ctx, 1, insn, false);
+					_emitLogicFlags(ctx);
+					break;
+				case OP_XOR_R_R:
+					_emitALU8(ctx, 6, insn, false);
+					_emitLogicFlags(ctx);
+					break;
+				case OP_CMP_R_R:
+					_emitALU8(ctx, 7, insn, false);
+					_emitArithFlags(ctx, false);
+					break;
+				case OP_SUB_R_R:
+					_emitALU8(ctx, 5, insn, false);
+					_emitArithFlags(ctx, false);
+					break;
+				case OP_ADDC_R_R:
+					EMIT(0x41, 0x0f, 0xba, 0xe4, 0x07);	// bt r12d, 7
+					_emitALU8(ctx, 2, insn, false);
+					_emitArithFlags(ctx, true);
+					break;
+				default:
+					EMIT(0x41, 0x0f, 0xba, 0xe4, 0x07);	// bt r12d, 7
+					_emitALU8(ctx, 3, insn, false);
+					_emitArithFlags(ctx, true);
+			}
+			break;
+
+		case OP_CMPC_R_R:
+			_emit8(ctx, 0x8a);			// mov al, [rbx + Rm]
+			_emitRBX(ctx, 0, OFFSET_GR(m));
+			_emit8(ctx, 0x8a);			// mov cl, [rbx + Rn]
+			_emitRBX(ctx, 1, OFFSET_GR(n));
+			EMIT(0x41, 0x0f, 0xba, 0xe4, 0x07);	// bt r12d, 7
+			EMIT(0x18, 0xc1);		// sbb cl, al
+			_emitArithFlags(ctx, true);
+			break;
+
+		case OP_MOV_ER_IMM:
+			EMIT(0x66, 0xc7);		// mov word [rbx + ERn], imm16
+			_emitRBX(ctx, 0, OFFSET_GR(n & 0x0e));
+			_emit16(ctx, insn -> imm);
+			_emitStaticFlags(ctx, (insn -> imm? 0 : PSW_Z) | ((insn -> imm & 0x8000)? PSW_S : 0));
+			break;
+
+		case OP_MOV_ER_ER:
+			EMIT(0x0f, 0xb7);		// movzx eax, word [rbx + ERm]
+			_emitRBX(ctx, 0, OFFSET_GR(m & 0x0e));
+			_emit8(ctx, 0x66);			// mov [rbx + ERn], ax
+			_emit8(ctx, 0x89);
+			_emitRBX(ctx, 0, OFFSET_GR(n & 0x0e));
+			EMIT(0x66, 0x85, 0xc0);		// test ax, ax
+			_emitLogicFlags(ctx);
+			break;
+
+		case OP_ADD_ER_IMM:
+			EMIT(0x0f, 0xb7);		// movzx eax, word [rbx + ERn]
+			_emitRBX(ctx, 0, OFFSET_GR(n & 0x0e));
+			_emit8(ctx, 0xb9);			// mov ecx, imm7
+			_emit32(ctx, insn -> imm);
+			_emitArith16(ctx, false, true, n & 0x0e);
+			break;
+
+		case OP_ADD_ER_ER:
+		case OP_CMP_ER_ER:
+			EMIT(0x0f, 0xb7);		// movzx eax, word [rbx + ERn]
+			_emitRBX(ctx, 0, OFFSET_GR(n & 0x0e));
+			EMIT(0x0f, 0xb7);		// movzx ecx, word [rbx + ERm]
+			_emitRBX(ctx, 1, OFFSET_GR(m & 0x0e));
+			if( insn -> op == OP_ADD_ER_ER )
+				_emitArith16(ctx, false, true, n & 0x0e);
+			else
+				_emitArith16(ctx, true, false, 0);
+			break;
+
+		case OP_LEA_ER:
+			EMIT(0x44, 0x0f, 0xb7);		// movzx r13d, word [rbx + ERm]
+			_emitRBX(ctx, 5, OFFSET_GR(m & 0x0e));
+			break;
+
+		case OP_LEA_D16:
+			EMIT(0x44, 0x0f, 0xb7);		// movzx r13d, word [rbx + ERm]
+			_emitRBX(ctx, 5, OFFSET_GR(m & 0x0e));
+			EMIT(0x41, 0x81, 0xc5);		// add r13d, disp16
+			_emit32(ctx, insn -> imm);
+			EMIT(0x41, 0x81, 0xe5, 0xff, 0xff, 0x00, 0x00);	// and r13d, 0xffff
+			break;
+
+		case OP_LEA_ADR:
+			EMIT(0x41, 0xbd);		// mov r13d, adr
+			_emit32(ctx, insn -> imm);
+			break;
+
+		case OP_RC:
+			EMIT(0x41, 0x81, 0xe4);		// and r12d, ~C
+			_emit32(ctx, 0xff & ~PSW_C);
+			break;
+
+		case OP_SC:
+			EMIT(0x41, 0x81, 0xcc);		// or r12d, C
+			_emit32(ctx, PSW_C);
+			break;
+
+		case OP_CPLC:
+			EMIT(0x41, 0x81, 0xf4);		// xor r12d, C
+			_emit32(ctx, PSW_C);
+			break;
+
+		case OP_DI:
+			EMIT(0x41, 0x81, 0xe4);		// and r12d, ~MIE
+			_emit32(ctx, 0xff & ~PSW_MIE);
+			break;
+
+		case OP_EI:
+			EMIT(0x41, 0x81, 0xcc);		// or r12d, MIE
+			_emit32(ctx, PSW_MIE);
+			break;
+
+		case OP_L_R_ERM:
+		case OP_L_R_EA:
+		case OP_L_R_EAP:
+		case OP_L_R_BP:
+		case OP_L_R_FP:
+			_emitAddress(ctx, insn);
+			_emitLoad(ctx, 1, JIT_READ_BYTE, pc);
+			_emit8(ctx, 0x88);			// mov [rbx + Rn], al
+			_emitRBX(ctx, 0, OFFSET_GR(n));
+			EMIT(0x84, 0xc0);		// test al, al
+			_emitLogicFlags(ctx);
+			if( insn -> op == OP_L_R_EAP ) {
+				EMIT(0x41, 0x83, 0xc5, 0x01);	// add r13d, 1
+				EMIT(0x41, 0x81, 0xe5, 0xff, 0xff, 0x00, 0x00);	// and r13d, 0xffff
+			}
+			break;
+
+		case OP_L_ER_ERM:
+		case OP_L_ER_EA:
+		case OP_L_ER_EAP:
+		case OP_L_ER_BP:
+		case OP_L_ER_FP:
+			_emitAddress(ctx, insn);
+			_emitLoad(ctx, 2, ((insn -> op == OP_L_ER_BP) || (insn -> op == OP_L_ER_FP))? JIT_READ_WORD_DISP : JIT_READ_WORD, pc);
+			EMIT(0x66, 0x89);		// mov [rbx + ERn], ax
+			_emitRBX(ctx, 0, OFFSET_GR(n & 0x0e));
+			EMIT(0x66, 0x85, 0xc0);		// test ax, ax
+			_emitLogicFlags(ctx);
+			if( insn -> op == OP_L_ER_EAP ) {
+				EMIT(0x41, 0x83, 0xc5, 0x02);	// add r13d, 2
+				EMIT(0x41, 0x81, 0xe5, 0xfe, 0xff, 0x00, 0x00);	// and r13d, 0xfffe
+			}
+			break;
+
+		case OP_ST_R_ERM:
+		case OP_ST_R_EA:
+		case OP_ST_R_EAP:
+		case OP_ST_R_BP:
+		case OP_ST_R_FP:
+			_emitAddress(ctx, insn);
+			EMIT(0x0f, 0xb6);		// movzx edx, byte [rbx + Rn]
+			_emitRBX(ctx, 2, OFFSET_GR(n));
+			_emitStore(ctx, 1, pc);
+			if( insn -> op == OP_ST_R_EAP ) {
+				EMIT(0x41, 0x83, 0xc5, 0x01);	// add r13d, 1
+				EMIT(0x41, 0x81, 0xe5, 0xff, 0xff, 0x00, 0x00);	// and r13d, 0xffff
+			}
+			break;
+
+		case OP_ST_ER_ERM:
+		case OP_ST_ER_EA:
+		case OP_ST_ER_EAP:
+		case OP_ST_ER_BP:
+		case OP_ST_ER_FP:
+			_emitAddress(ctx, insn);
+			EMIT(0x0f, 0xb7);		// movzx edx, word [rbx + ERn]
+			_emitRBX(ctx, 2, OFFSET_GR(n & 0x0e));
+			_emitStore(ctx, 2, pc);
+			if( insn -> op == OP_ST_ER_EAP ) {
+				EMIT(0x41, 0x83, 0xc5, 0x02);	// add r13d, 2
+				EMIT(0x41, 0x81, 0xe5, 0xfe, 0xff, 0x00, 0x00);	// and r13d, 0xfffe
+			}
+			break;
+	}
+}
+
+
+// Sets up the code buffer of `ctx`
+static bool _jitInit(EmuContext_t *ctx) {
+	ctx -> JitCode = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if( ctx -> JitCode == MAP_FAILED ) {
+		ctx -> JitCode = NULL;
+		ctx -> IsJitBroken = true;
+		return false;
+	}
+	ctx -> JitCodeNext = ctx -> JitCode;
+
+#ifdef CORE_JIT_PERF_MAP
+	{
+		// all the contexts of the process append to the same map
+		char path[32];
+		snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+		ctx -> JitPerfMap = fopen(path, "a");
+	}
+#endif
+
+	return true;
+}
+
+// Translates the leading instructions of `block` that can be translated
+// Sets `native` to NULL if none of them can.
+void jitTranslate(EmuContext_t *ctx, CoreBlock_t *block) {
+	const CoreInstruction_t *insn;
+	uint8_t *start;
+	PC_t pc = block -> tag & 0xffff;
+	int cycles = 0, extraCycles = 0;
+	bool isEAInc = false, isBranch = false;
+	uint8_t count;
+
+	block -> native = NULL;
+	block -> nativeLength = 0;
+
+	if( ctx -> IsJitBroken || ((ctx -> JitCode == NULL) && !_jitInit(ctx)) )
+		return;
+	if( !_isTranslatable(block -> ops[0].op) )
+		return;
+
+	if( ctx -> JitCodeNext + JIT_BLOCK_SIZE_MAX > ctx -> JitCode + JIT_CODE_SIZE )
+		jitFlush(ctx);
+	start = ctx -> JitCodeNext;
+
+	EMIT(
+		0x53,				// push rbx
+		0x41, 0x54,			// push r12
+		0x41, 0x55,			// push r13
+		0x41, 0x56,			// push r14
+		0x41, 0x57,			// push r15
+		0x48, 0x89, 0xfb		// mov rbx, rdi
+	);
+	EMIT(0x44, 0x0f, 0xb6);			// movzx r12d, byte [rbx + PSW]
+	_emitRBX(ctx, 4, OFFSET_PSW);
+	EMIT(0x44, 0x0f, 0xb7);			// movzx r13d, word [rbx + EA]
+	_emitRBX(ctx, 5, OFFSET_EA);
+	EMIT(0x49, 0xbe);			// mov r14, FlagTable
+	_emit64(ctx, (uint64_t)(uintptr_t)FlagTable);
+	_emitRAMBase(ctx);
+
+	for( count = 0; count < block -> length; ++count ) {
+		insn = &block -> ops[count];
+		if( !_isTranslatable(insn -> op) )
+			break;
+
+		cycles += insn -> cycles;
+		if( isEAInc && _isEAIncDelayed(insn -> op) )
+			++cycles;
+		isEAInc = (insn -> op == OP_L_R_EAP) || (insn -> op == OP_ST_R_EAP) ||
+			(insn -> op == OP_L_ER_EAP) || (insn -> op == OP_ST_ER_EAP);
+
+		pc = (pc + (insn -> words << 1)) & 0xfffe;
+		if( (insn -> op >= OP_BGE) && (insn -> op <= OP_BAL) ) {
+			_emitBranch(ctx, insn, pc, cycles);
+			extraCycles += 3 - insn -> cycles;
+			isBranch = true;
+			++count;
+			break;
+		}
+		_emitInstruction(ctx, insn, pc);
+
+		// loads & stores
+		if( (insn -> op >= OP_L_R_ERM) && (insn -> op <= OP_ST_R_FP) ) {
+			extraCycles += 2;	// a word in the ROM window at most
+			_emitStopCheck(ctx, pc, count + 1, cycles);
+		}
+	}
+
+	if( !isBranch ) {
+		_emitSync(ctx, pc);
+		EMIT(0xb8);			// mov eax, cycles
+		_emit32(ctx, cycles);
+	}
+	_emitEpilogue(ctx);
+
+#ifdef CORE_JIT_PERF_MAP
+	if( ctx -> JitPerfMap != NULL ) {
+#if defined(CORE_DUAL_VARIANT)
+		const char *core = ctx -> IsU16? "u16" : "u8";
+#elif defined(CORE_IS_U16)
+		const char *core = "u16";
+#else
+		const char *core = "u8";
+#endif
+		fprintf(ctx -> JitPerfMap, "%lx %lx %s_%X_%04X\n", (unsigned long)(uintptr_t)start,
+			(unsigned long)(ctx -> JitCodeNext - start), core, (unsigned int)(block -> tag >> 16), (unsigned int)(block -> tag & 0xffff));
+		fflush(ctx -> JitPerfMap);
+	}
+#endif
+
+	// Set last, `jitFlush()` above may have moved to a new generation
+	block -> native = (CoreNativeBlock_t)(uintptr_t)start;
+	block -> nativeGeneration = ctx -> JitGeneration;
+	block -> nativeCycles = cycles + extraCycles;
+	block -> nativeLength = count;
+}
+
+// Throws away all translated code of `ctx`
+void jitFlush(EmuContext_t *ctx) {
+	ctx -> JitCodeNext = ctx -> JitCode;
+	++ctx -> JitGeneration;
+}
+
+// Releases the code buffer of `ctx`
+// Blocks translated before are thrown away, and it's set up again if translation is needed later.
+void jitFree(EmuContext_t *ctx) {
+	if( ctx -> JitCode != NULL )
+		munmap(ctx -> JitCode, JIT_CODE_SIZE);
+	ctx -> JitCode = ctx -> JitCodeNext = NULL;
+	ctx -> IsJitBroken = false;
+	++ctx -> JitGeneration;
+
+#ifdef CORE_JIT_PERF_MAP
+	if( ctx -> JitPerfMap != NULL )
+		fclose(ctx -> JitPerfMap);
+	ctx -> JitPerfMap = NULL;
+#endif
+}
+
+#endif
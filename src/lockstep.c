@@ -0,0 +1,536 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "regtypes.h"
+#include "core.h"
+#include "coretypes.h"
+#include "decode.h"
+#include "lockstep.h"
+#include "intc.h"
+#include "context.h"
+
+
+// Lane-wise execution
+//
+// Every `FOR_LANES()` loop of the kernels below goes through all `LOCKSTEP_LANES` lanes with no branch at all:
+// the instruction only picks the masks and operands the loop starts with, flags come from arithmetic, and
+// the lanes in `ls -> mask` are picked with masks too. Written this way, GCC (`-O3`, or `-O2 -ftree-vectorize`)
+// and Clang turn them into SSE2 code, or AVX2 code with `-mavx2`, without any intrinsics that would tie the
+// code to x86. Check with `-fopt-info-vec` when changing them, a single branch left in a loop keeps it scalar.
+
+#define FOR_LANES(l) for( (l) = 0; (l) < LOCKSTEP_LANES; ++(l) )
+
+// Keeps `old` in the lanes that don't run the current instruction, `mask[l]` widened for wider registers
+#define PICK(l, val, old) (((val) & ls -> mask[l]) | ((old) & ~ls -> mask[l]))
+#define MASK16(l) ((uint16_t)-(uint16_t)(ls -> mask[l] & 1))
+#define PICK16(l, val, old) (((val) & MASK16(l)) | ((old) & ~MASK16(l)))
+#define MASK32(l) (-(int)(ls -> mask[l] & 1))
+
+// Rn:Rn+1 of a lane
+#define ER(n, l) ((uint16_t)(ls -> gr[n][l] | (ls -> gr[(n) + 1][l] << 8)))
+
+// Flags ALU instructions don't change
+#define PSW_KEPT (PSW_MIE | 0x03)
+
+
+// Z & S of a result, in `PSW_t.raw` layout
+static inline uint8_t _flagsZS8(uint32_t r) {
+	return (((r & 0xff) == 0)? PSW_Z : 0) | ((r >> 2) & PSW_S);
+}
+
+static inline uint8_t _flagsZS16(uint32_t r) {
+	return (((r & 0xffff) == 0)? PSW_Z : 0) | ((r >> 10) & PSW_S);
+}
+
+// C, OV & HC of `r = d + s (+ c)` or `r = d - s (- c)`
+// `d ^ s ^ r` has the carry (borrow) into every bit, OV is the carry into the sign bit xor the one out of it.
+static inline uint8_t _flagsCarry8(uint32_t d, uint32_t s, uint32_t r) {
+	uint32_t x = d ^ s ^ r;
+	return ((x >> 1) & PSW_C) | (((x >> 3) ^ (x >> 4)) & PSW_OV) | ((x >> 2) & PSW_HC);
+}
+
+static inline uint8_t _flagsCarry16(uint32_t d, uint32_t s, uint32_t r) {
+	uint32_t x = d ^ s ^ r;
+	return ((x >> 9) & PSW_C) | (((x >> 11) ^ (x >> 12)) & PSW_OV) | ((x >> 10) & PSW_HC);
+}
+
+// MOV/AND/OR/XOR Rn, with the operand of each lane in `src`
+static inline void _lockstepLogic8(Lockstep_t *ls, uint8_t op, uint8_t n, const uint8_t *src) {
+	unsigned int l;
+	uint8_t isAnd = 0, isOr = 0, isXor = 0, isMov = 0, d, s, r;
+
+	switch( op ) {
+		case OP_AND_R_IMM:
+		case OP_AND_R_R:
+			isAnd = 0xff;
+			break;
+		case OP_OR_R_IMM:
+		case OP_OR_R_R:
+			isOr = 0xff;
+			break;
+		case OP_XOR_R_IMM:
+		case OP_XOR_R_R:
+			isXor = 0xff;
+			break;
+		default:
+			isMov = 0xff;
+	}
+
+	FOR_LANES(l) {
+		d = ls -> gr[n][l];
+		s = src[l];
+		r = (d & s & isAnd) | ((d | s) & isOr) | ((d ^ s) & isXor) | (s & isMov);
+		ls -> psw[l] = PICK(l, (ls -> psw[l] & ~(PSW_Z | PSW_S)) | _flagsZS8(r), ls -> psw[l]);
+		ls -> gr[n][l] = PICK(l, r, ls -> gr[n][l]);
+	}
+}
+
+// ADD/ADDC/SUB/SUBC/CMP/CMPC Rn, with the operand of each lane in `src`
+// Subtracting is adding the complement of `s + c` plus one. ADDC, SUBC & CMPC only keep Z if it was already set.
+static inline void _lockstepArith8(Lockstep_t *ls, uint8_t n, const uint8_t *src, bool isSub, bool isCarried, bool isStored) {
+	unsigned int l;
+	uint16_t d, s, c, r, sub = isSub? 0xffff : 0;
+	uint8_t carry = isCarried? 1 : 0, keptZ = isCarried? (uint8_t)~PSW_Z : 0xff, stored = isStored? 0xff : 0, flags, m;
+
+	FOR_LANES(l) {
+		d = ls -> gr[n][l];
+		s = src[l];
+		c = (ls -> psw[l] >> 7) & carry;
+		r = d + ((s + c) ^ sub) + (sub & 1);
+		flags = (_flagsCarry8(d, s, r) | _flagsZS8(r)) & (ls -> psw[l] | keptZ);
+		ls -> psw[l] = PICK(l, (ls -> psw[l] & PSW_KEPT) | flags, ls -> psw[l]);
+		m = ls -> mask[l] & stored;
+		ls -> gr[n][l] = ((uint8_t)r & m) | (ls -> gr[n][l] & ~m);
+	}
+}
+
+// MOV/ADD/CMP ERn, with the operand of each lane in `src`
+static inline void _lockstepALU16(Lockstep_t *ls, uint8_t op, uint8_t n, const uint16_t *src) {
+	unsigned int l;
+	uint32_t d, s, r, sub = 0;
+	uint16_t isMov = 0, stored = 0xffff, m;
+	uint8_t flags;
+
+	switch( op ) {
+		case OP_ADD_ER_IMM:
+		case OP_ADD_ER_ER:
+			break;
+		case OP_CMP_ER_ER:
+			sub = 0xffffffff;
+			stored = 0;
+			break;
+		default:
+			isMov = 0xffff;
+	}
+
+	FOR_LANES(l) {
+		d = ER(n, l);
+		s = src[l];
+		r = d + (s ^ sub) + (sub & 1);
+		flags = ((ls -> psw[l] & PSW_KEPT) | _flagsCarry16(d, s, r) | _flagsZS16(r)) & ~isMov;
+		flags |= ((ls -> psw[l] & ~(PSW_Z | PSW_S)) | _flagsZS16(s)) & isMov;
+		r = (r & ~isMov) | (s & isMov);
+		ls -> psw[l] = PICK(l, flags, ls -> psw[l]);
+		m = MASK16(l) & stored;
+		ls -> gr[n][l] = ((uint8_t)r & m) | (ls -> gr[n][l] & ~m);
+		ls -> gr[n + 1][l] = ((uint8_t)(r >> 8) & m) | (ls -> gr[n + 1][l] & ~m);
+	}
+}
+
+// What `RETIRE()` in `core.c` does, for the lanes that have run an instruction taking `cycles[l]`
+static inline void _lockstepRetire(Lockstep_t *ls, const int *cycles) {
+	unsigned int l;
+	int left;
+
+	FOR_LANES(l) {
+		left = ls -> intMaskCycle[l] - cycles[l];
+		left &= -(int)(left >= 0);
+		ls -> intMaskCycle[l] = (left & MASK32(l)) | (ls -> intMaskCycle[l] & ~MASK32(l));
+		ls -> cycles[l] += cycles[l] & MASK32(l);
+		ls -> eaIncDelay[l] &= ~ls -> mask[l];
+		ls -> nextAccess[l] = PICK(l, DATA_ACCESS_PAGE0, ls -> nextAccess[l]);
+	}
+}
+
+// Runs `insn` on the lanes in `ls -> mask`
+// Only instructions that touch nothing but the lane-wise registers can be run this way.
+// Returns false if `insn` isn't one of them, the lanes haven't been changed then.
+static bool _lockstepExecute(Lockstep_t *ls, const CoreInstruction_t *insn) {
+	unsigned int l;
+	uint8_t n = insn -> dest, m = insn -> src, op = insn -> op;
+	uint8_t imm8[LOCKSTEP_LANES];
+	uint16_t imm16[LOCKSTEP_LANES], erMask, imm, taken;
+	int cycles[LOCKSTEP_LANES];
+	uint8_t bitsAnd, bitsOr, bitsXor, direct, isSigned, isEven, isAlways, bits;
+
+	switch( op ) {
+		case OP_NONE:
+		case OP_NOP:
+			break;
+
+		case OP_MOV_R_IMM:
+		case OP_AND_R_IMM:
+		case OP_OR_R_IMM:
+		case OP_XOR_R_IMM:
+			FOR_LANES(l) {
+				imm8[l] = insn -> imm;
+			}
+			_lockstepLogic8(ls, op, n, imm8);
+			break;
+
+		case OP_MOV_R_R:
+		case OP_AND_R_R:
+		case OP_OR_R_R:
+		case OP_XOR_R_R:
+			FOR_LANES(l) {
+				imm8[l] = ls -> gr[m][l];
+			}
+			_lockstepLogic8(ls, op, n, imm8);
+			break;
+
+		case OP_ADD_R_IMM:
+		case OP_ADDC_R_IMM:
+		case OP_CMP_R_IMM:
+		case OP_CMPC_R_IMM:
+			FOR_LANES(l) {
+				imm8[l] = insn -> imm;
+			}
+			switch( op ) {
+				case OP_ADD_R_IMM:
+					_lockstepArith8(ls, n, imm8, false, false, true);
+					break;
+				case OP_ADDC_R_IMM:
+					_lockstepArith8(ls, n, imm8, false, true, true);
+					break;
+				case OP_CMP_R_IMM:
+					_lockstepArith8(ls, n, imm8, true, false, false);
+					break;
+				default:
+					_lockstepArith8(ls, n, imm8, true, true, false);
+			}
+			break;
+
+		case OP_ADD_R_R:
+		case OP_ADDC_R_R:
+		case OP_SUB_R_R:
+		case OP_SUBC_R_R:
+		case OP_CMP_R_R:
+		case OP_CMPC_R_R:
+			FOR_LANES(l) {
+				imm8[l] = ls -> gr[m][l];
+			}
+			switch( op ) {
+				case OP_ADD_R_R:
+					_lockstepArith8(ls, n, imm8, false, false, true);
+					break;
+				case OP_ADDC_R_R:
+					_lockstepArith8(ls, n, imm8, false, true, true);
+					break;
+				case OP_SUB_R_R:
+					_lockstepArith8(ls, n, imm8, true, false, true);
+					break;
+				case OP_SUBC_R_R:
+					_lockstepArith8(ls, n, imm8, true, true, true);
+					break;
+				case OP_CMP_R_R:
+					_lockstepArith8(ls, n, imm8, true, false, false);
+					break;
+				default:
+					_lockstepArith8(ls, n, imm8, true, true, false);
+			}
+			break;
+
+		case OP_MOV_ER_IMM:
+		case OP_ADD_ER_IMM:
+			FOR_LANES(l) {
+				imm16[l] = insn -> imm;
+			}
+			_lockstepALU16(ls, op, n & 0x0e, imm16);
+			break;
+
+		case OP_MOV_ER_ER:
+		case OP_ADD_ER_ER:
+		case OP_CMP_ER_ER:
+			FOR_LANES(l) {
+				imm16[l] = ER(m & 0x0e, l);
+			}
+			_lockstepALU16(ls, op, n & 0x0e, imm16);
+			break;
+
+		case OP_LEA_ER:
+		case OP_LEA_D16:
+		case OP_LEA_ADR:
+			// EA = (ERm & erMask) + imm
+			erMask = (op == OP_LEA_ADR)? 0 : 0xffff;
+			imm = (op == OP_LEA_ER)? 0 : insn -> imm;
+			FOR_LANES(l) {
+				ls -> ea[l] = PICK16(l, (uint16_t)((ER(m & 0x0e, l) & erMask) + imm), ls -> ea[l]);
+			}
+			break;
+
+		case OP_RC:
+		case OP_SC:
+		case OP_CPLC:
+		case OP_DI:
+		case OP_EI:
+			// PSW = ((PSW & bitsAnd) | bitsOr) ^ bitsXor
+			bitsAnd = 0xff;
+			bitsOr = bitsXor = 0;
+			switch( op ) {
+				case OP_RC:
+					bitsAnd = (uint8_t)~PSW_C;
+					break;
+				case OP_SC:
+					bitsOr = PSW_C;
+					break;
+				case OP_CPLC:
+					bitsXor = PSW_C;
+					break;
+				case OP_DI:
+					bitsAnd = (uint8_t)~PSW_MIE;
+					break;
+				default:
+					bitsOr = PSW_MIE;
+			}
+			FOR_LANES(l) {
+				ls -> psw[l] = PICK(l, ((ls -> psw[l] & bitsAnd) | bitsOr) ^ bitsXor, ls -> psw[l]);
+			}
+			break;
+
+		default:
+			if( (op < OP_BGE) || (op > OP_BAL) )
+				return false;
+
+			// B<cond>, odd conditions branch when the bits they test are set, even ones when they're clear
+			// The bits are `(PSW & direct) | ((PSW >> 1 ^ PSW) & isSigned)`, OV ^ S for the signed ones.
+			direct = isSigned = 0;
+			switch( (op - OP_BGE) >> 1 ) {
+				case 0:		// GE, LT
+					direct = PSW_C;
+					break;
+				case 1:		// GT, LE
+					direct = PSW_C | PSW_Z;
+					break;
+				case 2:		// GES, LTS
+					isSigned = PSW_OV;
+					break;
+				case 3:		// GTS, LES
+					direct = PSW_Z;
+					isSigned = PSW_OV;
+					break;
+				case 4:		// NE, EQ
+					direct = PSW_Z;
+					break;
+				case 5:		// NV, OV
+					direct = PSW_OV;
+					break;
+				case 6:		// PS, NS
+					direct = PSW_S;
+					break;
+			}
+			isEven = !((op - OP_BGE) & 1);
+			isAlways = (op == OP_BAL);
+			imm = insn -> imm;
+			FOR_LANES(l) {
+				bits = (ls -> psw[l] & direct) | (((ls -> psw[l] >> 1) ^ ls -> psw[l]) & isSigned);
+				taken = ((bits != 0) ^ isEven) | isAlways;
+				ls -> pc[l] = PICK16(l, (uint16_t)(ls -> pc[l] + 2 + (imm & -taken)), ls -> pc[l]);
+				cycles[l] = insn -> cycles + taken * (3 - insn -> cycles);
+			}
+			_lockstepRetire(ls, cycles);
+			return true;
+	}
+
+	FOR_LANES(l) {
+		ls -> pc[l] = PICK16(l, (uint16_t)((ls -> pc[l] + (insn -> words << 1)) & 0xfffe), ls -> pc[l]);
+		cycles[l] = insn -> cycles;
+	}
+	_lockstepRetire(ls, cycles);
+	return true;
+}
+
+// Copies the registers of a lane from its context
+static void _lockstepLoadLane(Lockstep_t *ls, unsigned int lane) {
+	EmuContext_t *ctx = ls -> contexts[lane];
+	unsigned int n;
+
+	for( n = 0; n < 16; ++n ) {
+		ls -> gr[n][lane] = GR.rs[n];
+	}
+	ls -> psw[lane] = PSW.raw;
+	ls -> pc[lane] = PC;
+	ls -> csr[lane] = CSR;
+	ls -> ea[lane] = EA;
+	ls -> sp[lane] = SP;
+	ls -> intMaskCycle[lane] = ctx -> IntMaskCycle;
+	ls -> eaIncDelay[lane] = ctx -> EAIncDelay;
+	ls -> nextAccess[lane] = ctx -> NextAccess;
+}
+
+// Copies the registers of a lane back to its context
+static void _lockstepStoreLane(Lockstep_t *ls, unsigned int lane) {
+	EmuContext_t *ctx = ls -> contexts[lane];
+	unsigned int n;
+
+	for( n = 0; n < 16; ++n ) {
+		GR.rs[n] = ls -> gr[n][lane];
+	}
+	PSW.raw = ls -> psw[lane];
+	PC = ls -> pc[lane];
+	CSR = ls -> csr[lane];
+	EA = ls -> ea[lane];
+	SP = ls -> sp[lane];
+	ctx -> IntMaskCycle = ls -> intMaskCycle[lane];
+	ctx -> EAIncDelay = ls -> eaIncDelay[lane];
+	ctx -> NextAccess = ls -> nextAccess[lane];
+}
+
+// Runs one instruction of a lane on its own context
+static void _lockstepStepLane(Lockstep_t *ls, unsigned int lane) {
+	_lockstepStoreLane(ls, lane);
+	ls -> status[lane] = coreStep(ls -> contexts[lane]);
+	ls -> cycles[lane] += ls -> contexts[lane] -> CycleCount;
+	_lockstepLoadLane(ls, lane);
+}
+
+// Puts the running lanes at the same CSR:PC as `lane` into `ls -> mask`
+// Returns how many there are.
+static unsigned int _lockstepMatch(Lockstep_t *ls, unsigned int lane) {
+	unsigned int l, count = 0;
+	PC_t pc = ls -> pc[lane];
+	SR_t csr = ls -> csr[lane];
+
+	FOR_LANES(l) {
+		ls -> mask[l] = (uint8_t)-(uint8_t)((ls -> pc[l] == pc) & (ls -> csr[l] == csr) & (ls -> status[l] == CORE_OK));
+	}
+#ifdef CORE_INTC
+	// `coreStep()` takes the interrupt first
+	for( l = 0; l < ls -> laneCount; ++l ) {
+		if( ls -> contexts[l] -> IntcRequest | INTC_IS_RAISED(ls -> contexts[l]) )
+			ls -> mask[l] = 0;
+	}
+#endif
+	FOR_LANES(l) {
+		count += ls -> mask[l] & 1;
+	}
+	return count;
+}
+
+// Picks the lanes that run the next instruction lane-wise
+// The leader is kept as long as at least half of the running lanes are with it,
+// otherwise the lane with the biggest group becomes the leader.
+// Returns how many lanes are still running.
+static unsigned int _lockstepGroup(Lockstep_t *ls) {
+	unsigned int l, running = 0, count, best, bestCount;
+
+	for( l = 0; l < ls -> laneCount; ++l ) {
+		if( ls -> status[l] == CORE_OK ) {
+			if( ls -> status[ls -> leader] != CORE_OK )
+				ls -> leader = l;
+			++running;
+		}
+	}
+	if( running == 0 )
+		return 0;
+
+	count = _lockstepMatch(ls, ls -> leader);
+	if( count * 2 >= running )
+		return running;
+
+	best = ls -> leader;
+	bestCount = count;
+	for( l = 0; l < ls -> laneCount; ++l ) {
+		if( (ls -> status[l] != CORE_OK) || ((ls -> pc[l] == ls -> pc[best]) && (ls -> csr[l] == ls -> csr[best])) )
+			continue;
+		count = _lockstepMatch(ls, l);
+		if( count > bestCount ) {
+			best = l;
+			bestCount = count;
+		}
+	}
+	ls -> leader = best;
+	_lockstepMatch(ls, best);
+	return running;
+}
+
+
+// Sets up lanes for `count` contexts, which must share the same code memory
+// The contexts should have been reset. Lanes which share CSR:PC run together.
+LOCKSTEP_STATUS lockstepInit(Lockstep_t *ls, EmuContext_t * const *contexts, unsigned int count) {
+	unsigned int l, n;
+
+	if( count > LOCKSTEP_LANES )
+		return LOCKSTEP_TOO_MANY_LANES;
+
+	for( l = 0; l < count; ++l ) {
+		if( contexts[l] -> IsMemoryInited == false )
+			return LOCKSTEP_MEMORY_UNINITIALIZED;
+		if( contexts[l] -> CodeMemory != contexts[0] -> CodeMemory )
+			return LOCKSTEP_CODE_NOT_SHARED;
+#ifdef CORE_DUAL_VARIANT
+		if( contexts[l] -> IsU16 != contexts[0] -> IsU16 )
+			return LOCKSTEP_CODE_NOT_SHARED;
+#endif
+	}
+
+	ls -> laneCount = count;
+	ls -> leader = 0;
+	FOR_LANES(l) {
+		ls -> contexts[l] = (l < count)? contexts[l] : NULL;
+		ls -> status[l] = (l < count)? CORE_OK : CORE_MEMORY_UNINITIALIZED;
+		for( n = 0; n < 16; ++n ) {
+			ls -> gr[n][l] = 0;
+		}
+		ls -> psw[l] = 0;
+		ls -> pc[l] = 0;
+		ls -> csr[l] = 0;
+		ls -> ea[l] = 0;
+		ls -> sp[l] = 0;
+		ls -> intMaskCycle[l] = 0;
+		ls -> eaIncDelay[l] = 0;
+		ls -> nextAccess[l] = DATA_ACCESS_PAGE0;
+		ls -> cycles[l] = 0;
+		ls -> mask[l] = 0;
+	}
+
+	return LOCKSTEP_OK;
+}
+
+// Runs `count` instructions on every lane, the same as calling `coreStep()` on each context `count` times
+// A lane stops early once an instruction doesn't return `CORE_OK`, and keeps the status in `ls -> status`.
+// `CycleCount` of each context is set to the cycles taken by all the instructions it has run.
+// Returns how many lanes are still running.
+unsigned int lockstepRun(Lockstep_t *ls, unsigned int count) {
+	const CoreInstruction_t *insn;
+	unsigned int l, running = 0;
+	bool isLaneWise;
+
+	for( l = 0; l < ls -> laneCount; ++l ) {
+		_lockstepLoadLane(ls, l);
+		ls -> cycles[l] = 0;
+	}
+
+	while( count-- != 0 ) {
+		if( (running = _lockstepGroup(ls)) == 0 )
+			break;
+
+		insn = coreFetchDecoded(ls -> contexts[ls -> leader], ls -> csr[ls -> leader], ls -> pc[ls -> leader]);
+		isLaneWise = _lockstepExecute(ls, insn);
+
+		// the rest, one lane at a time
+		for( l = 0; l < ls -> laneCount; ++l ) {
+			if( (ls -> status[l] == CORE_OK) && !(isLaneWise && ls -> mask[l]) )
+				_lockstepStepLane(ls, l);
+		}
+	}
+
+	running = 0;
+	for( l = 0; l < ls -> laneCount; ++l ) {
+		_lockstepStoreLane(ls, l);
+		ls -> contexts[l] -> CycleCount = ls -> cycles[l];
+		if( ls -> status[l] == CORE_OK )
+			++running;
+	}
+	return running;
+}
@@ -0,0 +1,59 @@
+#ifndef LOCKSTEP_H_INCLUDED
+#define LOCKSTEP_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "regtypes.h"
+#include "coretypes.h"
+#include "contexttypes.h"
+
+
+// Lanes of a `Lockstep_t`
+// Keep it a multiple of 32, so that lane loops fill whole AVX2 (or SSE) registers.
+#define LOCKSTEP_LANES 32
+
+typedef enum {
+	LOCKSTEP_OK,
+	LOCKSTEP_TOO_MANY_LANES,
+	LOCKSTEP_CODE_NOT_SHARED,	// lanes must run the same ROM on the same core, see `memoryInitShared()`
+	LOCKSTEP_MEMORY_UNINITIALIZED
+} LOCKSTEP_STATUS;
+
+// Several contexts running the same ROM, stepped together
+// While `lockstepRun()` runs, the registers below belong to the lanes and the ones in the contexts are stale.
+// Lanes whose CSR:PC agree run register-only instructions as one lane-wise loop, which the compiler turns into SIMD code;
+// anything else, and every lane that has diverged, is run by `coreStep()` on its own context.
+// Like contexts, it's big, so don't put it on the stack.
+typedef struct {
+	unsigned int laneCount;
+	unsigned int leader;	// lane whose CSR:PC the others are compared with
+	EmuContext_t *contexts[LOCKSTEP_LANES];
+	CORE_STATUS status[LOCKSTEP_LANES];	// a lane stops once an instruction doesn't return `CORE_OK`, unused lanes never run
+
+	// registers, `gr[n][lane]` is Rn of a lane
+	// They're lowercase so that the register macros in `core.h` leave them alone.
+	uint8_t gr[16][LOCKSTEP_LANES];
+	uint8_t psw[LOCKSTEP_LANES];
+	PC_t pc[LOCKSTEP_LANES];
+	SR_t csr[LOCKSTEP_LANES];
+	EA_t ea[LOCKSTEP_LANES];
+	EA_t sp[LOCKSTEP_LANES];
+
+	// hidden core states, see `context.h`
+	int intMaskCycle[LOCKSTEP_LANES];
+	uint8_t eaIncDelay[LOCKSTEP_LANES];
+	uint8_t nextAccess[LOCKSTEP_LANES];
+	int cycles[LOCKSTEP_LANES];	// taken in the current `lockstepRun()`
+
+	// 0xff for lanes that run the current instruction lane-wise, 0 for the others
+	uint8_t mask[LOCKSTEP_LANES];
+} Lockstep_t;
+
+
+LOCKSTEP_STATUS lockstepInit(Lockstep_t *ls, EmuContext_t * const *contexts, unsigned int count);
+unsigned int lockstepRun(Lockstep_t *ls, unsigned int count);
+
+
+#endif
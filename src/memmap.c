@@ -3,11 +3,13 @@
 
 #include "memmap.h"
 #include "mmu.h"
+#include "intc.h"
+#include "context.h"
 
 
 // Handler for mismatched addresses
-uint8_t defaultHandler(uint32_t address, uint8_t data, bool isWrite) {
-	MemoryStatus = MEMORY_UNMAPPED;
+uint8_t defaultHandler(EmuContext_t *ctx, uint32_t address, uint8_t data, bool isWrite) {
+	ctx -> MemoryStatus = MEMORY_UNMAPPED;
 	return 0;
 }
 
@@ -16,58 +18,99 @@ uint8_t defaultHandler(uint32_t address, uint8_t data, bool isWrite) {
 // The handlers must be of the type `DataMemoryHandler_t`.
 // The handlers must *not* be `inline`.
 
-static uint8_t codeSegHandler(uint32_t address, uint8_t data, bool isWrite) {
+static uint8_t codeSegHandler(EmuContext_t *ctx, uint32_t address, uint8_t data, bool isWrite) {
+	uint32_t segment = (address >> 16) & ctx -> Model.codeMirrorMask;
+
 	if( isWrite ) {
-		MemoryStatus = MEMORY_READ_ONLY;
+		ctx -> MemoryStatus = MEMORY_READ_ONLY;
+		return 0;
+	}
+
+	if( segment >= ctx -> Model.codePageCount ) {
+		ctx -> MemoryStatus = MEMORY_UNMAPPED;
 		return 0;
 	}
 
-	return *((uint8_t *)CodeMemory + (address & 0x1ffff));
+	return *((uint8_t *)ctx -> CodeMemory + (segment << 16) + (address & 0xffff));
 }
 
-static uint8_t romWindowHandler(uint32_t address, uint8_t data, bool isWrite) {
-	++ROMWinAccessCount;
-	MemoryStatus = MEMORY_ROM_WINDOW;
+static uint8_t romWindowHandler(EmuContext_t *ctx, uint32_t address, uint8_t data, bool isWrite) {
+	++ctx -> ROMWinAccessCount;
+	ctx -> MemoryStatus = MEMORY_ROM_WINDOW;
 
-	return codeSegHandler(address, data, isWrite);
+	return codeSegHandler(ctx, address, data, isWrite);
 }
 
-static uint8_t RAMHandler(uint32_t address, uint8_t data, bool isWrite) {
-	uint8_t *p = (uint8_t *)DataMemory + address - ROM_WINDOW_SIZE;
+uint8_t RAMHandler(EmuContext_t *ctx, uint32_t address, uint8_t data, bool isWrite) {
+	uint32_t offset = address - ROM_WINDOW_SIZE;
+	unsigned int page = offset / DATA_PAGE_SIZE;
 
 	if( isWrite ) {
-		*p = data;
+		// a page shared with forked contexts gets copied first
+		if( (ctx -> DataPagesShared >> page) & 1 )
+			memoryOwnDataPage(ctx, page);
+		ctx -> DataPages[page][offset % DATA_PAGE_SIZE] = data;
 		return 0;
 	}
 	else {
-		return *p;
+		return ctx -> DataPages[page][offset % DATA_PAGE_SIZE];
 	}
 }
 
-static uint8_t VRAMHandler(uint32_t address, uint8_t data, bool isWrite) {
+static uint8_t VRAMHandler(EmuContext_t *ctx, uint32_t address, uint8_t data, bool isWrite) {
 	if( (address & 0xF) >= 0xC ) {	// unmapped region of VRAM
 		if( isWrite ) {
-			MemoryStatus = MEMORY_UNMAPPED;
+			ctx -> MemoryStatus = MEMORY_UNMAPPED;
 		}
 		return 0;
 	}
 
-	return RAMHandler(address, data, isWrite);
+	return RAMHandler(ctx, address, data, isWrite);
 }
 
-// Define your memory regions here. Mismatched addresses defaults to unmapped addresses
-// Note that you shouldn't change the name of it.
+// Define your memory models here. Mismatched addresses defaults to unmapped addresses
+// Note that you shouldn't change the name of them, the first one is what `memoryInit()` uses.
 // I stole the idea from FraserBc :P
+const MemoryModel_t MEMORY_MODELS[MEMORY_MODEL_COUNT] = {
+	// default memory map, for real ES+
+	{
+		.name = "es_plus",
+		.romWindowSize = 0x8000,
+		.codePageCount = 2,
+		.codeMirrorMask = 0x01,
+#ifdef CORE_INTC
+		.regionCount = 8,
+#else
+		.regionCount = 7,
+#endif
+		.regions = {
+		//	start		end +1		handler			kind
+			{0x08000,	0x08e00,	RAMHandler,		DATA_REGION_RAM},	// ES+ RAM
+			{0x0f800,	0x0fa00,	VRAMHandler},		// ES+ VRAM
+#ifdef CORE_INTC
+			{INTC_IE_ADDRESS,	INTC_IRQ_ADDRESS + INTC_REGISTER_COUNT,	intcHandler},	// IE and IRQ
+#endif
+			{0x0f000,	0x0f050,	SFRHandler},		// ES+ SFRs
+			{0x00000,	0x08000,	romWindowHandler,	DATA_REGION_ROM_WINDOW},	// ROM window handler
+			{0x10000,	0x20000,	codeSegHandler,		DATA_REGION_ROM},	// segment 1
+			{0x80000,	0xa0000,	codeSegHandler,		DATA_REGION_ROM},	// segment 8+
+
+			{0x000000,	0x1000000,	defaultHandler}		// unmapped regions
+		}
+	}
+};
 
-// default memory map, for real ES+
-const DataMemoryRegion_t DATA_MEMORY_MAP[DATA_MEMORY_REGION_COUNT] = {
-//	start		end +1		handler
-	{0x08000,	0x08e00,	RAMHandler},		// ES+ RAM
-	{0x0f800,	0x0fa00,	VRAMHandler},		// ES+ VRAM
-	{0x0f000,	0x0f050,	SFRHandler},		// ES+ SFRs
-	{0x00000,	0x08000,	romWindowHandler},	// ROM window handler
-	{0x10000,	0x20000,	codeSegHandler},	// segment 1
-	{0x80000,	0xa0000,	codeSegHandler},	// segment 8+
-
-	{0x000000,	0x1000000,	defaultHandler}		// unmapped regions
+// Handlers that text descriptions of models can name, see `memoryParseModel()`
+// Add yours here to use them in descriptions.
+const MemoryHandlerName_t MEMORY_HANDLERS[MEMORY_HANDLER_COUNT] = {
+//	name		handler			kind
+	{"ram",		RAMHandler,		DATA_REGION_RAM},
+	{"vram",	VRAMHandler},		// ES+ VRAM, the last 4 bytes of every 16 are unmapped
+	{"sfr",		SFRHandler},
+#ifdef CORE_INTC
+	{"intc",	intcHandler},
+#endif
+	{"rom_window",	romWindowHandler,	DATA_REGION_ROM_WINDOW},
+	{"code",	codeSegHandler,		DATA_REGION_ROM},
+	{"unmapped",	defaultHandler}
 };
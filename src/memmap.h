@@ -5,15 +5,61 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "contexttypes.h"
+#include "core.h"
 
+
+// Where data memory starts on segment 0, the smallest ROM window of any memory model
+// Contexts keep `[ROM_WINDOW_SIZE, 0x10000)` in `ctx -> DataMemory`, whichever model they run.
 #define ROM_WINDOW_SIZE 0x8000
 
-// On segment 1 and above, code and data memory accesses access the same physical memories
-// and an assumption is made here: I assume all pages above page 0 are read-only
+// Most code pages (64KiB each) of any memory model
+// With `CORE_PREDECODE`, every context keeps a decoded copy of this many pages.
 #define CODE_PAGE_COUNT 2
-#define DATA_PAGE_COUNT 2
 
-// mask for page mirrowing
+// Most regions of a memory model
+#define MEMORY_MODEL_REGIONS 16
+
+// number of entries in `MEMORY_MODELS` and `MEMORY_HANDLERS`
+#define MEMORY_MODEL_COUNT 1
+#ifdef CORE_INTC
+#define MEMORY_HANDLER_COUNT 7
+#else
+#define MEMORY_HANDLER_COUNT 6
+#endif
+
+
+// `uint8_t handler(EmuContext_t *ctx, uint32_t address, uint8_t data, bool isWrite);`
+// Modifies `ctx -> MemoryStatus`.
+// Returns the byte at `address`, or write `data` to `address` if `isWrite` is true.
+// `ctx` is the context doing the access, per-device peripheral state can hang off `ctx -> UserData`.
+// The handlers must *not* be `inline`.
+typedef uint8_t (*DataMemoryHandler_t)(EmuContext_t *, uint32_t, uint8_t, bool);
+
+// What accesses to a region may do instead of calling its handler, for every byte
+// It must be what the handler would have done.
+typedef enum {
+	DATA_REGION_HANDLER,		// nothing, there's only the handler
+	DATA_REGION_RAM,		// read and write `RAMHandler()`'s bytes
+	DATA_REGION_ROM,		// read code memory like `codeSegHandler()`, writes go to the handler
+	DATA_REGION_ROM_WINDOW		// the same, counted in `ctx -> ROMWinAccessCount` with `MEMORY_ROM_WINDOW`
+} DATA_REGION_KIND;
+
+// Defines data regions and their respective handlers
+typedef struct {
+	uint32_t start;
+	uint32_t end;
+	DataMemoryHandler_t handler;
+	DATA_REGION_KIND kind;		// may be left out for `DATA_REGION_HANDLER`
+} DataMemoryRegion_t;
+
+// Memory layout of a device, picked when a context is initialized, see `memoryInitModel()`
+// Take one of `MEMORY_MODELS` (by name with `memoryFindModel()`), or describe it in text (`memoryParseModel()`),
+// so one build runs the ROMs of different devices.
+//
+// On segment 1 and above, code and data memory accesses access the same physical memories
+// and an assumption is made here: I assume all pages above page 0 are read-only
+// `codeMirrorMask` is the mask for code page mirrowing
 // If there're 3 code pages (0~3), mirrow mask should be set to 0x03
 // real page < 3, mirrowed page > mask
 /* Page	| Type
@@ -26,35 +72,88 @@
  * 6	| mirrow
  * 7	| mirrow
  */
-#define CODE_MIRROW_MASK 0x01
-#define DATA_MIRROW_MASK 0x07
+// Data segments mirror code pages through regions using `codeSegHandler()`.
+typedef struct {
+	char name[32];
+	uint32_t romWindowSize;		// data memory is `[romWindowSize, 0x10000)`, which data files hold, at least `ROM_WINDOW_SIZE`
+	uint8_t codePageCount;		// at most `CODE_PAGE_COUNT`
+	uint8_t codeMirrorMask;
+	uint8_t regionCount;		// at most `MEMORY_MODEL_REGIONS`
+	DataMemoryRegion_t regions[MEMORY_MODEL_REGIONS];	// the first one matching an address wins it
+} MemoryModel_t;
+
+// A handler that text descriptions of models name, see `memoryParseModel()`
+typedef struct {
+	const char *name;
+	DataMemoryHandler_t handler;
+	DATA_REGION_KIND kind;
+} MemoryHandlerName_t;
 
-// number of entries in `DATA_MEMORY_MAP`
-#define DATA_MEMORY_REGION_COUNT 7
+// The regions of a model are turned into a table of 256-byte pages when memory is initialized, see `mmu.c`
+// Segments laid out the same way share a page table, this many different ones are kept.
+#define MEMORY_PAGE_TABLES 8
+// Pages that are split between regions look their handler up byte by byte, this many of them are kept.
+#define MEMORY_SPLIT_PAGES 8
 
+// One page of data memory
+typedef struct {
+	DataMemoryHandler_t handler;	// NULL if the page is split between regions
+	uint8_t *host;			// where its bytes are in host memory, unless it's `DATA_REGION_HANDLER`
+	uint8_t kind;			// `DATA_REGION_KIND` of its region
+	uint8_t split;			// if it's split, the one of `ctx -> MemorySplitPages` with its handlers
+	bool isShared;			// its RAM is shared with forked contexts, so writes go to the handler
+	bool isWatched;			// a watch has some of its bytes, so accesses to it are checked, see `memoryAddWatch()`
+	uint16_t data;			// for RAM, where its first byte is in data memory
+} DataMemoryPage_t;
+
+// Data memory is kept in pages of this size, forked contexts share the ones neither of them has written, see `memoryFork()`
+#define DATA_PAGE_SIZE 0x1000
+#define DATA_MEMORY_PAGES ((0x10000 - ROM_WINDOW_SIZE) / DATA_PAGE_SIZE)
+
+// A page of data memory outside of `ctx -> DataMemory`, shared by the contexts that have forked from each other
+typedef struct {
+	unsigned int refs;		// contexts using it
+	uint8_t bytes[DATA_PAGE_SIZE];
+} SharedDataPage_t;
 
-// `uint8_t handler(uint32_t address, uint8_t data, bool isWrite);`
-// Modifies `MemoryStatus`.
-// Returns the byte at `address`, or write `data` to `address` if `isWrite` is true.
-// The handlers must *not* be `inline`.
-typedef uint8_t (*DataMemoryHandler_t)(uint32_t, uint8_t, bool);
 
-// Defines data regions and their respective handlers
+// Data watchpoints kept by each context, see `memoryAddWatch()`
+#define MEMORY_WATCHES 8
+#define MEMORY_WATCH_READ 0x01
+#define MEMORY_WATCH_WRITE 0x02
+#define MEMORY_WATCH_VALUE 0x04		// only accesses leaving the watched bytes at `value` hit
+
 typedef struct {
-	uint32_t start;
+	uint32_t start;			// flat addresses (segment << 16 | offset) of the watched bytes
 	uint32_t end;
-	DataMemoryHandler_t handler;
-} DataMemoryRegion_t;
+	uint8_t flags;			// `MEMORY_WATCH_*`
+	uint64_t value;
+} MemoryWatch_t;
+
+// The access that hit a watch, kept until the next hit once `coreRun()` has stopped with `CORE_STOP_WATCH`
+typedef struct {
+	MemoryWatch_t watch;		// the watch it hit
+	uint32_t address;		// flat address of the access
+	uint8_t size;
+	bool isWrite;
+	uint64_t oldValue;		// what the watched bytes (the first 8) held before, only known for RAM and ROM, read accesses leave it as `newValue`
+	uint64_t newValue;		// what they hold after the access
+	SR_t csr;			// where the core was, `pc` is past the first word of the instruction doing the access
+	PC_t pc;
+} MemoryWatchHit_t;
 
 
-extern const DataMemoryRegion_t DATA_MEMORY_MAP[DATA_MEMORY_REGION_COUNT];
+extern const MemoryModel_t MEMORY_MODELS[MEMORY_MODEL_COUNT];
+extern const MemoryHandlerName_t MEMORY_HANDLERS[MEMORY_HANDLER_COUNT];
 
 
-uint8_t defaultHandler(uint32_t address, uint8_t data, bool isWrite);
+uint8_t defaultHandler(EmuContext_t *ctx, uint32_t address, uint8_t data, bool isWrite);
+// Standard RAM handler, address `ROM_WINDOW_SIZE` is the first byte of data memory (see `ctx -> DataPages`)
+uint8_t RAMHandler(EmuContext_t *ctx, uint32_t address, uint8_t data, bool isWrite);
 
 // All peripherals interact with memory via this function
 // Implement this yourself
-extern uint8_t SFRHandler(uint32_t address, uint8_t data, bool isWrite);
+extern uint8_t SFRHandler(EmuContext_t *ctx, uint32_t address, uint8_t data, bool isWrite);
 
 
 #endif
@@ -13,7 +13,10 @@ typedef enum {
 	MEMORY_ROM_WINDOW,
 	MEMORY_MIRROWED_BANK,
 	MEMORY_UNALIGNED,
-	MEMORY_READ_ONLY
+	MEMORY_READ_ONLY,
+	MEMORY_MAP_TOO_COMPLEX,		// the memory model needs more than `MEMORY_PAGE_TABLES`/`MEMORY_SPLIT_PAGES`
+	MEMORY_TOO_MANY_WATCHES,	// there are `MEMORY_WATCHES` already
+	MEMORY_MODEL_INVALID		// the memory model doesn't fit this build or makes no sense, see `memoryCheckModel()`
 } MEMORY_STATUS;
 
 
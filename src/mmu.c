@@ -1,144 +1,804 @@
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 
 #include "regtypes.h"
 #include "memtypes.h"
 #include "mmustub.h"
 #include "memmap.h"
+#include "mmu.h"
+#include "trace.h"
+#include "context.h"
 
 
-void *CodeMemory = NULL;
-void *DataMemory = NULL;
-bool IsMemoryInited = false;
-// Status of last memory operation
-MEMORY_STATUS MemoryStatus;
-// Tracks how many ROM window access has happened
-unsigned int ROMWinAccessCount = 0;
+// Shared pages of data memory are dropped by whichever context lets go of them last, on whatever thread runs it
+#if defined(__GNUC__) || defined(__clang__)
+	#define REFS_ADD(refs, n) __atomic_add_fetch(&(refs), (n), __ATOMIC_ACQ_REL)
+	#define REFS_GET(refs) __atomic_load_n(&(refs), __ATOMIC_ACQUIRE)
+#else
+	// contexts forked from each other must run on the same thread then
+	#define REFS_ADD(refs, n) ((refs) += (n))
+	#define REFS_GET(refs) (refs)
+#endif
 
 
-// Initializes `CodeMemory` and `DataMemory`.
-MEMORY_STATUS memoryInit(stub_MMUFileID_t codeFileID, stub_MMUFileID_t dataFileID) {
+// What addresses no region of the model has are
+static const DataMemoryRegion_t UNMAPPED_REGION = {0x000000, 0x1000000, defaultHandler};
+
+// Returns the index of the region of `ctx -> Model` matching `address`, `regionCount` if there's none
+static unsigned int _memoryRegionIndex(const EmuContext_t *ctx, uint32_t address) {
+	unsigned int index;
+	const DataMemoryRegion_t *p = ctx -> Model.regions;
+
+	for( index = 0; index < ctx -> Model.regionCount; ++index ) {
+		if( (address >= p -> start) && (address < p -> end) )
+			break;
+		++p;
+	}
+	return index;
+}
+
+// Looks up `address` in the regions of `ctx -> Model`.
+// Returns a pointer to matching entry for `address`
+// Only used to build the page tables, accesses go through `_memoryPage()`.
+static const DataMemoryRegion_t * lookupRegion(const EmuContext_t *ctx, uint32_t address) {
+	unsigned int index = _memoryRegionIndex(ctx, address);
+
+	return (index < ctx -> Model.regionCount)? &ctx -> Model.regions[index] : &UNMAPPED_REGION;
+}
+
+// Fills in `page`, the one starting at `address`
+// Returns false if there's no split page left for it.
+static bool _memoryBuildPage(EmuContext_t *ctx, DataMemoryPage_t *page, uint32_t address, unsigned int *splitCount) {
+	const DataMemoryRegion_t *p, *end = ctx -> Model.regions + ctx -> Model.regionCount;
+	DataMemoryHandler_t bytes[0x100];
+	unsigned int i, split, segment;
+
+	// the first region that has anything in the page wins it all, if it has all of it
+	for( p = ctx -> Model.regions; p < end; ++p ) {
+		if( (p -> start < address + 0x100) && (p -> end > address) )
+			break;
+	}
+	page -> split = 0;
+	page -> host = NULL;
+	page -> kind = DATA_REGION_HANDLER;
+	page -> isShared = false;
+	page -> isWatched = false;
+	page -> data = 0;
+	if( (p < end) && (p -> start <= address) && (p -> end >= address + 0x100) ) {
+		page -> handler = p -> handler;
+		page -> kind = p -> kind;
+		// the same bytes `RAMHandler()` and `codeSegHandler()` access
+		switch( p -> kind ) {
+			case DATA_REGION_RAM:
+				page -> data = (uint16_t)(address - ROM_WINDOW_SIZE);
+				page -> host = ctx -> DataPages[page -> data / DATA_PAGE_SIZE] + page -> data % DATA_PAGE_SIZE;
+				break;
+			case DATA_REGION_ROM:
+			case DATA_REGION_ROM_WINDOW:
+				// unmapped code pages are left to the handler
+				segment = (address >> 16) & ctx -> Model.codeMirrorMask;
+				if( segment >= ctx -> Model.codePageCount ) {
+					page -> kind = DATA_REGION_HANDLER;
+					break;
+				}
+				page -> host = (uint8_t *)ctx -> CodeMemory + ((uint32_t)segment << 16) + (address & 0xffff);
+				break;
+			default:
+				break;
+		}
+		return true;
+	}
+
+	// otherwise every byte gets its own, pages split the same way share them
+	page -> handler = NULL;
+	for( i = 0; i < 0x100; ++i ) {
+		bytes[i] = lookupRegion(ctx, address + i) -> handler;
+	}
+	for( split = 0; split < *splitCount; ++split ) {
+		for( i = 0; (i < 0x100) && (ctx -> MemorySplitPages[split][i] == bytes[i]); ++i )
+			;
+		if( i == 0x100 )
+			break;
+	}
+	if( split == *splitCount ) {
+		if( split == MEMORY_SPLIT_PAGES )
+			return false;
+		for( i = 0; i < 0x100; ++i ) {
+			ctx -> MemorySplitPages[split][i] = bytes[i];
+		}
+		++*splitCount;
+	}
+	page -> split = split;
+	return true;
+}
+
+// Sets `isWatched` on the pages with watched bytes, and clears it on the others
+// Segments sharing a page table share the marks, the watches are checked byte by byte anyway.
+static void _memoryMarkWatches(EmuContext_t *ctx) {
+	const MemoryWatch_t *watch;
+	unsigned int table, page;
+	uint32_t address;
+
+	for( table = 0; table < ctx -> MemoryPageTableCount; ++table ) {
+		for( page = 0; page < 0x100; ++page ) {
+			ctx -> MemoryPageTables[table][page].isWatched = false;
+		}
+	}
+
+	for( watch = ctx -> Watches; watch < ctx -> Watches + ctx -> WatchCount; ++watch ) {
+		for( address = watch -> start & ~(uint32_t)0xff; address < watch -> end; address += 0x100 ) {
+			ctx -> MemoryPageTables[ctx -> MemorySegments[(address >> 16) & 0xff]][(address >> 8) & 0xff].isWatched = true;
+		}
+	}
+}
+
+// Turns the regions of `ctx -> Model` into page tables, so that an access finds its handler without searching the map
+// Segments whose pages all match share one table. `CodeMemory` and `DataPages` must be set up.
+static MEMORY_STATUS _memoryBuildPageTables(EmuContext_t *ctx) {
+	DataMemoryPage_t *table;
+	unsigned int segment, page, other, tableCount = 0, splitCount = 0;
+
+	for( segment = 0; segment < 0x100; ++segment ) {
+		if( tableCount == MEMORY_PAGE_TABLES )
+			return MEMORY_MAP_TOO_COMPLEX;
+
+		table = ctx -> MemoryPageTables[tableCount];
+		for( page = 0; page < 0x100; ++page ) {
+			if( !_memoryBuildPage(ctx, &table[page], (segment << 16) | (page << 8), &splitCount) )
+				return MEMORY_MAP_TOO_COMPLEX;
+		}
+
+		for( other = 0; other < tableCount; ++other ) {
+			for( page = 0; page < 0x100; ++page ) {
+				if( (ctx -> MemoryPageTables[other][page].handler != table[page].handler) ||
+					(ctx -> MemoryPageTables[other][page].host != table[page].host) ||
+					(ctx -> MemoryPageTables[other][page].split != table[page].split) )
+					break;
+			}
+			if( page == 0x100 )
+				break;
+		}
+		ctx -> MemorySegments[segment] = other;
+		if( other == tableCount )
+			++tableCount;
+	}
+	ctx -> MemoryPageTableCount = tableCount;
+	ctx -> MemorySplitPageCount = splitCount;
+	_memoryMarkWatches(ctx);
+	return MEMORY_OK;
+}
+
+// Points the RAM pages of the page tables at where the pages of data memory in `mask` (bit n for `ctx -> DataPages[n]`) are now
+static void _memoryMapDataPages(EmuContext_t *ctx, uint32_t mask) {
+	DataMemoryPage_t *page;
+	unsigned int table, index;
+
+	for( table = 0; table < ctx -> MemoryPageTableCount; ++table ) {
+		for( page = ctx -> MemoryPageTables[table]; page < ctx -> MemoryPageTables[table] + 0x100; ++page ) {
+			index = page -> data / DATA_PAGE_SIZE;
+			if( (page -> kind == DATA_REGION_RAM) && ((mask >> index) & 1) ) {
+				page -> host = ctx -> DataPages[index] + page -> data % DATA_PAGE_SIZE;
+				page -> isShared = (ctx -> DataPagesShared >> index) & 1;
+			}
+		}
+	}
+}
+
+// Puts every page of data memory in its place in `ctx -> DataMemory`
+static void _memorySetDataPages(EmuContext_t *ctx) {
+	unsigned int i;
+
+	for( i = 0; i < DATA_MEMORY_PAGES; ++i ) {
+		ctx -> DataPages[i] = ctx -> DataMemory + i * DATA_PAGE_SIZE;
+		ctx -> DataPageBlocks[i] = NULL;
+	}
+	ctx -> DataPagesShared = 0;
+}
+
+// Lets go of a shared page, freeing it if no other context uses it
+static void _memoryDropDataPage(SharedDataPage_t *block) {
+	if( REFS_ADD(block -> refs, -1) == 0 )
+		free(block);
+}
+
+// Moves every page of data memory back into `ctx -> DataMemory`, and lets go of the shared ones
+// Their bytes are copied over if `isKept`, otherwise `DataMemory` has just been loaded.
+static void _memoryGatherDataPages(EmuContext_t *ctx, bool isKept) {
+	unsigned int i;
+	uint32_t moved = 0;
+
+	for( i = 0; i < DATA_MEMORY_PAGES; ++i ) {
+		if( ctx -> DataPageBlocks[i] != NULL ) {
+			if( isKept )
+				memcpy(ctx -> DataMemory + i * DATA_PAGE_SIZE, ctx -> DataPages[i], DATA_PAGE_SIZE);
+			_memoryDropDataPage(ctx -> DataPageBlocks[i]);
+			moved |= (uint32_t)1 << i;
+		}
+	}
+	_memorySetDataPages(ctx);
+	if( moved != 0 )
+		_memoryMapDataPages(ctx, moved);
+}
+
+// Returns the page `address` is in
+static inline const DataMemoryPage_t* _memoryPage(EmuContext_t *ctx, uint32_t address) {
+	return &ctx -> MemoryPageTables[ctx -> MemorySegments[(address >> 16) & 0xff]][(address >> 8) & 0xff];
+}
+
+// Returns the handler of `address`
+static inline DataMemoryHandler_t _memoryHandler(EmuContext_t *ctx, uint32_t address) {
+	const DataMemoryPage_t *page = _memoryPage(ctx, address);
+
+	return (page -> handler != NULL)? page -> handler : ctx -> MemorySplitPages[page -> split][address & 0xff];
+}
+
+// Reads `size` bytes at `p`, little-endian like the core
+static inline uint64_t _memoryLoad(const uint8_t *p, size_t size) {
+	uint8_t b;
+	uint16_t w;
+	uint32_t d;
+	uint64_t q;
+
+	switch( size ) {
+		case 1:
+			memcpy(&b, p, 1);
+			return b;
+		case 2:
+			memcpy(&w, p, 2);
+			return w;
+		case 4:
+			memcpy(&d, p, 4);
+			return d;
+		default:
+			memcpy(&q, p, 8);
+			return q;
+	}
+}
+
+// Writes the low `size` bytes of `data` to `p`
+static inline void _memoryStore(uint8_t *p, size_t size, uint64_t data) {
+	uint8_t b = (uint8_t)data;
+	uint16_t w = (uint16_t)data;
+	uint32_t d = (uint32_t)data;
+
+	switch( size ) {
+		case 1:
+			memcpy(p, &b, 1);
+			break;
+		case 2:
+			memcpy(p, &w, 2);
+			break;
+		case 4:
+			memcpy(p, &d, 4);
+			break;
+		default:
+			memcpy(p, &data, 8);
+	}
+}
+
+// Returns the byte at `address` as it's in its page, 0 unless it's RAM or ROM
+static uint8_t _memoryPeek(EmuContext_t *ctx, uint32_t address) {
+	const DataMemoryPage_t *page = _memoryPage(ctx, address);
+
+	return (page -> host != NULL)? page -> host[address & 0xff] : 0;
+}
+
+// Checks an access of `size` bytes at `address` against the watches, called before writes and after reads
+// The first hit is kept in `ctx -> WatchHit`, and stops `coreRun()` once the instruction is done.
+// Values are the ones of the watched bytes (the first 8 of them), the accessed ones taken from `data`, the others
+// read straight from the pages, as reading them through the handlers may have side effects.
+static void _memoryCheckWatches(EmuContext_t *ctx, uint32_t address, size_t size, bool isWrite, uint64_t data) {
+	const MemoryWatch_t *watch;
+	uint64_t old, new, mask;
+	uint32_t byte, end;
+	unsigned int shift;
+
+	if( ctx -> CoreStopRequests[CORE_STOP_REQUEST_WATCH] )
+		return;
+
+	for( watch = ctx -> Watches; watch < ctx -> Watches + ctx -> WatchCount; ++watch ) {
+		if( (address + size <= watch -> start) || (address >= watch -> end) )
+			continue;
+		if( !(watch -> flags & (isWrite? MEMORY_WATCH_WRITE : MEMORY_WATCH_READ)) )
+			continue;
+
+		end = (watch -> end - watch -> start > 8)? watch -> start + 8 : watch -> end;
+		mask = (end - watch -> start == 8)? ~(uint64_t)0 : ((uint64_t)1 << ((end - watch -> start) * 8)) - 1;
+		old = new = 0;
+		for( byte = end; byte-- != watch -> start; ) {
+			old = (old << 8) | _memoryPeek(ctx, byte);
+			shift = (byte - address) * 8;
+			new = (new << 8) | (((byte >= address) && (byte < address + size))? (data >> shift) & 0xff : (old & 0xff));
+		}
+		if( !isWrite )
+			old = new;
+		if( (watch -> flags & MEMORY_WATCH_VALUE) && (new != (watch -> value & mask)) )
+			continue;
+
+		ctx -> WatchHit.watch = *watch;
+		ctx -> WatchHit.address = address;
+		ctx -> WatchHit.size = (uint8_t)size;
+		ctx -> WatchHit.isWrite = isWrite;
+		ctx -> WatchHit.oldValue = old;
+		ctx -> WatchHit.newValue = new;
+		ctx -> WatchHit.csr = CSR;
+		ctx -> WatchHit.pc = PC;
+		ctx -> CoreStopRequests[CORE_STOP_REQUEST_WATCH] = 1;
+		return;
+	}
+}
+
+#ifdef CORE_TRACE
+// Hands an access to the tracer of `ctx`, see `trace.c`
+// Sizes and offsets are the ones actually accessed, as `memoryGetData()` adjusts them.
+static void _memoryTrace(EmuContext_t *ctx, SR_t segment, EA_t offset, size_t size, uint64_t data, bool isWrite) {
+	TraceRecord_t record;
+
+	if( ctx -> IsMemoryInited == false )
+		return;
+
+	size = (size <= 1)? 1 : (size == 2)? 2 : (size <= 4)? 4 : 8;
+	if( size > 1 )
+		offset &= 0xfffe;
+
+	record.cycle = ctx -> TraceClock + (uint64_t)ctx -> RunCycles;
+	record.value = (size == 8)? data : data & (((uint64_t)1 << (size * 8)) - 1);
+	record.pc = PC;
+	record.offset = (uint16_t)offset;
+	record.csr = (uint8_t)CSR;
+	record.segment = (uint8_t)segment;
+	record.flags = (uint8_t)size | (isWrite? TRACE_WRITE : 0);
+	record.region = (uint8_t)_memoryRegionIndex(ctx, ((uint32_t)segment << 16) + offset);
+	traceRecord(ctx -> Trace, &record);
+}
+#endif
+
+
+// Returns true if `model` fits this build and its regions make sense
+// Plain RAM regions must be in data memory, ROM window regions on segment 0.
+bool memoryCheckModel(const MemoryModel_t *model) {
+	const DataMemoryRegion_t *p;
+
+	if( (model -> romWindowSize < ROM_WINDOW_SIZE) || (model -> romWindowSize >= 0x10000) )
+		return false;
+	if( (model -> codePageCount == 0) || (model -> codePageCount > CODE_PAGE_COUNT) || (model -> codeMirrorMask > 0x0f) )
+		return false;
+	if( model -> regionCount > MEMORY_MODEL_REGIONS )
+		return false;
+
+	for( p = model -> regions; p < model -> regions + model -> regionCount; ++p ) {
+		if( (p -> handler == NULL) || (p -> start >= p -> end) || (p -> end > 0x1000000) )
+			return false;
+		if( (p -> kind == DATA_REGION_RAM) && ((p -> start < model -> romWindowSize) || (p -> end > 0x10000)) )
+			return false;
+		if( (p -> kind == DATA_REGION_ROM_WINDOW) && (p -> end > 0x10000) )
+			return false;
+	}
+	return true;
+}
+
+// Returns the model in `MEMORY_MODELS` called `name`, NULL if there's none
+const MemoryModel_t* memoryFindModel(const char *name) {
+	unsigned int i;
+
+	for( i = 0; i < MEMORY_MODEL_COUNT; ++i ) {
+		if( strcmp(MEMORY_MODELS[i].name, name) == 0 )
+			return &MEMORY_MODELS[i];
+	}
+	return NULL;
+}
+
+// Skips blanks, then returns the length of the word at `*text`
+static size_t _memoryWord(const char **text) {
+	size_t length = 0;
+
+	while( (**text == ' ') || (**text == '\t') || (**text == '\r') )
+		++*text;
+	while( ((*text)[length] != '\0') && (strchr(" \t\r\n#", (*text)[length]) == NULL) )
+		++length;
+	return length;
+}
+
+// Reads a number (decimal, or hexadecimal with `0x`) into `*value`
+static bool _memoryNumber(const char **text, uint32_t *value) {
+	size_t length = _memoryWord(text);
+	char *end;
+	unsigned long n;
+
+	if( (length == 0) || !((**text >= '0') && (**text <= '9')) )
+		return false;
+	n = strtoul(*text, &end, 0);
+	if( (end != *text + length) || (n > 0x1000000) )
+		return false;
+
+	*value = (uint32_t)n;
+	*text += length;
+	return true;
+}
+
+static bool _memoryIsWord(const char *word, size_t length, const char *name) {
+	return (strlen(name) == length) && (memcmp(word, name, length) == 0);
+}
+
+// Fills in `model` from its text description, one setting per line, `#` starts a comment:
+//	name es_plus			up to 31 characters
+//	rom_window 0x8000		`romWindowSize`
+//	code_pages 2			`codePageCount`
+//	code_mirror 0x01		`codeMirrorMask`
+//	region 0x08000 0x08e00 ram	start, end + 1 and one of `MEMORY_HANDLERS`, in the order they're matched
+// Returns `MEMORY_MODEL_INVALID` if there's anything else in it, or if `memoryCheckModel()` rejects it.
+MEMORY_STATUS memoryParseModel(MemoryModel_t *model, const char *text) {
+	const char *word;
+	size_t length;
+	uint32_t value;
+	DataMemoryRegion_t *region;
+	unsigned int i;
+
+	memset(model, 0, sizeof(MemoryModel_t));
+	while( *text != '\0' ) {
+		word = text;
+		length = _memoryWord(&word);
+		text = word + length;
+
+		if( length == 0 ) {
+			// blank line
+		}
+		else if( _memoryIsWord(word, length, "name") ) {
+			length = _memoryWord(&text);
+			if( (length == 0) || (length >= sizeof(model -> name)) )
+				return MEMORY_MODEL_INVALID;
+			memcpy(model -> name, text, length);
+			model -> name[length] = '\0';
+			text += length;
+		}
+		else if( _memoryIsWord(word, length, "rom_window") ) {
+			if( !_memoryNumber(&text, &model -> romWindowSize) )
+				return MEMORY_MODEL_INVALID;
+		}
+		else if( _memoryIsWord(word, length, "code_pages") ) {
+			if( !_memoryNumber(&text, &value) || (value > 0xff) )
+				return MEMORY_MODEL_INVALID;
+			model -> codePageCount = (uint8_t)value;
+		}
+		else if( _memoryIsWord(word, length, "code_mirror") ) {
+			if( !_memoryNumber(&text, &value) || (value > 0xff) )
+				return MEMORY_MODEL_INVALID;
+			model -> codeMirrorMask = (uint8_t)value;
+		}
+		else if( _memoryIsWord(word, length, "region") ) {
+			if( model -> regionCount == MEMORY_MODEL_REGIONS )
+				return MEMORY_MODEL_INVALID;
+			region = &model -> regions[model -> regionCount++];
+			if( !_memoryNumber(&text, &region -> start) || !_memoryNumber(&text, &region -> end) )
+				return MEMORY_MODEL_INVALID;
+
+			length = _memoryWord(&text);
+			for( i = 0; i < MEMORY_HANDLER_COUNT; ++i ) {
+				if( _memoryIsWord(text, length, MEMORY_HANDLERS[i].name) )
+					break;
+			}
+			if( i == MEMORY_HANDLER_COUNT )
+				return MEMORY_MODEL_INVALID;
+			region -> handler = MEMORY_HANDLERS[i].handler;
+			region -> kind = MEMORY_HANDLERS[i].kind;
+			text += length;
+		}
+		else {
+			return MEMORY_MODEL_INVALID;
+		}
+
+		// nothing but a comment may follow on the line
+		if( _memoryWord(&text) != 0 )
+			return MEMORY_MODEL_INVALID;
+		while( (*text != '\0') && (*text != '\n') )
+			++text;
+		if( *text == '\n' )
+			++text;
+	}
+
+	return memoryCheckModel(model)? MEMORY_OK : MEMORY_MODEL_INVALID;
+}
+
+
+// Where data files go in `ctx -> DataMemory`, the data memory of its model
+#define DATA_FILE_BYTES(ctx) ((ctx) -> DataMemory + ((ctx) -> Model.romWindowSize - ROM_WINDOW_SIZE))
+#define DATA_FILE_SIZE(ctx) (0x10000 - (ctx) -> Model.romWindowSize)
+
+// Initializes `CodeMemory` and `DataMemory` of `ctx` for the device `model` describes, which is copied
+// Its regions are turned into page tables here, so accesses cost the same whatever the model.
+// Data memory is part of the context, see `CONTEXT_STATE_SIZE`, so only code memory is allocated.
+MEMORY_STATUS memoryInitModel(EmuContext_t *ctx, const MemoryModel_t *model, stub_MMUFileID_t codeFileID, stub_MMUFileID_t dataFileID) {
 	stub_MMUInitStruct_t s = {
 		.codeMemoryID = codeFileID,
 		.dataMemoryID = dataFileID,
-		.codeMemorySize = CODE_PAGE_COUNT * 0x10000,
-		.dataMemorySize = 0x10000 - ROM_WINDOW_SIZE
+		.codeMemorySize = model -> codePageCount * 0x10000,
+		.dataMemorySize = 0x10000 - model -> romWindowSize
 	};
+	MEMORY_STATUS retVal;
 
-	if( (CodeMemory = stub_mmuInitCodeMemory(s)) == NULL ) {
+	if( !memoryCheckModel(model) )
+		return MEMORY_MODEL_INVALID;
+	ctx -> Model = *model;
+
+	if( (ctx -> CodeMemory = stub_mmuInitCodeMemory(s)) == NULL ) {
 		return MEMORY_ROM_MISSING;
 	}
 
-	if( (DataMemory = stub_mmuInitDataMemory(s)) == NULL ) {
-		stub_mmuFreeCodeMemory(CodeMemory);
-		CodeMemory = NULL;
-		return MEMORY_ALLOCATION_FAILED;
+	if( stub_mmuLoadDataMemory(s, DATA_FILE_BYTES(ctx)) != STUB_MMU_OK ) {
+		stub_mmuFreeCodeMemory(ctx -> CodeMemory);
+		ctx -> CodeMemory = NULL;
+		return MEMORY_LOADING_FAILED;
+	}
+
+	_memorySetDataPages(ctx);
+	if( (retVal = _memoryBuildPageTables(ctx)) != MEMORY_OK ) {
+		stub_mmuFreeCodeMemory(ctx -> CodeMemory);
+		ctx -> CodeMemory = NULL;
+		return retVal;
 	}
 
-	IsMemoryInited = true;
+	ctx -> IsCodeShared = false;
+	ctx -> IsMemoryInited = true;
+	return MEMORY_OK;
+}
+
+// The same, for the first of `MEMORY_MODELS`
+MEMORY_STATUS memoryInit(EmuContext_t *ctx, stub_MMUFileID_t codeFileID, stub_MMUFileID_t dataFileID) {
+	return memoryInitModel(ctx, &MEMORY_MODELS[0], codeFileID, dataFileID);
+}
+
+// Initializes `DataMemory` of `ctx`, and makes it use the code memory and the memory model of `owner`
+// Code memory is never written, so any number of contexts can share one ROM.
+// `owner` must stay initialized until all the contexts sharing its ROM are freed.
+MEMORY_STATUS memoryInitShared(EmuContext_t *ctx, const EmuContext_t *owner, stub_MMUFileID_t dataFileID) {
+	stub_MMUInitStruct_t s = {
+		.dataMemoryID = dataFileID,
+		.dataMemorySize = DATA_FILE_SIZE(owner)
+	};
+	MEMORY_STATUS retVal;
+
+	if( owner -> IsMemoryInited == false )
+		return MEMORY_UNINITIALIZED;
+
+	ctx -> Model = owner -> Model;
+	if( stub_mmuLoadDataMemory(s, DATA_FILE_BYTES(ctx)) != STUB_MMU_OK )
+		return MEMORY_LOADING_FAILED;
+
+	ctx -> CodeMemory = owner -> CodeMemory;
+	_memorySetDataPages(ctx);
+	if( (retVal = _memoryBuildPageTables(ctx)) != MEMORY_OK ) {
+		ctx -> CodeMemory = NULL;
+		return retVal;
+	}
+	ctx -> IsCodeShared = true;
+	ctx -> IsMemoryInited = true;
 	return MEMORY_OK;
 }
 
 // Saves data in *DataMemory into file
 // WARNING: This will overwrite existing file!!!
-MEMORY_STATUS memorySaveData(stub_MMUFileID_t dataFileID) {
+MEMORY_STATUS memorySaveData(EmuContext_t *ctx, stub_MMUFileID_t dataFileID) {
 	stub_MMUInitStruct_t s = {
 		.dataMemoryID = dataFileID,
-		.dataMemorySize = 0x10000 - ROM_WINDOW_SIZE
+		.dataMemorySize = DATA_FILE_SIZE(ctx)
 	};
 
-	if( stub_mmuSaveDataMemory(s, DataMemory) == STUB_MMU_ERROR )
+	if( ctx -> IsMemoryInited == false )
+		return MEMORY_UNINITIALIZED;
+
+	// data memory of forked contexts is put back in one piece first
+	_memoryGatherDataPages(ctx, true);
+
+	if( stub_mmuSaveDataMemory(s, DATA_FILE_BYTES(ctx)) == STUB_MMU_ERROR )
 		return MEMORY_SAVING_FAILED;
 
 	return MEMORY_OK;
 }
 
 // Loads data memory from a binary file
-MEMORY_STATUS memoryLoadData(stub_MMUFileID_t dataFileID) {
+MEMORY_STATUS memoryLoadData(EmuContext_t *ctx, stub_MMUFileID_t dataFileID) {
 	stub_MMUInitStruct_t s = {
 		.dataMemoryID = dataFileID,
-		.dataMemorySize = 0x10000 - ROM_WINDOW_SIZE
+		.dataMemorySize = DATA_FILE_SIZE(ctx)
 	};
 
-	if( IsMemoryInited == false )
+	if( ctx -> IsMemoryInited == false )
 		return MEMORY_UNINITIALIZED;
 
-	if( stub_mmuLoadDataMemory(s, DataMemory) == STUB_MMU_ERROR )
+	if( stub_mmuLoadDataMemory(s, DATA_FILE_BYTES(ctx)) == STUB_MMU_ERROR )
 		return MEMORY_LOADING_FAILED;
+	_memoryGatherDataPages(ctx, false);
 
 	return MEMORY_OK;
 }
 
 // Frees memory allocated
-MEMORY_STATUS memoryFree(void) {
-	if( IsMemoryInited == false )
+MEMORY_STATUS memoryFree(EmuContext_t *ctx) {
+	unsigned int i;
+
+	if( ctx -> IsMemoryInited == false )
+		return MEMORY_UNINITIALIZED;
+
+	if( ctx -> IsCodeShared == false )
+		stub_mmuFreeCodeMemory(ctx -> CodeMemory);
+	for( i = 0; i < DATA_MEMORY_PAGES; ++i ) {
+		if( ctx -> DataPageBlocks[i] != NULL )
+			_memoryDropDataPage(ctx -> DataPageBlocks[i]);
+		ctx -> DataPageBlocks[i] = NULL;
+	}
+	ctx -> DataPagesShared = 0;
+
+	ctx -> IsMemoryInited = false;
+	return MEMORY_OK;
+}
+
+// Makes `child` continue with the data memory of `parent`, sharing its ROM like `memoryInitShared()` does
+// Nothing is copied: they share every page of data memory (`DATA_PAGE_SIZE` bytes) until one of them
+// writes to it, then it gets a copy of its own in its `DataMemory`. So forking costs a few page tables, and the
+// shared pages are only copied when written. The first fork of a context copies its data memory out once, the
+// ones after that don't, unless it has written to it in between.
+// `child` must not have any memory, the core is copied with `coreFork()`. Contexts forked from each other
+// may run on different threads and be freed in any order, except for the one owning the ROM.
+MEMORY_STATUS memoryFork(EmuContext_t *child, EmuContext_t *parent) {
+	SharedDataPage_t *blocks[DATA_MEMORY_PAGES] = {NULL};
+	unsigned int i;
+
+	if( parent -> IsMemoryInited == false )
+		return MEMORY_UNINITIALIZED;
+
+	// pages in `DataMemory` can't be shared as they are, as the parent would write over them
+	// They're all allocated before the parent is touched, so it's left as it was if one can't be.
+	for( i = 0; i < DATA_MEMORY_PAGES; ++i ) {
+		if( (parent -> DataPageBlocks[i] == NULL) && ((blocks[i] = malloc(sizeof(SharedDataPage_t))) == NULL) ) {
+			while( i-- != 0 )
+				free(blocks[i]);
+			return MEMORY_ALLOCATION_FAILED;
+		}
+	}
+	for( i = 0; i < DATA_MEMORY_PAGES; ++i ) {
+		if( blocks[i] == NULL )
+			continue;
+
+		blocks[i] -> refs = 1;
+		memcpy(blocks[i] -> bytes, parent -> DataPages[i], DATA_PAGE_SIZE);
+		parent -> DataPageBlocks[i] = blocks[i];
+		parent -> DataPages[i] = blocks[i] -> bytes;
+	}
+
+	child -> Model = parent -> Model;
+	child -> CodeMemory = parent -> CodeMemory;
+	for( i = 0; i < DATA_MEMORY_PAGES; ++i ) {
+		REFS_ADD(parent -> DataPageBlocks[i] -> refs, 1);
+		child -> DataPageBlocks[i] = parent -> DataPageBlocks[i];
+		child -> DataPages[i] = parent -> DataPages[i];
+	}
+	parent -> DataPagesShared = child -> DataPagesShared = ((uint32_t)1 << DATA_MEMORY_PAGES) - 1;
+
+	// the same page tables, once they point at the shared pages
+	memcpy(child -> MemorySegments, parent -> MemorySegments, sizeof(child -> MemorySegments));
+	memcpy(child -> MemoryPageTables, parent -> MemoryPageTables, parent -> MemoryPageTableCount * sizeof(child -> MemoryPageTables[0]));
+	memcpy(child -> MemorySplitPages, parent -> MemorySplitPages, parent -> MemorySplitPageCount * sizeof(child -> MemorySplitPages[0]));
+	child -> MemoryPageTableCount = parent -> MemoryPageTableCount;
+	child -> MemorySplitPageCount = parent -> MemorySplitPageCount;
+	memcpy(child -> Watches, parent -> Watches, sizeof(child -> Watches));
+	child -> WatchCount = parent -> WatchCount;
+	_memoryMapDataPages(parent, parent -> DataPagesShared);
+	_memoryMapDataPages(child, child -> DataPagesShared);
+
+	child -> MemoryStatus = MEMORY_OK;
+	child -> IsCodeShared = true;
+	child -> IsMemoryInited = true;
+	return MEMORY_OK;
+}
+
+// Makes page `index` of data memory writable by `ctx` alone, copying it back into `DataMemory` if other contexts still use it
+// Called by `RAMHandler()` before writing to a page in `ctx -> DataPagesShared`.
+void memoryOwnDataPage(EmuContext_t *ctx, unsigned int index) {
+	SharedDataPage_t *block = ctx -> DataPageBlocks[index];
+
+	// nobody else can take it once it's the last one using it
+	// Otherwise its place in `DataMemory` is free, since the page has been moved out.
+	if( (block != NULL) && (REFS_GET(block -> refs) != 1) ) {
+		ctx -> DataPages[index] = ctx -> DataMemory + index * DATA_PAGE_SIZE;
+		memcpy(ctx -> DataPages[index], block -> bytes, DATA_PAGE_SIZE);
+		ctx -> DataPageBlocks[index] = NULL;
+		_memoryDropDataPage(block);
+	}
+
+	ctx -> DataPagesShared &= ~((uint32_t)1 << index);
+	_memoryMapDataPages(ctx, (uint32_t)1 << index);
+}
+
+// Moves every page of data memory of a forked context back into `ctx -> DataMemory`, copying the shared ones
+// Afterwards the context's state can be copied as a whole, see `CONTEXT_STATE_SIZE`.
+MEMORY_STATUS memoryUnshare(EmuContext_t *ctx) {
+	if( ctx -> IsMemoryInited == false )
+		return MEMORY_UNINITIALIZED;
+
+	_memoryGatherDataPages(ctx, true);
+	return MEMORY_OK;
+}
+
+// Watches `size` bytes of data memory at `segment:offset`, making `coreRun()` stop with `CORE_STOP_WATCH`
+// once an instruction accessing any of them is done. `flags` picks reads, writes or both (`MEMORY_WATCH_*`),
+// with `MEMORY_WATCH_VALUE` only accesses after which the watched bytes (the first 8, little-endian) hold `value` hit.
+// What hit is in `ctx -> WatchHit`.
+// Only pages with watched bytes are checked, accesses to the others keep going the fast way.
+// Contexts with watches don't run translated code (see `jit_x64.c`). Host accesses through `memoryGetData()`
+// and `memorySetData()` are checked too.
+MEMORY_STATUS memoryAddWatch(EmuContext_t *ctx, SR_t segment, EA_t offset, size_t size, uint8_t flags, uint64_t value) {
+	MemoryWatch_t *watch;
+
+	if( ctx -> IsMemoryInited == false )
 		return MEMORY_UNINITIALIZED;
 
-	stub_mmuFreeCodeMemory(CodeMemory);
-	stub_mmuFreeDataMemory(DataMemory);
+	if( ctx -> WatchCount == MEMORY_WATCHES )
+		return MEMORY_TOO_MANY_WATCHES;
 
-	IsMemoryInited = false;
+	watch = &ctx -> Watches[ctx -> WatchCount++];
+	watch -> start = ((uint32_t)segment << 16) + offset;
+	watch -> end = watch -> start + ((size != 0)? size : 1);
+	watch -> flags = flags;
+	watch -> value = value;
+	_memoryMarkWatches(ctx);
 	return MEMORY_OK;
 }
 
+// Removes the watches starting at `segment:offset`
+void memoryRemoveWatch(EmuContext_t *ctx, SR_t segment, EA_t offset) {
+	uint32_t start = ((uint32_t)segment << 16) + offset;
+	unsigned int i, count = 0;
+
+	for( i = 0; i < ctx -> WatchCount; ++i ) {
+		if( ctx -> Watches[i].start != start )
+			ctx -> Watches[count++] = ctx -> Watches[i];
+	}
+	ctx -> WatchCount = count;
+	_memoryMarkWatches(ctx);
+}
+
 // Fetches a word from code memory
 // It aligns to word boundary
 // It returns `0xffff` in unmapped pages
-uint16_t memoryGetCodeWord(SR_t segment, PC_t offset) {
-	MemoryStatus = MEMORY_OK;
+uint16_t memoryGetCodeWord(EmuContext_t *ctx, SR_t segment, PC_t offset) {
+	ctx -> MemoryStatus = MEMORY_OK;
 
-	if( IsMemoryInited == false ) {
-		MemoryStatus = MEMORY_UNINITIALIZED;
+	if( ctx -> IsMemoryInited == false ) {
+		ctx -> MemoryStatus = MEMORY_UNINITIALIZED;
 		return 0;
 	}
 
 	segment &= 0x0f;	// limit segment to 0~15
 	offset &= 0xfffe;	// align to word boundary
 
-	if( (segment & CODE_MIRROW_MASK) >= CODE_PAGE_COUNT ) {
-		MemoryStatus = MEMORY_UNMAPPED;
+	if( (segment & ctx -> Model.codeMirrorMask) >= ctx -> Model.codePageCount ) {
+		ctx -> MemoryStatus = MEMORY_UNMAPPED;
 		return 0xffff;
 	}
 
-	if( segment > CODE_MIRROW_MASK ) {
-		segment &= CODE_MIRROW_MASK;
-		MemoryStatus = MEMORY_MIRROWED_BANK;
+	if( segment > ctx -> Model.codeMirrorMask ) {
+		segment &= ctx -> Model.codeMirrorMask;
+		ctx -> MemoryStatus = MEMORY_MIRROWED_BANK;
 	}
 
-	return *((uint16_t*)(CodeMemory + (segment << 16) + offset));
+	return *((uint16_t*)(ctx -> CodeMemory + (segment << 16) + offset));
 }
 
 
-// Looks up `address` in `DATA_MEMORY_MAP`.
-// Returns a pointer to matching entry for `address`
-// This is an internal helper function. you don't really need to call it.
-static const DataMemoryRegion_t * lookupRegion(uint32_t address) {
-	unsigned int index;
-	const DataMemoryRegion_t *p = DATA_MEMORY_MAP;
-
-	for( index = 0; index < DATA_MEMORY_REGION_COUNT; ++index ) {
-		if( (address >= p -> start) && (address < p -> end) )
-			break;
-		++p;
-	}
-	return p;
-}
-
-
-// fetches some data from data memory
-// Unmapped memory reads 0
-// size can only be 1, 2, 4, 8
-uint64_t memoryGetData(SR_t segment, EA_t offset, size_t size) {
+// Reads data memory for `memoryGetData()`
+static inline uint64_t _memoryGetData(EmuContext_t *ctx, SR_t segment, EA_t offset, size_t size) {
 	uint64_t retVal = 0;
-	uint32_t flatAddress;
-	const DataMemoryRegion_t * region;
+	uint32_t flatAddress, address;
+	const DataMemoryPage_t *page;
 
-	MemoryStatus = MEMORY_OK;
+	ctx -> MemoryStatus = MEMORY_OK;
 
-	ROMWinAccessCount = 0;
-	if( IsMemoryInited == false ) {
-		MemoryStatus = MEMORY_UNINITIALIZED;
+	ctx -> ROMWinAccessCount = 0;
+	if( ctx -> IsMemoryInited == false ) {
+		ctx -> MemoryStatus = MEMORY_UNINITIALIZED;
 		return 0;
 	}
 
@@ -165,51 +825,61 @@ uint64_t memoryGetData(SR_t segment, EA_t offset, size_t size) {
 
 	// align to word boundary
 	if( size > 1 ) {
-		(offset & 1)? MemoryStatus = MEMORY_UNALIGNED : 0;
+		(offset & 1)? ctx -> MemoryStatus = MEMORY_UNALIGNED : 0;
 		offset &= 0xfffe;
 	}
 
 	flatAddress = (segment << 16) + offset;
 
-	// lookup for the region the address belongs to
-	region = lookupRegion(flatAddress);
-
-	if( (flatAddress += size - 1) < region -> end ) {
-		// all the accesses happen within the region
-		// so we can do only 1 lookup
+	// one lookup does for all the bytes, unless they're on different pages or the page is split
+	page = _memoryPage(ctx, flatAddress);
+	if( (page -> handler != NULL) && !page -> isWatched && (((flatAddress + size - 1) ^ flatAddress) < 0x100) ) {
+		// RAM and ROM are read in one go, without calling the handler for each byte
+		if( page -> host != NULL ) {
+			if( page -> kind == DATA_REGION_ROM_WINDOW ) {
+				ctx -> ROMWinAccessCount = size;
+				ctx -> MemoryStatus = MEMORY_ROM_WINDOW;
+			}
+			return _memoryLoad(page -> host + (flatAddress & 0xff), size);
+		}
+
+		flatAddress += size - 1;
 		do {
 			retVal <<= 8;
-			retVal |= (*(region -> handler))(flatAddress--, 0, false);
+			retVal |= (*(page -> handler))(ctx, flatAddress--, 0, false);
 		} while( --size != 0 );
 
 		return retVal;
 	}
 	else {
-		// this single access splits across different regions
-		// we do multiple lookups to ensure compatibility
+		// watched pages come here too, so the others don't pay for the check
+		address = flatAddress + size - 1;
 		do {
-			region = lookupRegion(flatAddress);
 			retVal <<= 8;
-			retVal |= (*(region -> handler))(flatAddress--, 0, false);
-		} while( --size != 0 );
+			retVal |= (*_memoryHandler(ctx, address))(ctx, address, 0, false);
+		} while( address-- != flatAddress );
 
+		if( ctx -> WatchCount != 0 )
+			_memoryCheckWatches(ctx, flatAddress, size, false, retVal);
 		return retVal;
 	}
 }
 
-// writes some data into data memory
-// size can only be 1, 2, 4, 8
-void memorySetData(SR_t segment, EA_t offset, size_t size, uint64_t data) {
+// Writes data memory for `memorySetData()`
+static inline void _memorySetData(EmuContext_t *ctx, SR_t segment, EA_t offset, size_t size, uint64_t data) {
 	uint32_t flatAddress;
-	const DataMemoryRegion_t * region;
+	const DataMemoryPage_t *page;
 
-	MemoryStatus = MEMORY_OK;
+	ctx -> MemoryStatus = MEMORY_OK;
 
-	ROMWinAccessCount = 0;
-	if( IsMemoryInited == false ) {
-		MemoryStatus = MEMORY_UNINITIALIZED;
+	ctx -> ROMWinAccessCount = 0;
+	if( ctx -> IsMemoryInited == false ) {
+		ctx -> MemoryStatus = MEMORY_UNINITIALIZED;
 		goto exit;
 	}
+#ifdef CORE_IDLE_SKIP
+	++ctx -> MemoryWrites;
+#endif
 
 	// validate size
 	switch( size ) {
@@ -234,34 +904,61 @@ void memorySetData(SR_t segment, EA_t offset, size_t size, uint64_t data) {
 
 	// align to word boundary
 	if( size > 1 ) {
-		(offset & 1)? MemoryStatus = MEMORY_UNALIGNED : 0;
+		(offset & 1)? ctx -> MemoryStatus = MEMORY_UNALIGNED : 0;
 		offset &= 0xfffe;
 	}
 
 	flatAddress = (segment << 16) + offset;
 
-	// lookup for the region the address belongs to
-	region = lookupRegion(flatAddress);
+	// one lookup does for all the bytes, unless they're on different pages or the page is split
+	page = _memoryPage(ctx, flatAddress);
+	if( (page -> handler != NULL) && !page -> isWatched && (((flatAddress + size - 1) ^ flatAddress) < 0x100) ) {
+		// only RAM is written in one go, writes to ROM and to shared RAM are left to the handler
+		if( (page -> kind == DATA_REGION_RAM) && !page -> isShared ) {
+			_memoryStore(page -> host + (flatAddress & 0xff), size, data);
+			goto exit;
+		}
 
-	if( (flatAddress + size - 1) < region -> end ) {
-		// all the accesses happen within the region
-		// so we can do only 1 lookup
 		do {
-			(*(region -> handler))(flatAddress++, data & 0xff, true);
+			(*(page -> handler))(ctx, flatAddress++, data & 0xff, true);
 			data >>= 8;
 		} while( --size != 0 );
 	}
 	else {
-		// this single access splits across different regions
-		// we do multiple lookups to ensure compatibility
+		// watched pages come here too, so the others don't pay for the check
+		if( ctx -> WatchCount != 0 )
+			_memoryCheckWatches(ctx, flatAddress, size, true, data);
 		do {
-			(*(region -> handler))(flatAddress++, data & 0xff, true);
+			(*_memoryHandler(ctx, flatAddress))(ctx, flatAddress, data & 0xff, true);
+			++flatAddress;
 			data >>= 8;
-			if( --size == 0 )
-				break;
-			region = lookupRegion(flatAddress);
-		} while( 1 );
+		} while( --size != 0 );
 	}
 exit:
 	;
 }
+
+// fetches some data from data memory
+// Unmapped memory reads 0
+// size can only be 1, 2, 4, 8
+uint64_t memoryGetData(EmuContext_t *ctx, SR_t segment, EA_t offset, size_t size) {
+#ifdef CORE_TRACE
+	uint64_t data = _memoryGetData(ctx, segment, offset, size);
+
+	if( ctx -> Trace != NULL )
+		_memoryTrace(ctx, segment, offset, size, data, false);
+	return data;
+#else
+	return _memoryGetData(ctx, segment, offset, size);
+#endif
+}
+
+// writes some data into data memory
+// size can only be 1, 2, 4, 8
+void memorySetData(EmuContext_t *ctx, SR_t segment, EA_t offset, size_t size, uint64_t data) {
+#ifdef CORE_TRACE
+	if( ctx -> Trace != NULL )
+		_memoryTrace(ctx, segment, offset, size, data, true);
+#endif
+	_memorySetData(ctx, segment, offset, size, data);
+}
@@ -7,24 +7,29 @@
 
 #include "regtypes.h"
 #include "memtypes.h"
+#include "contexttypes.h"
 #include "mmustub.h"
-
-
-extern void *CodeMemory;
-extern void *DataMemory;
-extern bool IsMemoryInited;
-// Status of last memory operation
-extern MEMORY_STATUS MemoryStatus;
-// Tracks how many ROM window access has happened
-extern unsigned int ROMWinAccessCount;
-
-
-MEMORY_STATUS memoryInit(stub_MMUFileID_t codeFileID, stub_MMUFileID_t dataFileID);
-MEMORY_STATUS memorySaveData(stub_MMUFileID_t dataFileID);
-MEMORY_STATUS memoryLoadData(stub_MMUFileID_t dataFileID);
-MEMORY_STATUS memoryFree(void);
-uint16_t memoryGetCodeWord(SR_t segment, PC_t offset);
-uint64_t memoryGetData(SR_t segment, EA_t offset, size_t size);
-void memorySetData(SR_t segment, EA_t offset, size_t size, uint64_t data);
+#include "memmap.h"
+
+
+// The memory of each context lives in it, see `context.h`
+
+bool memoryCheckModel(const MemoryModel_t *model);
+const MemoryModel_t* memoryFindModel(const char *name);
+MEMORY_STATUS memoryParseModel(MemoryModel_t *model, const char *text);
+MEMORY_STATUS memoryInitModel(EmuContext_t *ctx, const MemoryModel_t *model, stub_MMUFileID_t codeFileID, stub_MMUFileID_t dataFileID);
+MEMORY_STATUS memoryInit(EmuContext_t *ctx, stub_MMUFileID_t codeFileID, stub_MMUFileID_t dataFileID);
+MEMORY_STATUS memoryInitShared(EmuContext_t *ctx, const EmuContext_t *owner, stub_MMUFileID_t dataFileID);
+MEMORY_STATUS memorySaveData(EmuContext_t *ctx, stub_MMUFileID_t dataFileID);
+MEMORY_STATUS memoryLoadData(EmuContext_t *ctx, stub_MMUFileID_t dataFileID);
+MEMORY_STATUS memoryFree(EmuContext_t *ctx);
+MEMORY_STATUS memoryFork(EmuContext_t *child, EmuContext_t *parent);
+void memoryOwnDataPage(EmuContext_t *ctx, unsigned int page);
+MEMORY_STATUS memoryUnshare(EmuContext_t *ctx);
+MEMORY_STATUS memoryAddWatch(EmuContext_t *ctx, SR_t segment, EA_t offset, size_t size, uint8_t flags, uint64_t value);
+void memoryRemoveWatch(EmuContext_t *ctx, SR_t segment, EA_t offset);
+uint16_t memoryGetCodeWord(EmuContext_t *ctx, SR_t segment, PC_t offset);
+uint64_t memoryGetData(EmuContext_t *ctx, SR_t segment, EA_t offset, size_t size);
+void memorySetData(EmuContext_t *ctx, SR_t segment, EA_t offset, size_t size, uint64_t data);
 
 #endif
@@ -37,7 +37,6 @@ extern stub_MMUStatus_t stub_mmuLoadCodeMemory(const stub_MMUInitStruct_t s, voi
 
 /// @brief Load data memory.
 /// 		You need to implement this function YOURSELF.
-///		Hint: You can call this function in `stub_mmuInitDataMemory` to reuse logic
 /// @param s `dataMemoryID` refers to data memory file,
 ///		`dataMemorySize` specifies size in bytes.
 /// @param p A pointer to data memory.
@@ -59,22 +58,9 @@ extern stub_MMUStatus_t stub_mmuSaveDataMemory(const stub_MMUInitStruct_t s, voi
 /// @returns A pointer to code memory, `NULL` if failed.
 extern void* stub_mmuInitCodeMemory(const stub_MMUInitStruct_t s);
 
-/// @brief Initialize data memory.
-/// 		You need to implement this function YOURSELF.
-/// @param s `dataMemoryID` refers to data memory file,
-///		`dataMemorySize` specifies size in bytes.
-/// @returns A pointer to data memory, `NULL` if failed.
-extern void* stub_mmuInitDataMemory(const stub_MMUInitStruct_t s);
-
 /// @brief Free/Release code memory.
 /// 		You need to implement this function YOURSELF.
 /// @param p A pointer to code memory.
 extern void stub_mmuFreeCodeMemory(void *p);
 
-/// @brief Free/Release data memory.
-/// 		You need to implement this function YOURSELF.
-/// @param p A pointer to data memory.
-extern void stub_mmuFreeDataMemory(void *p);
-
-
 #endif
@@ -0,0 +1,166 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>	// file I/O
+#include <stdlib.h>	// memory allocation
+#include <string.h>	// memory operation
+#include <stdint.h>	// integer types
+#include <stdbool.h>
+#include <sys/mman.h>	// mapping ROM files
+#include <sys/stat.h>	// file sizes and identities
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mmustub.h"
+
+
+// Stub functions for Linux (and other POSIX systems), use them instead of `mmustub_pc.c`
+//
+// Code memory isn't copied, the ROM file is mapped read-only instead. Every context loading
+// the same file gets the same mapping, so hundreds of them cost no more memory than one,
+// and starting one more doesn't read the ROM again. Code memory is never written (see `mmu.c`).
+
+// A mapped ROM file
+typedef struct CodeMapping CodeMapping_t;
+struct CodeMapping {
+	CodeMapping_t *next;
+	dev_t device;
+	ino_t inode;
+	size_t size;
+	void *p;
+	unsigned int refs;
+};
+
+static CodeMapping_t *Mappings = NULL;
+static pthread_mutex_t MappingsLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+stub_MMUStatus_t stub_mmuLoadCodeMemory(const stub_MMUInitStruct_t s, void *p) {
+	FILE *f;
+	bool isRead;
+
+	if( p == NULL )
+		return STUB_MMU_ERROR;
+
+	if( (f = fopen(s.codeMemoryID, "rb")) == NULL) {
+		return STUB_MMU_ERROR;
+	}
+
+	// short files fail
+	isRead = fread(p, sizeof(uint8_t), (size_t)s.codeMemorySize, f) == (size_t)s.codeMemorySize;
+	fclose(f);
+
+	return isRead? STUB_MMU_OK : STUB_MMU_ERROR;
+}
+
+
+stub_MMUStatus_t stub_mmuLoadDataMemory(const stub_MMUInitStruct_t s, void *p) {
+	FILE *f;
+	size_t size;
+
+	if( p == NULL )
+		return STUB_MMU_ERROR;
+
+	// zero data memory if not found
+	if( (f = fopen(s.dataMemoryID, "rb")) == NULL) {
+		memset(p, 0, s.dataMemorySize);
+		return STUB_MMU_OK;
+	}
+
+	// so is whatever a short file leaves out
+	size = fread(p, sizeof(uint8_t), (size_t)s.dataMemorySize, f);
+	memset((uint8_t *)p + size, 0, s.dataMemorySize - size);
+	fclose(f);
+
+	return STUB_MMU_OK;
+}
+
+
+stub_MMUStatus_t stub_mmuSaveDataMemory(const stub_MMUInitStruct_t s, void *p) {
+	FILE *f;
+	bool isWritten;
+
+	if( p == NULL )
+		return STUB_MMU_ERROR;
+
+	if( (f = fopen(s.dataMemoryID, "wb")) == NULL) {
+		return STUB_MMU_ERROR;
+	}
+
+	isWritten = fwrite(p, sizeof(uint8_t), (size_t)s.dataMemorySize, f) == (size_t)s.dataMemorySize;
+	if( fclose(f) != 0 )
+		isWritten = false;
+
+	return isWritten? STUB_MMU_OK : STUB_MMU_ERROR;
+}
+
+
+// Maps the ROM file, or takes another reference to its mapping if it's already mapped
+// Fails if the file is shorter than `codeMemorySize`, the code pages of the memory model.
+void* stub_mmuInitCodeMemory(const stub_MMUInitStruct_t s) {
+	CodeMapping_t *m;
+	struct stat st;
+	void *p = NULL;
+	int fd;
+
+	if( (fd = open(s.codeMemoryID, O_RDONLY | O_CLOEXEC)) < 0 )
+		return NULL;
+
+	if( (fstat(fd, &st) != 0) || (st.st_size < (off_t)s.codeMemorySize) ) {
+		close(fd);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&MappingsLock);
+	for( m = Mappings; m != NULL; m = m -> next ) {
+		if( (m -> device == st.st_dev) && (m -> inode == st.st_ino) && (m -> size == (size_t)s.codeMemorySize) ) {
+			++m -> refs;
+			p = m -> p;
+			goto exit;
+		}
+	}
+
+	if( (m = malloc(sizeof(CodeMapping_t))) == NULL )
+		goto exit;
+
+	m -> p = mmap(NULL, (size_t)s.codeMemorySize, PROT_READ, MAP_SHARED, fd, 0);
+	if( m -> p == MAP_FAILED ) {
+		free(m);
+		goto exit;
+	}
+
+	m -> device = st.st_dev;
+	m -> inode = st.st_ino;
+	m -> size = (size_t)s.codeMemorySize;
+	m -> refs = 1;
+	m -> next = Mappings;
+	Mappings = m;
+	p = m -> p;
+
+exit:
+	pthread_mutex_unlock(&MappingsLock);
+	close(fd);
+	return p;
+}
+
+
+// Drops a reference to the mapping, and unmaps it once the last context using it is done
+void stub_mmuFreeCodeMemory(void *p) {
+	CodeMapping_t **link, *m;
+
+	if( p == NULL )
+		return;
+
+	pthread_mutex_lock(&MappingsLock);
+	for( link = &Mappings; (m = *link) != NULL; link = &m -> next ) {
+		if( m -> p == p ) {
+			if( --m -> refs == 0 ) {
+				*link = m -> next;
+				munmap(m -> p, m -> size);
+				free(m);
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&MappingsLock);
+}
@@ -15,7 +15,11 @@ stub_MMUStatus_t stub_mmuLoadCodeMemory(const stub_MMUInitStruct_t s, void *p) {
 		return STUB_MMU_ERROR;
 	}
 
-	fread(p, sizeof(uint8_t), (size_t)s.codeMemorySize, f);
+	// short files fail, instead of leaving the rest of code memory uninitialized
+	if( fread(p, sizeof(uint8_t), (size_t)s.codeMemorySize, f) != (size_t)s.codeMemorySize ) {
+		fclose(f);
+		return STUB_MMU_ERROR;
+	}
 	fclose(f);
 
 	return STUB_MMU_OK;
@@ -72,27 +76,7 @@ void* stub_mmuInitCodeMemory(const stub_MMUInitStruct_t s) {
 }
 
 
-void* stub_mmuInitDataMemory(const stub_MMUInitStruct_t s) {
-	void *p = malloc((size_t)s.dataMemorySize);
-
-	if( p == NULL )
-		return p;
-
-	if( stub_mmuLoadDataMemory(s, p) != STUB_MMU_OK ) {
-		free(p);	// here `p` is not NULL, so it's safe to ignore the warning
-		return NULL;
-	}
-
-	return p;
-}
-
-
 void stub_mmuFreeCodeMemory(void *p) {
 	if( p != NULL )
 		free(p);
 }
-
-
-inline void stub_mmuFreeDataMemory(void *p) {
-	stub_mmuFreeCodeMemory(p);
-}
@@ -20,6 +20,13 @@ typedef union {
 		uint8_t C	:1;
 	} field;
 } PSW_t;
+// `PSW_t.raw` bits
+#define PSW_C 0x80
+#define PSW_Z 0x40
+#define PSW_S 0x20
+#define PSW_OV 0x10
+#define PSW_MIE 0x08
+#define PSW_HC 0x04
 typedef union {
 	uint64_t qrs[2];
 	uint32_t xrs[4];
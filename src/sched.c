@@ -0,0 +1,166 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+
+#include "core.h"
+#include "coretypes.h"
+#include "sched.h"
+#include "context.h"
+
+
+// Cycle-driven event scheduler
+//
+// Every context has a 64-bit clock, counting the cycles run through `schedRun()`, and a binary min-heap
+// of pending events. `schedRun()` hands the core a budget that ends at the next event, so the core
+// runs at full speed in between, and only stops when something is due.
+// If a memory handler schedules an event before the end of the current budget (say, a timer SFR
+// has been written), the core is stopped with `CORE_STOP_REQUEST_INTERRUPT` to take a new one.
+
+#define WHEN(pos) (ctx -> SchedWhen[ctx -> SchedHeap[pos]])
+
+
+// Puts the event at `pos` of the heap and keeps track of where it is
+static inline void _schedPlace(EmuContext_t *ctx, unsigned int pos, uint8_t id) {
+	ctx -> SchedHeap[pos] = id;
+	ctx -> SchedPosition[id] = pos + 1;
+}
+
+// Moves the event at `pos` up or down until the heap is in order again
+static void _schedFix(EmuContext_t *ctx, unsigned int pos) {
+	uint8_t id = ctx -> SchedHeap[pos];
+	uint64_t when = ctx -> SchedWhen[id];
+	unsigned int child;
+
+	while( (pos > 0) && (WHEN((pos - 1) / 2) > when) ) {
+		_schedPlace(ctx, pos, ctx -> SchedHeap[(pos - 1) / 2]);
+		pos = (pos - 1) / 2;
+	}
+
+	while( (child = pos * 2 + 1) < ctx -> SchedCount ) {
+		if( (child + 1 < ctx -> SchedCount) && (WHEN(child + 1) < WHEN(child)) )
+			++child;
+		if( WHEN(child) >= when )
+			break;
+		_schedPlace(ctx, pos, ctx -> SchedHeap[child]);
+		pos = child;
+	}
+
+	_schedPlace(ctx, pos, id);
+}
+
+// Takes the event at `pos` off the heap
+static void _schedRemove(EmuContext_t *ctx, unsigned int pos) {
+	ctx -> SchedPosition[ctx -> SchedHeap[pos]] = 0;
+	if( pos != --ctx -> SchedCount ) {
+		_schedPlace(ctx, pos, ctx -> SchedHeap[ctx -> SchedCount]);
+		_schedFix(ctx, pos);
+	}
+}
+
+// Runs the handlers of the events that are due, earliest first
+static void _schedFire(EmuContext_t *ctx) {
+	uint8_t id;
+	uint64_t when;
+
+	while( (ctx -> SchedCount != 0) && (WHEN(0) <= ctx -> SchedClock) ) {
+		id = ctx -> SchedHeap[0];
+		when = ctx -> SchedWhen[id];
+		// off the heap first, so that it can schedule itself again
+		_schedRemove(ctx, 0);
+
+		ctx -> CycleCount = 0;
+		ctx -> SchedHandlers[id](ctx, id, when);
+		ctx -> SchedClock += ctx -> CycleCount;
+	}
+}
+
+
+// Sets the clock back to 0 and drops all the events
+// A zeroed context starts like this.
+void schedReset(EmuContext_t *ctx) {
+	unsigned int i;
+
+	ctx -> SchedClock = 0;
+	ctx -> SchedCount = 0;
+	for( i = 0; i < SCHED_EVENTS; ++i ) {
+		ctx -> SchedPosition[i] = 0;
+	}
+}
+
+// Returns the current cycle
+// In a memory handler, it's the cycle the running instruction has started at
+// (the running block, with `CORE_JIT`), otherwise the cycle `schedRun()` has got to.
+uint64_t schedNow(const EmuContext_t *ctx) {
+	return ctx -> SchedClock + (ctx -> IsSchedRunning? (uint64_t)ctx -> RunCycles : 0);
+}
+
+// Makes event `id` come due at cycle `when`, replacing it if it's pending
+// An event that's already due runs as soon as the running instruction is done.
+void schedAt(EmuContext_t *ctx, unsigned int id, uint64_t when, SchedHandler_t handler) {
+	unsigned int pos;
+
+	if( (id >= SCHED_EVENTS) || (handler == NULL) )
+		return;
+
+	ctx -> SchedWhen[id] = when;
+	ctx -> SchedHandlers[id] = handler;
+	if( ctx -> SchedPosition[id] != 0 ) {
+		pos = ctx -> SchedPosition[id] - 1;
+	}
+	else {
+		pos = ctx -> SchedCount++;
+		ctx -> SchedHeap[pos] = id;
+	}
+	_schedFix(ctx, pos);
+
+	// the core has been given a budget that goes past it
+	if( ctx -> IsSchedRunning && (when < ctx -> SchedTarget) )
+		coreSignalInterrupt(ctx);
+}
+
+// Makes event `id` come due `delay` cycles from now, see `schedAt()`
+void schedIn(EmuContext_t *ctx, unsigned int id, uint64_t delay, SchedHandler_t handler) {
+	schedAt(ctx, id, schedNow(ctx) + delay, handler);
+}
+
+// Drops event `id` if it's pending
+void schedCancel(EmuContext_t *ctx, unsigned int id) {
+	if( (id < SCHED_EVENTS) && (ctx -> SchedPosition[id] != 0) )
+		_schedRemove(ctx, ctx -> SchedPosition[id] - 1);
+}
+
+bool schedIsPending(const EmuContext_t *ctx, unsigned int id) {
+	return (id < SCHED_EVENTS) && (ctx -> SchedPosition[id] != 0);
+}
+
+// Runs the core until the clock reaches `until`, running the handlers of the events as they come due
+// Returns `CORE_STOP_BUDGET` once it's there, or why the core has stopped before (see `coreRun()`).
+// `CORE_STOP_INTERRUPT` is used by the scheduler itself, so raise interrupts with events instead of
+// `coreSignalInterrupt()`. The clock may end up a few cycles past `until`, and events may run a few
+// cycles late, as the instruction that uses a budget up is run to the end.
+CORE_STOP_REASON schedRun(EmuContext_t *ctx, uint64_t until) {
+	CoreRunResult_t result;
+	uint64_t target;
+
+	for( ;; ) {
+		_schedFire(ctx);
+		if( ctx -> SchedClock >= until )
+			return CORE_STOP_BUDGET;
+
+		target = until;
+		if( (ctx -> SchedCount != 0) && (WHEN(0) < target) )
+			target = WHEN(0);
+		if( target - ctx -> SchedClock > INT_MAX )
+			target = ctx -> SchedClock + INT_MAX;
+
+		ctx -> SchedTarget = target;
+		ctx -> IsSchedRunning = true;
+		result = coreRun(ctx, (int)(target - ctx -> SchedClock), UINT_MAX);
+		ctx -> IsSchedRunning = false;
+		ctx -> SchedClock += result.cycles;
+
+		if( (result.reason != CORE_STOP_BUDGET) && (result.reason != CORE_STOP_INTERRUPT) )
+			return result.reason;
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef SCHED_H_INCLUDED
+#define SCHED_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "coretypes.h"
+#include "contexttypes.h"
+
+
+// Events a context can have pending at once, their IDs go from 0 to `SCHED_EVENTS - 1`
+// The host numbers them, e.g. one for each timer, key repeat, LCD refresh and standby wakeup.
+// Can't go above 255.
+#define SCHED_EVENTS 16
+
+// Called once the clock has reached `when`, the cycle the event was due
+// It may deliver an interrupt with `coreDoMI()`/`coreDoNMI()`, whose cycles are added to the clock,
+// schedule events (itself included, e.g. at `when + period`), or stop `schedRun()` with `coreRequestStop()`.
+typedef void (*SchedHandler_t)(EmuContext_t *ctx, unsigned int id, uint64_t when);
+
+
+void schedReset(EmuContext_t *ctx);
+uint64_t schedNow(const EmuContext_t *ctx);
+void schedAt(EmuContext_t *ctx, unsigned int id, uint64_t when, SchedHandler_t handler);
+void schedIn(EmuContext_t *ctx, unsigned int id, uint64_t delay, SchedHandler_t handler);
+void schedCancel(EmuContext_t *ctx, unsigned int id);
+bool schedIsPending(const EmuContext_t *ctx, unsigned int id);
+CORE_STOP_REASON schedRun(EmuContext_t *ctx, uint64_t until);
+
+
+#endif
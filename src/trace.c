@@ -0,0 +1,169 @@
+// for `nanosleep()` under -std=c99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "core.h"
+#include "trace.h"
+#include "context.h"
+
+
+#ifdef CORE_TRACE
+// Data memory access tracer
+//
+// `memoryGetData()` and `memorySetData()` hand every access of a traced context to `traceRecord()`,
+// which puts it into a ring buffer, and a consumer thread passes what's there to the sink in batches.
+// The emulation thread is the only one moving `head` and the consumer the only one moving `tail`,
+// so neither takes a lock. Nothing is dropped: once the ring is full, the emulation thread waits
+// for the consumer, so a slow sink slows the run down rather than leaving holes in the trace.
+
+struct Trace {
+	TraceRecord_t *records;
+	size_t mask;			// records in the ring - 1
+	uint64_t head;			// records made, written by the emulation thread
+	uint64_t tail;			// records passed to the sink, written by the consumer
+	bool isStopping;
+	TraceSink_t sink;
+	void *userData;
+	FILE *file;			// for `traceStartFile()`
+	bool isFailed;			// some of them couldn't be written to it
+	pthread_t thread;
+};
+
+// How long the consumer sleeps when the ring is empty, and the emulation thread when it's full
+#define TRACE_IDLE_NS 100000
+#define TRACE_FULL_NS 1000
+
+
+// Passes everything in the ring to the sink, until `traceStop()` has been called and the ring is empty
+static void* _traceConsume(void *arg) {
+	Trace_t *trace = arg;
+	struct timespec idle = {0, TRACE_IDLE_NS};
+	uint64_t head, tail = trace -> tail;
+	size_t count;
+
+	for( ;; ) {
+		head = __atomic_load_n(&trace -> head, __ATOMIC_ACQUIRE);
+		if( head == tail ) {
+			// records made before `traceStop()` are all there once it's seen
+			if( __atomic_load_n(&trace -> isStopping, __ATOMIC_ACQUIRE) &&
+				(__atomic_load_n(&trace -> head, __ATOMIC_ACQUIRE) == tail) )
+				break;
+			nanosleep(&idle, NULL);
+			continue;
+		}
+
+		// up to where the ring wraps around
+		count = (size_t)(head - tail);
+		if( count > trace -> mask + 1 - (tail & trace -> mask) )
+			count = trace -> mask + 1 - (tail & trace -> mask);
+		trace -> sink(trace -> userData, &trace -> records[tail & trace -> mask], count);
+		tail += count;
+		__atomic_store_n(&trace -> tail, tail, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+// Sink of `traceStartFile()`
+static void _traceWrite(void *userData, const TraceRecord_t *records, size_t count) {
+	Trace_t *trace = userData;
+
+	if( fwrite(records, sizeof(TraceRecord_t), count, trace -> file) != count )
+		trace -> isFailed = true;
+}
+
+static bool _traceStart(EmuContext_t *ctx, unsigned int order, TraceSink_t sink, void *userData, FILE *file) {
+	Trace_t *trace;
+
+	if( (ctx -> Trace != NULL) || (order > 30) )
+		return false;
+
+	if( (trace = calloc(1, sizeof(Trace_t))) == NULL )
+		return false;
+	if( (trace -> records = malloc(sizeof(TraceRecord_t) << order)) == NULL ) {
+		free(trace);
+		return false;
+	}
+	trace -> mask = ((size_t)1 << order) - 1;
+	trace -> file = file;
+	trace -> sink = (file != NULL)? _traceWrite : sink;
+	trace -> userData = (file != NULL)? trace : userData;
+
+	if( pthread_create(&trace -> thread, NULL, _traceConsume, trace) != 0 ) {
+		free(trace -> records);
+		free(trace);
+		return false;
+	}
+	ctx -> Trace = trace;
+	return true;
+}
+
+
+// Starts tracing the data memory accesses of `ctx` into a ring of `1 << order` records,
+// which a thread of its own passes to `sink`
+// Records count cycles from when `ctx` was zeroed, see `ctx -> TraceClock`. Accesses made by the host
+// through `memoryGetData()` and `memorySetData()` are traced too. Translated code isn't run meanwhile.
+// Returns false if `ctx` is already being traced, or if the ring or the thread can't be made.
+bool traceStart(EmuContext_t *ctx, unsigned int order, TraceSink_t sink, void *userData) {
+	if( sink == NULL )
+		return false;
+
+	return _traceStart(ctx, order, sink, userData, NULL);
+}
+
+// The same, writing the records to the file at `path`, which is overwritten
+bool traceStartFile(EmuContext_t *ctx, unsigned int order, const char *path) {
+	FILE *f;
+
+	if( (f = fopen(path, "wb")) == NULL )
+		return false;
+
+	if( !_traceStart(ctx, order, NULL, NULL, f) ) {
+		fclose(f);
+		return false;
+	}
+	return true;
+}
+
+// Stops tracing `ctx`, once the sink has got every record, call it from the thread running `ctx`
+// Returns false if some of them couldn't be written to the file of `traceStartFile()`.
+bool traceStop(EmuContext_t *ctx) {
+	Trace_t *trace = ctx -> Trace;
+	bool isWritten = true;
+
+	if( trace == NULL )
+		return true;
+
+	__atomic_store_n(&trace -> isStopping, true, __ATOMIC_RELEASE);
+	pthread_join(trace -> thread, NULL);
+
+	if( trace -> file != NULL ) {
+		isWritten = !trace -> isFailed;
+		if( fclose(trace -> file) != 0 )
+			isWritten = false;
+	}
+	free(trace -> records);
+	free(trace);
+	ctx -> Trace = NULL;
+	return isWritten;
+}
+
+// Puts `record` into the ring, waiting for the consumer if it's full
+// Called by `mmu.c` on the thread running the context.
+void traceRecord(Trace_t *trace, const TraceRecord_t *record) {
+	struct timespec full = {0, TRACE_FULL_NS};
+	uint64_t head = trace -> head;
+
+	while( head - __atomic_load_n(&trace -> tail, __ATOMIC_ACQUIRE) > trace -> mask )
+		nanosleep(&full, NULL);
+
+	trace -> records[head & trace -> mask] = *record;
+	__atomic_store_n(&trace -> head, head + 1, __ATOMIC_RELEASE);
+}
+#endif
@@ -0,0 +1,43 @@
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+#include "contexttypes.h"
+
+
+// One data memory access, as it's written out
+// 24 bytes in host byte order, with no padding, so a trace file is an array of them.
+typedef struct {
+	uint64_t cycle;			// cycles the core had run before the instruction doing the access, see `traceStart()`
+	uint64_t value;			// the value read or written
+	uint16_t pc;			// past the first word of the instruction doing the access
+	uint16_t offset;		// aligned to a word for word and wider accesses
+	uint8_t csr;
+	uint8_t segment;
+	uint8_t flags;			// `TRACE_SIZE` bytes, `TRACE_WRITE`
+	uint8_t region;			// index of the region in `ctx -> Model.regions`, `regionCount` if none has it
+} TraceRecord_t;
+
+#define TRACE_SIZE 0x0f			// 1, 2, 4 or 8
+#define TRACE_WRITE 0x80
+
+// Called by the consumer thread with records in the order they were made, `count` of them at `records`
+typedef void (*TraceSink_t)(void *userData, const TraceRecord_t *records, size_t count);
+
+typedef struct Trace Trace_t;
+
+
+#ifdef CORE_TRACE
+bool traceStart(EmuContext_t *ctx, unsigned int order, TraceSink_t sink, void *userData);
+bool traceStartFile(EmuContext_t *ctx, unsigned int order, const char *path);
+bool traceStop(EmuContext_t *ctx);
+void traceRecord(Trace_t *trace, const TraceRecord_t *record);
+#endif
+
+
+#endif